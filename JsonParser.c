@@ -1,17 +1,85 @@
+#if defined(__unix__) || defined(__APPLE__)
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200112L
+#endif
+#define JSON_POSIX 1
+#endif
+
+#if defined(JSON_POSIX) && !defined(JSON_PARSE_NO_THREADS)
+#define JSON_THREADS 1
+#endif
+
 #include "JsonParser.h"
 #include <assert.h>
 #include <memory.h>
+#include <stddef.h>
 #include <stdio.h>
+#include <stdint.h>
+#include "JsonParserTables.h"
+
+#ifdef JSON_POSIX
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+#ifdef JSON_THREADS
+#include <pthread.h>
+#endif
+
+#if !defined(JSON_PARSE_NO_SIMD) && (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define JSON_SIMD_X86 1
+#include <immintrin.h>
+#endif
+
+#ifndef JSON_ARENA_BLOCK_SIZE
+#define JSON_ARENA_BLOCK_SIZE 4096
+#endif
+
+/* every arena allocation is rounded up to keep doubles and pointers aligned */
+#define JSON_ARENA_ALIGN(size) (((size) + 7) & ~(size_t)7)
+
+static json_allocator json_alloc_hooks = { malloc, realloc, free };
+
+#define JSON_MALLOC(size) (json_alloc_hooks.malloc_fn(size))
+#define JSON_REALLOC(ptr, size) (json_alloc_hooks.realloc_fn((ptr), (size)))
+#define JSON_FREE(ptr) (json_alloc_hooks.free_fn(ptr))
+
+typedef struct json_arena_block json_arena_block;
+
+struct json_arena_block {
+    json_arena_block *next;
+    size_t size, top; /* usable bytes after the header, bytes handed out */
+};
+
+typedef struct {
+    json_arena_block *head;
+    size_t next_size;
+} json_arena;
+
+struct json_document {
+    json_arena arena;
+    json_arena *workers; size_t worker_count; /* private arenas of json_parse_into_parallel workers */
+    json_value root;
+};
 
 typedef struct {
-    const char *json;
+    const char *json, *end; /* input is [json, end), no NUL terminator required */
     char * stack;
     size_t size, top;
+    json_arena *arena; /* NULL: nodes are malloc'd one by one */
+    unsigned flags; /* JSON_PARSE_* option flags */
+    json_key_table *keys; /* JSON_PARSE_INTERN_KEYS */
+    int checked; /* the input already passed json_skip_value, see json_parse_lazy */
 }json_context;
 
 static int json_parse_value(json_context *context, json_value *value);
 
-#define EXPECT(c, ch) do { assert(*(c)->json == (ch)); (c)->json++; } while(0)
+#define EXPECT(c, ch) do { assert((c)->json < (c)->end && *(c)->json == (ch)); (c)->json++; } while(0)
+#define PEEK(c) ((c)->json < (c)->end ? *(c)->json : '\0')
 #define ISDIGIT(ch) ((ch) >= '0' && (ch) <= '9')
 #define ISDIGIT1TO9(ch) ((ch) >= '1' && (ch) <= '9')
 
@@ -32,7 +100,7 @@ static void* json_context_push(json_context *context, size_t size) {
             context->size += context->size >> 1;
         }
 
-        context->stack = (char *)realloc(context->stack, context->size);
+        context->stack = (char *)JSON_REALLOC(context->stack, context->size);
     }
 
     ret = context->stack + context->top;
@@ -45,12 +113,626 @@ static void* json_context_pop(json_context *context, size_t size) {
     return context->stack + (context->top -= size);
 }
 
+static void json_context_init(json_context *context, const char *json, size_t len,
+                              json_arena *arena, const json_parse_options *options) {
+    context->json = json;
+    context->end = json + len;
+    context->stack = NULL;
+    context->size = context->top = 0;
+    context->arena = arena;
+    context->flags = options ? options->flags : 0;
+    context->keys = (context->flags & JSON_PARSE_INTERN_KEYS) ? options->keys : NULL;
+    context->checked = 0;
+}
+
+#define JSON_ARENA_HEADER_SIZE JSON_ARENA_ALIGN(sizeof(json_arena_block))
+
+static void* json_arena_alloc(json_arena *arena, size_t size) {
+    json_arena_block *block = arena->head;
+    void *ret;
+
+    size = JSON_ARENA_ALIGN(size);
+
+    if (NULL == block || block->top + size > block->size) {
+        size_t block_size = arena->next_size;
+
+        if (block_size < JSON_ARENA_BLOCK_SIZE) {
+            block_size = JSON_ARENA_BLOCK_SIZE;
+        }
+
+        if (size > block_size) {
+            /* oversized request gets a block of its own, the current one keeps bumping */
+            block = (json_arena_block *)JSON_MALLOC(JSON_ARENA_HEADER_SIZE + size);
+            block->size = block->top = size;
+            if (NULL == arena->head) {
+                block->next = NULL;
+                arena->head = block;
+            } else {
+                block->next = arena->head->next;
+                arena->head->next = block;
+            }
+            return (char *)block + JSON_ARENA_HEADER_SIZE;
+        }
+
+        block = (json_arena_block *)JSON_MALLOC(JSON_ARENA_HEADER_SIZE + block_size);
+        block->size = block_size;
+        block->top = 0;
+        block->next = arena->head;
+        arena->head = block;
+        arena->next_size = block_size * 2;
+    }
+
+    ret = (char *)block + JSON_ARENA_HEADER_SIZE + block->top;
+    block->top += size;
+    return ret;
+}
+
+static void json_arena_release(json_arena *arena) {
+    json_arena_block *block = arena->head;
+
+    while (NULL != block) {
+        json_arena_block *next = block->next;
+        JSON_FREE(block);
+        block = next;
+    }
+
+    arena->head = NULL;
+    arena->next_size = 0;
+}
+
+static void* json_context_alloc(json_context *context, size_t size) {
+    return context->arena ? json_arena_alloc(context->arena, size) : JSON_MALLOC(size);
+}
+
+static void json_context_free_value(json_context *context, json_value *value) {
+    /* arena nodes die with their document */
+    if (NULL == context->arena) {
+        json_value_free(value);
+    }
+}
+
+/*
+ * Scanning layer: bulk scans over [p, end) with a scalar version and
+ * SSE2/AVX2 versions picked once at runtime. Vector loops never read past
+ * end, the remaining tail always goes through the scalar code.
+ */
+#define ISWS(ch) ((ch) == ' ' || (ch) == '\t' || (ch) == '\n' || (ch) == '\r')
+
+/* one bit per byte of a 64-byte block, bit i for block[i] */
+typedef struct {
+    uint64_t quote, backslash, whitespace, op; /* op: one of {}[]:, */
+} json_block_masks;
+
+/* string state carried from one block to the next */
+typedef struct {
+    uint64_t prev_escaped, prev_in_string;
+} json_block_carry;
+
+typedef struct {
+    const char* (*skip_whitespace)(const char *p, const char *end);
+    /* stops at the first '"', '\\' or control character */
+    const char* (*scan_string)(const char *p, const char *end);
+    void (*classify)(const char *block, json_block_masks *masks);
+    /* whether [p, end) is well-formed UTF-8 */
+    int (*validate_utf8)(const char *p, const char *end);
+} json_scanner;
+
+static const char* json_skip_whitespace_scalar(const char *p, const char *end) {
+    while (p < end && ISWS(*p)) {
+        p++;
+    }
+    return p;
+}
+
+static const char* json_scan_string_scalar(const char *p, const char *end) {
+    while (p < end) {
+        unsigned char ch = (unsigned char)*p;
+        if ('\"' == ch || '\\' == ch || ch < 0x20) {
+            break;
+        }
+        p++;
+    }
+    return p;
+}
+
+static void json_classify_scalar(const char *block, json_block_masks *masks) {
+    int i;
+
+    masks->quote = masks->backslash = masks->whitespace = masks->op = 0;
+    for (i = 0; i < 64; i++) {
+        uint64_t bit = (uint64_t)1 << i;
+        switch (block[i]) {
+            case '\"': masks->quote |= bit; break;
+            case '\\': masks->backslash |= bit; break;
+            case ' ': case '\t': case '\n': case '\r': masks->whitespace |= bit; break;
+            case '{': case '}': case '[': case ']': case ':': case ',': masks->op |= bit; break;
+        }
+    }
+}
+
+/*
+ * UTF-8 as RFC 3629 has it: no overlong forms, no surrogates, nothing above
+ * U+10FFFF. The length of the well-formed sequence at s, 0 for none.
+ */
+static size_t json_utf8_sequence(const unsigned char *s, const unsigned char *end) {
+    unsigned char low = 0x80, high = 0xBF;
+    size_t n, i;
+
+    if (s[0] < 0x80) {
+        return 1;
+    } else if (s[0] < 0xC2) {
+        return 0;
+    } else if (s[0] < 0xE0) {
+        n = 2;
+    } else if (s[0] < 0xF0) {
+        n = 3;
+        if (0xE0 == s[0]) low = 0xA0;
+        else if (0xED == s[0]) high = 0x9F;
+    } else if (s[0] < 0xF5) {
+        n = 4;
+        if (0xF0 == s[0]) low = 0x90;
+        else if (0xF4 == s[0]) high = 0x8F;
+    } else {
+        return 0;
+    }
+
+    if ((size_t)(end - s) < n || s[1] < low || s[1] > high) {
+        return 0;
+    }
+    for (i = 2; i < n; i++) {
+        if (0x80 != (s[i] & 0xC0)) {
+            return 0;
+        }
+    }
+    return n;
+}
+
+static int json_validate_utf8_scalar(const char *p, const char *end) {
+    const unsigned char *s = (const unsigned char *)p, *e = (const unsigned char *)end;
+
+    while (s < e) {
+        size_t n = json_utf8_sequence(s, e);
+        if (0 == n) {
+            return 0;
+        }
+        s += n;
+    }
+    return 1;
+}
+
+#ifdef JSON_SIMD_X86
+
+__attribute__((target("sse2")))
+static const char* json_skip_whitespace_sse2(const char *p, const char *end) {
+    const __m128i space = _mm_set1_epi8(' '), tab = _mm_set1_epi8('\t');
+    const __m128i lf = _mm_set1_epi8('\n'), cr = _mm_set1_epi8('\r');
+
+    while (end - p >= 16) {
+        __m128i chunk = _mm_loadu_si128((const __m128i *)p);
+        __m128i ws = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, space), _mm_cmpeq_epi8(chunk, tab)),
+                                  _mm_or_si128(_mm_cmpeq_epi8(chunk, lf), _mm_cmpeq_epi8(chunk, cr)));
+        unsigned mask = (unsigned)_mm_movemask_epi8(ws) ^ 0xFFFFu;
+
+        if (0 != mask) {
+            return p + __builtin_ctz(mask);
+        }
+        p += 16;
+    }
+
+    return json_skip_whitespace_scalar(p, end);
+}
+
+__attribute__((target("sse2")))
+static const char* json_scan_string_sse2(const char *p, const char *end) {
+    const __m128i quote = _mm_set1_epi8('\"'), backslash = _mm_set1_epi8('\\');
+    const __m128i control = _mm_set1_epi8(0x1F);
+
+    while (end - p >= 16) {
+        __m128i chunk = _mm_loadu_si128((const __m128i *)p);
+        /* unsigned ch <= 0x1F  <=>  max(ch, 0x1F) == 0x1F */
+        __m128i stop = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash)),
+                                    _mm_cmpeq_epi8(_mm_max_epu8(chunk, control), control));
+        unsigned mask = (unsigned)_mm_movemask_epi8(stop);
+
+        if (0 != mask) {
+            return p + __builtin_ctz(mask);
+        }
+        p += 16;
+    }
+
+    return json_scan_string_scalar(p, end);
+}
+
+__attribute__((target("avx2")))
+static const char* json_skip_whitespace_avx2(const char *p, const char *end) {
+    const __m256i space = _mm256_set1_epi8(' '), tab = _mm256_set1_epi8('\t');
+    const __m256i lf = _mm256_set1_epi8('\n'), cr = _mm256_set1_epi8('\r');
+
+    while (end - p >= 32) {
+        __m256i chunk = _mm256_loadu_si256((const __m256i *)p);
+        __m256i ws = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(chunk, space), _mm256_cmpeq_epi8(chunk, tab)),
+                                     _mm256_or_si256(_mm256_cmpeq_epi8(chunk, lf), _mm256_cmpeq_epi8(chunk, cr)));
+        unsigned mask = ~(unsigned)_mm256_movemask_epi8(ws);
+
+        if (0 != mask) {
+            return p + __builtin_ctz(mask);
+        }
+        p += 32;
+    }
+
+    return json_skip_whitespace_sse2(p, end);
+}
+
+__attribute__((target("avx2")))
+static const char* json_scan_string_avx2(const char *p, const char *end) {
+    const __m256i quote = _mm256_set1_epi8('\"'), backslash = _mm256_set1_epi8('\\');
+    const __m256i control = _mm256_set1_epi8(0x1F);
+
+    while (end - p >= 32) {
+        __m256i chunk = _mm256_loadu_si256((const __m256i *)p);
+        __m256i stop = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(chunk, quote), _mm256_cmpeq_epi8(chunk, backslash)),
+                                       _mm256_cmpeq_epi8(_mm256_max_epu8(chunk, control), control));
+        unsigned mask = (unsigned)_mm256_movemask_epi8(stop);
+
+        if (0 != mask) {
+            return p + __builtin_ctz(mask);
+        }
+        p += 32;
+    }
+
+    return json_scan_string_sse2(p, end);
+}
+
+/* ASCII 16 bytes at a time, sequences one by one */
+__attribute__((target("sse2")))
+static int json_validate_utf8_sse2(const char *p, const char *end) {
+    while (end - p >= 16) {
+        unsigned mask = (unsigned)_mm_movemask_epi8(_mm_loadu_si128((const __m128i *)p));
+        size_t n;
+
+        if (0 == mask) {
+            p += 16;
+            continue;
+        }
+        p += __builtin_ctz(mask);
+        if (0 == (n = json_utf8_sequence((const unsigned char *)p, (const unsigned char *)end))) {
+            return 0;
+        }
+        p += n;
+    }
+
+    return json_validate_utf8_scalar(p, end);
+}
+
+/* '[' and '{' differ only in bit 0x20, as do ']' and '}' */
+__attribute__((target("sse2")))
+static void json_classify_sse2(const char *block, json_block_masks *masks) {
+    const __m128i quote = _mm_set1_epi8('\"'), backslash = _mm_set1_epi8('\\');
+    const __m128i space = _mm_set1_epi8(' '), tab = _mm_set1_epi8('\t');
+    const __m128i lf = _mm_set1_epi8('\n'), cr = _mm_set1_epi8('\r');
+    const __m128i fold = _mm_set1_epi8(0x20), open = _mm_set1_epi8('{'), close = _mm_set1_epi8('}');
+    const __m128i colon = _mm_set1_epi8(':'), comma = _mm_set1_epi8(',');
+    int i;
+
+    masks->quote = masks->backslash = masks->whitespace = masks->op = 0;
+    for (i = 0; i < 64; i += 16) {
+        __m128i chunk = _mm_loadu_si128((const __m128i *)(block + i));
+        __m128i folded = _mm_or_si128(chunk, fold);
+        __m128i ws = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, space), _mm_cmpeq_epi8(chunk, tab)),
+                                  _mm_or_si128(_mm_cmpeq_epi8(chunk, lf), _mm_cmpeq_epi8(chunk, cr)));
+        __m128i op = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(folded, open), _mm_cmpeq_epi8(folded, close)),
+                                  _mm_or_si128(_mm_cmpeq_epi8(chunk, colon), _mm_cmpeq_epi8(chunk, comma)));
+
+        masks->quote |= (uint64_t)(unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, quote)) << i;
+        masks->backslash |= (uint64_t)(unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, backslash)) << i;
+        masks->whitespace |= (uint64_t)(unsigned)_mm_movemask_epi8(ws) << i;
+        masks->op |= (uint64_t)(unsigned)_mm_movemask_epi8(op) << i;
+    }
+}
+
+__attribute__((target("avx2")))
+static void json_classify_avx2(const char *block, json_block_masks *masks) {
+    const __m256i quote = _mm256_set1_epi8('\"'), backslash = _mm256_set1_epi8('\\');
+    const __m256i space = _mm256_set1_epi8(' '), tab = _mm256_set1_epi8('\t');
+    const __m256i lf = _mm256_set1_epi8('\n'), cr = _mm256_set1_epi8('\r');
+    const __m256i fold = _mm256_set1_epi8(0x20), open = _mm256_set1_epi8('{'), close = _mm256_set1_epi8('}');
+    const __m256i colon = _mm256_set1_epi8(':'), comma = _mm256_set1_epi8(',');
+    int i;
+
+    masks->quote = masks->backslash = masks->whitespace = masks->op = 0;
+    for (i = 0; i < 64; i += 32) {
+        __m256i chunk = _mm256_loadu_si256((const __m256i *)(block + i));
+        __m256i folded = _mm256_or_si256(chunk, fold);
+        __m256i ws = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(chunk, space), _mm256_cmpeq_epi8(chunk, tab)),
+                                     _mm256_or_si256(_mm256_cmpeq_epi8(chunk, lf), _mm256_cmpeq_epi8(chunk, cr)));
+        __m256i op = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(folded, open), _mm256_cmpeq_epi8(folded, close)),
+                                     _mm256_or_si256(_mm256_cmpeq_epi8(chunk, colon), _mm256_cmpeq_epi8(chunk, comma)));
+
+        masks->quote |= (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, quote)) << i;
+        masks->backslash |= (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, backslash)) << i;
+        masks->whitespace |= (uint64_t)(uint32_t)_mm256_movemask_epi8(ws) << i;
+        masks->op |= (uint64_t)(uint32_t)_mm256_movemask_epi8(op) << i;
+    }
+}
+
+/*
+ * UTF-8 by table lookups (Keiser and Lemire 2021): the high nibble of each
+ * byte and both nibbles of the byte before it each select the set of
+ * errors that pair could be; a pair is bad when all three agree. Third and
+ * fourth bytes, which no pair sees, are checked against the leads two and
+ * three bytes back. A run that ends inside a sequence fails through the
+ * zero padding of its last block.
+ */
+#define JSON_UTF8_TOO_SHORT 0x01 /* a lead not followed by a continuation */
+#define JSON_UTF8_TOO_LONG 0x02 /* a continuation after ASCII */
+#define JSON_UTF8_OVERLONG_3 0x04
+#define JSON_UTF8_TOO_LARGE 0x08
+#define JSON_UTF8_SURROGATE 0x10
+#define JSON_UTF8_OVERLONG_2 0x20
+#define JSON_UTF8_TOO_LARGE_1000 0x40
+#define JSON_UTF8_OVERLONG_4 0x40
+#define JSON_UTF8_TWO_CONTS 0x80 /* a continuation after a continuation, fine only as a third or fourth byte */
+#define JSON_UTF8_CARRY (JSON_UTF8_TOO_SHORT | JSON_UTF8_TOO_LONG | JSON_UTF8_TWO_CONTS)
+
+/* the same 16 entries in both lanes, for _mm256_shuffle_epi8 */
+#define JSON_UTF8_TABLE(a, b, c, d, e, f, g, h, i, j, k, l, m, n, o, p) \
+    _mm256_setr_epi8((char)(a), (char)(b), (char)(c), (char)(d), (char)(e), (char)(f), (char)(g), (char)(h),\
+                     (char)(i), (char)(j), (char)(k), (char)(l), (char)(m), (char)(n), (char)(o), (char)(p),\
+                     (char)(a), (char)(b), (char)(c), (char)(d), (char)(e), (char)(f), (char)(g), (char)(h),\
+                     (char)(i), (char)(j), (char)(k), (char)(l), (char)(m), (char)(n), (char)(o), (char)(p))
+
+/* input shifted by n bytes, the first n from the end of previous */
+#define JSON_UTF8_PREV(input, previous, n) \
+    _mm256_alignr_epi8(input, _mm256_permute2x128_si256(previous, input, 0x21), 16 - (n))
+
+__attribute__((target("avx2")))
+static __m256i json_utf8_block_errors(__m256i input, __m256i previous) {
+    const __m256i nibble = _mm256_set1_epi8(0x0F);
+    const __m256i byte_1_high_table = JSON_UTF8_TABLE(
+        JSON_UTF8_TOO_LONG, JSON_UTF8_TOO_LONG, JSON_UTF8_TOO_LONG, JSON_UTF8_TOO_LONG,
+        JSON_UTF8_TOO_LONG, JSON_UTF8_TOO_LONG, JSON_UTF8_TOO_LONG, JSON_UTF8_TOO_LONG,
+        JSON_UTF8_TWO_CONTS, JSON_UTF8_TWO_CONTS, JSON_UTF8_TWO_CONTS, JSON_UTF8_TWO_CONTS,
+        JSON_UTF8_TOO_SHORT | JSON_UTF8_OVERLONG_2,
+        JSON_UTF8_TOO_SHORT,
+        JSON_UTF8_TOO_SHORT | JSON_UTF8_OVERLONG_3 | JSON_UTF8_SURROGATE,
+        JSON_UTF8_TOO_SHORT | JSON_UTF8_TOO_LARGE | JSON_UTF8_TOO_LARGE_1000 | JSON_UTF8_OVERLONG_4);
+    const __m256i byte_1_low_table = JSON_UTF8_TABLE(
+        JSON_UTF8_CARRY | JSON_UTF8_OVERLONG_3 | JSON_UTF8_OVERLONG_2 | JSON_UTF8_OVERLONG_4,
+        JSON_UTF8_CARRY | JSON_UTF8_OVERLONG_2,
+        JSON_UTF8_CARRY,
+        JSON_UTF8_CARRY,
+        JSON_UTF8_CARRY | JSON_UTF8_TOO_LARGE,
+        JSON_UTF8_CARRY | JSON_UTF8_TOO_LARGE | JSON_UTF8_TOO_LARGE_1000,
+        JSON_UTF8_CARRY | JSON_UTF8_TOO_LARGE | JSON_UTF8_TOO_LARGE_1000,
+        JSON_UTF8_CARRY | JSON_UTF8_TOO_LARGE | JSON_UTF8_TOO_LARGE_1000,
+        JSON_UTF8_CARRY | JSON_UTF8_TOO_LARGE | JSON_UTF8_TOO_LARGE_1000,
+        JSON_UTF8_CARRY | JSON_UTF8_TOO_LARGE | JSON_UTF8_TOO_LARGE_1000,
+        JSON_UTF8_CARRY | JSON_UTF8_TOO_LARGE | JSON_UTF8_TOO_LARGE_1000,
+        JSON_UTF8_CARRY | JSON_UTF8_TOO_LARGE | JSON_UTF8_TOO_LARGE_1000,
+        JSON_UTF8_CARRY | JSON_UTF8_TOO_LARGE | JSON_UTF8_TOO_LARGE_1000,
+        JSON_UTF8_CARRY | JSON_UTF8_TOO_LARGE | JSON_UTF8_TOO_LARGE_1000 | JSON_UTF8_SURROGATE,
+        JSON_UTF8_CARRY | JSON_UTF8_TOO_LARGE | JSON_UTF8_TOO_LARGE_1000,
+        JSON_UTF8_CARRY | JSON_UTF8_TOO_LARGE | JSON_UTF8_TOO_LARGE_1000);
+    const __m256i byte_2_high_table = JSON_UTF8_TABLE(
+        JSON_UTF8_TOO_SHORT, JSON_UTF8_TOO_SHORT, JSON_UTF8_TOO_SHORT, JSON_UTF8_TOO_SHORT,
+        JSON_UTF8_TOO_SHORT, JSON_UTF8_TOO_SHORT, JSON_UTF8_TOO_SHORT, JSON_UTF8_TOO_SHORT,
+        JSON_UTF8_TOO_LONG | JSON_UTF8_OVERLONG_2 | JSON_UTF8_TWO_CONTS | JSON_UTF8_OVERLONG_3 |
+            JSON_UTF8_TOO_LARGE_1000 | JSON_UTF8_OVERLONG_4,
+        JSON_UTF8_TOO_LONG | JSON_UTF8_OVERLONG_2 | JSON_UTF8_TWO_CONTS | JSON_UTF8_OVERLONG_3 | JSON_UTF8_TOO_LARGE,
+        JSON_UTF8_TOO_LONG | JSON_UTF8_OVERLONG_2 | JSON_UTF8_TWO_CONTS | JSON_UTF8_SURROGATE | JSON_UTF8_TOO_LARGE,
+        JSON_UTF8_TOO_LONG | JSON_UTF8_OVERLONG_2 | JSON_UTF8_TWO_CONTS | JSON_UTF8_SURROGATE | JSON_UTF8_TOO_LARGE,
+        JSON_UTF8_TOO_SHORT, JSON_UTF8_TOO_SHORT, JSON_UTF8_TOO_SHORT, JSON_UTF8_TOO_SHORT);
+    __m256i prev1 = JSON_UTF8_PREV(input, previous, 1);
+    __m256i special = _mm256_and_si256(
+        _mm256_and_si256(
+            _mm256_shuffle_epi8(byte_1_high_table, _mm256_and_si256(_mm256_srli_epi16(prev1, 4), nibble)),
+            _mm256_shuffle_epi8(byte_1_low_table, _mm256_and_si256(prev1, nibble))),
+        _mm256_shuffle_epi8(byte_2_high_table, _mm256_and_si256(_mm256_srli_epi16(input, 4), nibble)));
+    /* only 111xxxxx two back and 1111xxxx three back reach 0x80 */
+    __m256i third = _mm256_subs_epu8(JSON_UTF8_PREV(input, previous, 2), _mm256_set1_epi8((char)(0xE0 - 0x80)));
+    __m256i fourth = _mm256_subs_epu8(JSON_UTF8_PREV(input, previous, 3), _mm256_set1_epi8((char)(0xF0 - 0x80)));
+    __m256i must_continue = _mm256_and_si256(_mm256_or_si256(third, fourth), _mm256_set1_epi8((char)0x80));
+
+    return _mm256_xor_si256(must_continue, special);
+}
+
+__attribute__((target("avx2")))
+static int json_validate_utf8_avx2(const char *p, const char *end) {
+    __m256i previous = _mm256_setzero_si256(), errors = _mm256_setzero_si256(), input;
+    char tail[32];
+
+    /* strings are mostly ASCII: up to the first block that is not, no table is needed */
+    while (end - p >= 32) {
+        input = _mm256_loadu_si256((const __m256i *)p);
+        if (0 != _mm256_movemask_epi8(input)) {
+            break;
+        }
+        p += 32;
+    }
+    if (end - p < 32) {
+        return json_validate_utf8_scalar(p, end);
+    }
+
+    for (; end - p >= 32; p += 32) {
+        input = _mm256_loadu_si256((const __m256i *)p);
+        errors = _mm256_or_si256(errors, json_utf8_block_errors(input, previous));
+        previous = input;
+    }
+    memset(tail, 0, sizeof(tail));
+    memcpy(tail, p, end - p);
+    input = _mm256_loadu_si256((const __m256i *)tail);
+    errors = _mm256_or_si256(errors, json_utf8_block_errors(input, previous));
+
+    return _mm256_testz_si256(errors, errors);
+}
+
+#endif
+
+static const json_scanner json_scanners[] = {
+    { json_skip_whitespace_scalar, json_scan_string_scalar, json_classify_scalar, json_validate_utf8_scalar }
+#ifdef JSON_SIMD_X86
+    ,{ json_skip_whitespace_sse2, json_scan_string_sse2, json_classify_sse2, json_validate_utf8_sse2 }
+    ,{ json_skip_whitespace_avx2, json_scan_string_avx2, json_classify_avx2, json_validate_utf8_avx2 }
+#endif
+};
+
+static int json_simd_supported(void) {
+#ifdef JSON_SIMD_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return JSON_SIMD_AVX2;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        return JSON_SIMD_SSE2;
+    }
+#endif
+    return JSON_SIMD_NONE;
+}
+
+#ifdef JSON_SIMD_X86
+static const char* json_skip_whitespace_resolve(const char *p, const char *end);
+static const char* json_scan_string_resolve(const char *p, const char *end);
+static void json_classify_resolve(const char *block, json_block_masks *masks);
+static int json_validate_utf8_resolve(const char *p, const char *end);
+
+/* starts out with resolvers that install the best scanners on first call */
+static json_scanner json_scan = {
+    json_skip_whitespace_resolve, json_scan_string_resolve, json_classify_resolve, json_validate_utf8_resolve
+};
+#else
+static json_scanner json_scan = {
+    json_skip_whitespace_scalar, json_scan_string_scalar, json_classify_scalar, json_validate_utf8_scalar
+};
+#endif
+
+/*
+ * One pointer at a time rather than a struct copy, so a reader never
+ * sees a torn scanner.
+ */
+static void json_scan_install(int level) {
+    json_scan.skip_whitespace = json_scanners[level].skip_whitespace;
+    json_scan.scan_string = json_scanners[level].scan_string;
+    json_scan.classify = json_scanners[level].classify;
+    json_scan.validate_utf8 = json_scanners[level].validate_utf8;
+}
+
+#ifdef JSON_SIMD_X86
+/*
+ * Resolved when the library is loaded, before any thread can parse, so
+ * parses started on several threads at once never write json_scan. The
+ * resolvers only serve parses run from other constructors ahead of this.
+ */
+__attribute__((constructor)) static void json_scan_resolve(void) {
+    json_scan_install(json_simd_supported());
+}
+
+static const char* json_skip_whitespace_resolve(const char *p, const char *end) {
+    json_scan_resolve();
+    return json_scan.skip_whitespace(p, end);
+}
+
+static const char* json_scan_string_resolve(const char *p, const char *end) {
+    json_scan_resolve();
+    return json_scan.scan_string(p, end);
+}
+
+static void json_classify_resolve(const char *block, json_block_masks *masks) {
+    json_scan_resolve();
+    json_scan.classify(block, masks);
+}
+
+static int json_validate_utf8_resolve(const char *p, const char *end) {
+    json_scan_resolve();
+    return json_scan.validate_utf8(p, end);
+}
+#endif
+
+int json_set_simd(int level) {
+    int supported = json_simd_supported();
+
+    if (level > supported) {
+        level = supported;
+    }
+    if (level < JSON_SIMD_NONE) {
+        level = JSON_SIMD_NONE;
+    }
+
+    json_scan_install(level);
+    return level;
+}
+
+/* classifies the 64 bytes at p, a block cut short by end is padded with spaces */
+static void json_classify_block(const char *p, const char *end, json_block_masks *masks) {
+    if (end - p < 64) {
+        char tail[64];
+        memset(tail, ' ', sizeof(tail));
+        memcpy(tail, p, end - p);
+        json_scan.classify(tail, masks);
+    } else {
+        json_scan.classify(p, masks);
+    }
+}
+
+static int json_ctz64(uint64_t x) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_ctzll(x);
+#else
+    int n = 0;
+    while (!(x & 1)) {
+        x >>= 1;
+        n++;
+    }
+    return n;
+#endif
+}
+
+/* bit i is the xor of bits 0..i */
+static uint64_t json_prefix_xor(uint64_t x) {
+    x ^= x << 1;
+    x ^= x << 2;
+    x ^= x << 4;
+    x ^= x << 8;
+    x ^= x << 16;
+    x ^= x << 32;
+    return x;
+}
+
+/*
+ * Drops escaped quotes from masks->quote and returns the bytes inside
+ * strings, each from its opening quote up to, not including, its closing
+ * quote. A quote is escaped when an odd run of backslashes ends right
+ * before it.
+ */
+static uint64_t json_block_strings(json_block_masks *masks, json_block_carry *carry) {
+    const uint64_t even_bits = UINT64_C(0x5555555555555555);
+    uint64_t backslash, follows_escape, odd_starts, sequences, in_string;
+
+    /* a block starting with an escaped backslash does not start a run with it */
+    backslash = masks->backslash & ~carry->prev_escaped;
+    follows_escape = backslash << 1 | carry->prev_escaped;
+    /* adding a run to its start bit carries out of it; runs on odd bits flip the parity */
+    odd_starts = backslash & ~even_bits & ~follows_escape;
+    sequences = odd_starts + backslash;
+    carry->prev_escaped = sequences < odd_starts;
+    masks->quote &= ~((even_bits ^ sequences << 1) & follows_escape);
+
+    in_string = json_prefix_xor(masks->quote) ^ carry->prev_in_string;
+    carry->prev_in_string = 0 - (in_string >> 63);
+    return in_string;
+}
+
 /* ws = *(%x20 / %x09 / %x0A / %x0D) */
 static void json_parse_whitespace(json_context *context) {
-    const char *p = context->json;
-    while (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r') {
-        p ++;
+    const char *p = context->json, *end = context->end;
+
+    /* compact text has at most one blank between tokens, only longer runs go wide */
+    if (p < end && ISWS(*p)) {
+        p++;
+        if (p < end && ISWS(*p)) {
+            p = json_scan.skip_whitespace(p + 1, end);
+        }
     }
+
     context->json = p;
 }
 
@@ -63,7 +745,7 @@ static int json_parse_literal(json_context *context,
     EXPECT(context, literal[0]);
 
     for (i = 0; literal[i + 1]; i++) {
-        if (context->json[i] != literal[i + 1]) {
+        if (context->json + i == context->end || context->json[i] != literal[i + 1]) {
             return JSON_PARSE_INVALID_VALUE;
         }
     }
@@ -80,63 +762,360 @@ static int json_parse_literal(json_context *context,
  * frac = "." 1*digit
  * exp = ("e" / "E") ["-" / "+"] 1*digit
 */
-static int json_parse_number(json_context *context, json_value *value) {
-    const char *p = context->json;
+/*
+ * Decimal to double conversion: w * 10^q with w holding at most 19
+ * significant digits. Clinger's exact fast path covers short values,
+ * Eisel-Lemire the rest; the few cases it cannot settle are rounded by
+ * strtod over a radix-free copy of the digits, so the result is always
+ * the correctly rounded double.
+ */
+#define JSON_DOUBLE_MANTISSA_BITS 52
+#define JSON_DOUBLE_INFINITE_POWER 0x7FF
+#define JSON_NUMBER_MAX_DIGITS 19
 
-    if ('-' == *p) p++;
-    if ('0' == *p) {
-        p++;
-    } else {
-        if (!ISDIGIT1TO9(*p)) {
-            return JSON_PARSE_INVALID_VALUE;
-        }
-        for (p++; ISDIGIT(*p); p++);
+#if defined(__SIZEOF_INT128__)
+__extension__ typedef unsigned __int128 json_uint128;
+#endif
+
+static void json_mul_64x64(uint64_t a, uint64_t b, uint64_t *high, uint64_t *low) {
+#if defined(__SIZEOF_INT128__)
+    json_uint128 r = (json_uint128)a * b;
+    *high = (uint64_t)(r >> 64);
+    *low = (uint64_t)r;
+#else
+    uint64_t a_lo = (uint32_t)a, a_hi = a >> 32, b_lo = (uint32_t)b, b_hi = b >> 32;
+    uint64_t lo_lo = a_lo * b_lo, hi_lo = a_hi * b_lo, lo_hi = a_lo * b_hi, hi_hi = a_hi * b_hi;
+    uint64_t cross = (lo_lo >> 32) + (uint32_t)hi_lo + lo_hi;
+    *high = hi_hi + (hi_lo >> 32) + (cross >> 32);
+    *low = (cross << 32) | (uint32_t)lo_lo;
+#endif
+}
+
+static int json_clz64(uint64_t x) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_clzll(x);
+#else
+    int n = 0;
+    while (!(x & (UINT64_C(1) << 63))) {
+        x <<= 1;
+        n++;
     }
+    return n;
+#endif
+}
 
-    if ('.' == *p) {
-        p++;
-        if (!ISDIGIT(*p)) {
-            return JSON_PARSE_INVALID_VALUE;
+static double json_bits_to_double(uint64_t bits) {
+    double d;
+    memcpy(&d, &bits, sizeof(d));
+    return d;
+}
+
+/* returns 0 when the truncated product is too close to a rounding boundary to decide */
+static int json_eisel_lemire(uint64_t w, long q, uint64_t *bits) {
+    const uint64_t *pow5;
+    uint64_t high, low, second_high, second_low, mantissa;
+    int lz, upperbit, shift;
+    long power2;
+
+    if (0 == w || q < JSON_POW5_MIN_EXPONENT) {
+        *bits = 0;
+        return 1;
+    }
+    if (q > JSON_POW5_MAX_EXPONENT) {
+        *bits = (uint64_t)JSON_DOUBLE_INFINITE_POWER << JSON_DOUBLE_MANTISSA_BITS;
+        return 1;
+    }
+
+    lz = json_clz64(w);
+    w <<= lz;
+    pow5 = json_pow5_128[q - JSON_POW5_MIN_EXPONENT];
+
+    /* 55 significant bits are needed, only widen to 192 bits when the low 9 are all ones */
+    json_mul_64x64(w, pow5[0], &high, &low);
+    if (0x1FF == (high & 0x1FF)) {
+        json_mul_64x64(w, pow5[1], &second_high, &second_low);
+        low += second_high;
+        if (second_high > low) {
+            high++;
         }
-        for (p++; ISDIGIT(*p); p++);
+    }
+    if (~(uint64_t)0 == low && (q < -27 || q > 55)) {
+        return 0;
     }
 
-    if ('e' == *p || 'E' == *p) {
-        p++;
+    upperbit = (int)(high >> 63);
+    shift = upperbit + 64 - JSON_DOUBLE_MANTISSA_BITS - 3;
+    mantissa = high >> shift;
+    /* floor(q * log2(10)) + 63, biased */
+    power2 = ((217706 * q) >> 16) + 63 + upperbit - lz + 1023;
 
-        if ('-' == *p || '+' == *p) {
-            p++;
+    if (power2 <= 0) {
+        /* subnormal */
+        if (-power2 + 1 >= 64) {
+            *bits = 0;
+            return 1;
         }
+        mantissa >>= -power2 + 1;
+        mantissa += mantissa & 1;
+        mantissa >>= 1;
+        power2 = mantissa < (UINT64_C(1) << JSON_DOUBLE_MANTISSA_BITS) ? 0 : 1;
+        *bits = mantissa | ((uint64_t)power2 << JSON_DOUBLE_MANTISSA_BITS);
+        return 1;
+    }
 
-        for (p++; ISDIGIT(*p); p++);
+    /* exactly halfway between two doubles: round to even instead of up */
+    if (low <= 1 && q >= -4 && q <= 23 && 1 == (mantissa & 3) && (mantissa << shift) == high) {
+        mantissa &= ~(uint64_t)1;
     }
 
-    value->u.number = strtod(context->json, NULL);
-    context->json = p;
-    value->type = JSON_NUMBER;
+    mantissa += mantissa & 1;
+    mantissa >>= 1;
+    if (mantissa >= (UINT64_C(2) << JSON_DOUBLE_MANTISSA_BITS)) {
+        mantissa = UINT64_C(1) << JSON_DOUBLE_MANTISSA_BITS;
+        power2++;
+    }
+    mantissa &= ~(UINT64_C(1) << JSON_DOUBLE_MANTISSA_BITS);
 
-    return JSON_PARSE_OK;
+    if (power2 >= JSON_DOUBLE_INFINITE_POWER) {
+        *bits = (uint64_t)JSON_DOUBLE_INFINITE_POWER << JSON_DOUBLE_MANTISSA_BITS;
+        return 1;
+    }
+
+    *bits = mantissa | ((uint64_t)power2 << JSON_DOUBLE_MANTISSA_BITS);
+    return 1;
 }
 
+#if defined(__FLT_EVAL_METHOD__) && 0 == __FLT_EVAL_METHOD__
+/* with no excess precision w * 10^q is exact for these, so the single rounding is correct */
+static const double json_exact_pow10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+#define JSON_NUMBER_CLINGER 1
+#endif
 
-#define PUTC(c, ch) do { *(char*)json_context_push(c, sizeof(char)) = (ch); } while(0)
-#define STRING_PARSE_ERR(e) do {context->top = head;return e;} while(0)
+/*
+ * Rounds [begin, end) with strtod. The copy drops the '.' and folds the
+ * fraction length into the exponent, so the locale's radix never matters.
+ */
+static double json_parse_number_slow(json_context *context, const char *begin, const char *end, long exponent) {
+    size_t size = (end - begin) + 32;
+    char *number = (char *)json_context_push(context, size), *q = number;
+    double d;
 
-static const char* json_parse_hex(const char *p, unsigned *unicode){
-    int i = 0;
-    *unicode = 0;
-    for (i = 0; i < 4; ++i) {
-        char ch = *p++;
-        *unicode <<= 4;
-        if      (ch >= '0' && ch <= '9')  *unicode |= ch - '0';
-        else if (ch >= 'A' && ch <= 'F')  *unicode |= ch - ('A' - 10);
-        else if (ch >= 'a' && ch <= 'f')  *unicode |= ch - ('a' - 10);
-        else return NULL;
+    for (; begin < end && 'e' != *begin && 'E' != *begin; begin++) {
+        if ('.' != *begin) {
+            *q++ = *begin;
+        }
+    }
+    sprintf(q, "e%ld", exponent);
+
+    d = strtod(number, NULL);
+    json_context_pop(context, size);
+    return d;
+}
+
+/*
+ * Stores the integer literal gathered as w * 10^q (q is the count of
+ * digits past the first 19) as int64, or uint64 above INT64_MAX. Returns 0
+ * when it does not fit, "-0" is left to the double path too.
+ */
+static int json_parse_integer(json_value *value, uint64_t w, long q, int negative, unsigned last) {
+    if (1 == q) {
+        /* a 20th digit: the last one was dropped from w, add it back unless it overflows */
+        if (w > (UINT64_MAX - last) / 10) {
+            return 0;
+        }
+        w = w * 10 + last;
+    } else if (0 != q) {
+        return 0;
+    }
+
+    if (negative) {
+        if (0 == w || w > (uint64_t)INT64_MAX + 1) {
+            return 0;
+        }
+        value->u.i64 = w == (uint64_t)INT64_MAX + 1 ? INT64_MIN : -(int64_t)w;
+        value->flags = JSON_FLAG_INT64;
+    } else if (w <= (uint64_t)INT64_MAX) {
+        value->u.i64 = (int64_t)w;
+        value->flags = JSON_FLAG_INT64;
+    } else {
+        value->u.u64 = w;
+        value->flags = JSON_FLAG_UINT64;
+    }
+
+    value->type = JSON_NUMBER;
+    return 1;
+}
+
+static int json_parse_number(json_context *context, json_value *value) {
+    const char *p = context->json, *end = context->end;
+    uint64_t w = 0, bits, bits_up;
+    int negative = 0, digits = 0, truncated = 0, exponent_negative = 0, has_exponent = 0;
+    long q = 0, exponent = 0, fraction = 0;
+    double d;
+
+#define NUMBER_CHAR(ch) (p < end && *p == (ch))
+#define NUMBER_DIGIT() (p < end && ISDIGIT(*p))
+
+    /* validate and gather w and q in the same pass */
+    if (NUMBER_CHAR('-')) {
+        negative = 1;
+        p++;
+    }
+    if (NUMBER_CHAR('0')) {
+        p++;
+    } else {
+        if (!(p < end && ISDIGIT1TO9(*p))) {
+            return JSON_PARSE_INVALID_VALUE;
+        }
+        for (; NUMBER_DIGIT(); p++) {
+            if (digits < JSON_NUMBER_MAX_DIGITS) {
+                w = w * 10 + (*p - '0');
+                digits++;
+            } else {
+                q++;
+                truncated |= '0' != *p;
+            }
+        }
+    }
+
+    if (NUMBER_CHAR('.')) {
+        p++;
+        if (!NUMBER_DIGIT()) {
+            return JSON_PARSE_INVALID_VALUE;
+        }
+        for (; NUMBER_DIGIT(); p++) {
+            fraction++;
+            if (digits < JSON_NUMBER_MAX_DIGITS) {
+                w = w * 10 + (*p - '0');
+                q--;
+                if (0 != w) {
+                    digits++;
+                }
+            } else {
+                truncated |= '0' != *p;
+            }
+        }
+    }
+
+    if (NUMBER_CHAR('e') || NUMBER_CHAR('E')) {
+        p++;
+        has_exponent = 1;
+
+        if (NUMBER_CHAR('-') || NUMBER_CHAR('+')) {
+            exponent_negative = '-' == *p;
+            p++;
+        }
+
+        if (!NUMBER_DIGIT()) {
+            return JSON_PARSE_INVALID_VALUE;
+        }
+        for (; NUMBER_DIGIT(); p++) {
+            /* anything past this already overflows or underflows */
+            if (exponent < 100000) {
+                exponent = exponent * 10 + (*p - '0');
+            }
+        }
+        if (exponent_negative) {
+            exponent = -exponent;
+        }
+    }
+
+#undef NUMBER_CHAR
+#undef NUMBER_DIGIT
+
+    /* plain integers that fit 64 bits keep their exact value */
+    if (0 == fraction && !has_exponent && json_parse_integer(value, w, q, negative, p[-1] - '0')) {
+        context->json = p;
+        return JSON_PARSE_OK;
+    }
+
+    q += exponent;
+
+    if (0 == w) {
+        d = 0.0;
+    }
+#ifdef JSON_NUMBER_CLINGER
+    else if (!truncated && -22 <= q && q <= 22 && w <= (UINT64_C(1) << 53)) {
+        d = (double)w;
+        d = q < 0 ? d / json_exact_pow10[-q] : d * json_exact_pow10[q];
+    }
+#endif
+    else if (json_eisel_lemire(w, q, &bits)
+             && (!truncated || (json_eisel_lemire(w + 1, q, &bits_up) && bits == bits_up))) {
+        /* a truncated w is exact if the value rounds the same at both ends of its range */
+        d = json_bits_to_double(bits);
+    } else {
+        d = json_parse_number_slow(context, context->json + negative, p, exponent - fraction);
+    }
+
+    value->u.number = negative ? -d : d;
+    context->json = p;
+    value->type = JSON_NUMBER;
+    value->flags = 0;
+
+    return JSON_PARSE_OK;
+}
+
+
+#define PUTC(c, ch) do { *(char*)json_context_push(c, sizeof(char)) = (ch); } while(0)
+#define STRING_PARSE_ERR(e) do {context->top = head;return e;} while(0)
+
+/* the escape-free run [p, end) of a string fails JSON_PARSE_VALIDATE_UTF8 */
+#define JSON_UTF8_INVALID(context, p, end) \
+    (((context)->flags & JSON_PARSE_VALIDATE_UTF8) && (p) != (end) && !json_scan.validate_utf8(p, end))
+
+static const char* json_parse_hex(const char *p, const char *end, unsigned *unicode){
+    int i = 0;
+    *unicode = 0;
+    if (end - p < 4) {
+        return NULL;
+    }
+    for (i = 0; i < 4; ++i) {
+        char ch = *p++;
+        *unicode <<= 4;
+        if      (ch >= '0' && ch <= '9')  *unicode |= ch - '0';
+        else if (ch >= 'A' && ch <= 'F')  *unicode |= ch - ('A' - 10);
+        else if (ch >= 'a' && ch <= 'f')  *unicode |= ch - ('a' - 10);
+        else return NULL;
     }
 
     return p;
 }
 
+/*
+ * The code point of the \u escape whose hex digits start at *p, a
+ * surrogate pair taken as one. A lone low surrogate passes through as it
+ * is unless JSON_PARSE_VALIDATE_UTF8 is set.
+ */
+static int json_parse_unicode(json_context *context, const char **p, unsigned *unicode) {
+    const char *q, *end = context->end;
+    unsigned low;
+
+    if (!(q = json_parse_hex(*p, end, unicode))) {
+        return JSON_PARSE_INVALID_UNICODE_HEX;
+    }
+    if (0xD800 <= *unicode && *unicode <= 0xDBFF) {
+        if (end - q < 2 || *q++ != '\\' || *q++ != 'u') {
+            return JSON_PARSE_INVALID_UNICODE_SURROGATE;
+        }
+        if (!(q = json_parse_hex(q, end, &low))) {
+            return JSON_PARSE_INVALID_UNICODE_HEX;
+        }
+        if (0xDC00 > low || low > 0xDFFF) {
+            return JSON_PARSE_INVALID_UNICODE_SURROGATE;
+        }
+        *unicode = 0x10000 + (*unicode - 0xD800) * 0x400 + (low - 0xDC00);
+    } else if (0xDC00 <= *unicode && *unicode <= 0xDFFF && (context->flags & JSON_PARSE_VALIDATE_UTF8)) {
+        return JSON_PARSE_INVALID_UNICODE_SURROGATE;
+    }
+
+    *p = q;
+    return JSON_PARSE_OK;
+}
+
 /*  码点范围        码点位数    byte1           byte2           byte3           byte4
  * 0x0000-0x007F      7      0xxxxxxx
  * 0x0080-0x07ff      11     110xxxxx         10xxxxxx
@@ -163,25 +1142,58 @@ static void json_encode_utf8(json_context *context, unsigned unicode) {
     }
 }
 
-static int json_parse_string_raw(json_context *context, char **str, size_t *len) {
+/*
+ * On success *str is either scratch space on the stack or, when the string
+ * has no escapes, points straight into the input (*borrowed is set then).
+ */
+static int json_parse_string_raw(json_context *context, const char **str, size_t *len, int *borrowed) {
     size_t head = context->top;
     unsigned u;
-    const char *p;
+    int ret;
+    const char *p, *run, *end = context->end;
     EXPECT(context, '\"');
 
     p = context->json;
 
-    for (;;) {
-        char ch = *p++;
-        switch (ch) {
+    /* escape-free strings are used as they stand in the input */
+    run = json_scan.scan_string(p, end);
+    if (run != end && '\"' == *run) {
+        if (JSON_UTF8_INVALID(context, p, run)) {
+            return JSON_PARSE_INVALID_UTF8;
+        }
+        *str = p;
+        *len = run - p;
+        *borrowed = 1;
+        context->json = run + 1;
+        return JSON_PARSE_OK;
+    }
+
+    *borrowed = 0;
+
+    /* the first run is already scanned, later ones start after each escape */
+    for (;; run = json_scan.scan_string(p, end)) {
+        /* copy the run up to the next quote, escape or control character in one go */
+        if (run != p) {
+            if (JSON_UTF8_INVALID(context, p, run)) {
+                STRING_PARSE_ERR(JSON_PARSE_INVALID_UTF8);
+            }
+            memcpy(json_context_push(context, run - p), p, run - p);
+            p = run;
+        }
+
+        if (p == end) {
+            STRING_PARSE_ERR(JSON_PARSE_MISS_QUOTATION_MARK);
+        }
+        switch (*p++) {
             case '\"':
                 *len = context->top - head;
-                *str = (char *)json_context_pop(context, *len);
+                *str = (const char *)json_context_pop(context, *len);
                 context->json = p;
                 return JSON_PARSE_OK;
-            case '\0':
-                STRING_PARSE_ERR(JSON_PARSE_MISS_QUOTATION_MARK);
             case '\\':
+                if (p == end) {
+                    STRING_PARSE_ERR(JSON_PARSE_MISS_QUOTATION_MARK);
+                }
                 switch (*p++) {
                     case '\\': PUTC(context,'\\'); break;
                     case '/': PUTC(context,'/'); break;
@@ -191,316 +1203,4169 @@ static int json_parse_string_raw(json_context *context, char **str, size_t *len)
                     case 'n': PUTC(context,'\n'); break;
                     case 'r': PUTC(context,'\r'); break;
                     case 't': PUTC(context,'\t'); break;
-                    case 'u':{
-                        if (!(p = json_parse_hex(p, &u))) {
-                            STRING_PARSE_ERR(JSON_PARSE_INVALID_UNICODE_HEX);
-                        }
-                        if (0xD800 <= u && u <= 0xDBFF) {  /* surrogate pair */
-                            unsigned H = u, L = 0;
-                            if (*p++ != '\\' || *p++ != 'u') {
-                                STRING_PARSE_ERR(JSON_PARSE_INVALID_UNICODE_SURROGATE);
-                            }
-                            if (!(p = json_parse_hex(p, &L))) {
-                                STRING_PARSE_ERR(JSON_PARSE_INVALID_UNICODE_HEX);
-                            }
-                            if (0xDC00 > L || L > 0xDD1E) {
-                                STRING_PARSE_ERR(JSON_PARSE_INVALID_UNICODE_SURROGATE);
-                            }
-
-                            u = 0x10000 + (H - 0xD800) * 0x400 +  (L - 0xDC00);
+                    case 'u':
+                        if ((ret = json_parse_unicode(context, &p, &u)) != JSON_PARSE_OK) {
+                            STRING_PARSE_ERR(ret);
                         }
                         json_encode_utf8(context, u);
-                    }break;
+                        break;
                     default: {
                         STRING_PARSE_ERR(JSON_PARSE_MISS_QUOTATION_MARK);
                     }
                 }
                 break;
             default:
-                if ((unsigned char)ch < 0x20) {
-                    STRING_PARSE_ERR(JSON_PARSE_INVALID_STRING_CHAR);
-                }
-                PUTC(context, ch);
+                /* the scanner only stops at control characters besides the cases above */
+                STRING_PARSE_ERR(JSON_PARSE_INVALID_STRING_CHAR);
+        }
+    }
+}
+
+/* FNV-1a */
+static uint32_t json_hash_key(const char *key, size_t len) {
+    uint32_t hash = 2166136261u;
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        hash = (hash ^ (unsigned char)key[i]) * 16777619u;
+    }
+    return hash;
+}
+
+/*
+ * Key table: every distinct key once, in the table's own arena, behind an
+ * open addressing index kept at most half full. Each string is preceded by
+ * its hash so that json_find_interned_value can probe object indexes
+ * without reading the key.
+ */
+#ifndef JSON_KEY_TABLE_INIT_SIZE
+#define JSON_KEY_TABLE_INIT_SIZE 64
+#endif
+
+#define JSON_KEY_HASH_SIZE JSON_ARENA_ALIGN(sizeof(uint32_t))
+#define JSON_KEY_HASH(key) (*(const uint32_t *)((key) - JSON_KEY_HASH_SIZE))
+
+typedef struct {
+    const char *key; /* NULL when the slot is empty */
+    uint32_t len, hash;
+} json_key_slot;
+
+struct json_key_table {
+    json_arena arena;
+    json_key_slot *slots;
+    size_t capacity, count;
+};
+
+json_key_table* json_key_table_create(void) {
+    json_key_table *table = (json_key_table *)JSON_MALLOC(sizeof(json_key_table));
+
+    table->arena.head = NULL;
+    table->arena.next_size = 0;
+    table->capacity = JSON_KEY_TABLE_INIT_SIZE;
+    table->count = 0;
+    table->slots = (json_key_slot *)JSON_MALLOC(table->capacity * sizeof(json_key_slot));
+    memset(table->slots, 0, table->capacity * sizeof(json_key_slot));
+    return table;
+}
+
+void json_key_table_free(json_key_table *table) {
+    if (NULL != table) {
+        json_arena_release(&table->arena);
+        JSON_FREE(table->slots);
+        JSON_FREE(table);
+    }
+}
+
+size_t json_key_table_size(const json_key_table *table) {
+    assert(NULL != table);
+    return table->count;
+}
+
+static void json_key_table_grow(json_key_table *table) {
+    size_t capacity = table->capacity * 2, mask = capacity - 1, i, slot;
+    json_key_slot *slots = (json_key_slot *)JSON_MALLOC(capacity * sizeof(json_key_slot));
+
+    memset(slots, 0, capacity * sizeof(json_key_slot));
+    for (i = 0; i < table->capacity; i++) {
+        if (NULL != table->slots[i].key) {
+            for (slot = table->slots[i].hash & mask; NULL != slots[slot].key; slot = (slot + 1) & mask) {
+            }
+            slots[slot] = table->slots[i];
+        }
+    }
+    JSON_FREE(table->slots);
+    table->slots = slots;
+    table->capacity = capacity;
+}
+
+const char* json_key_table_intern(json_key_table *table, const char *key, size_t len) {
+    uint32_t hash;
+    size_t mask, slot;
+    char *copy;
+
+    assert(NULL != table && (NULL != key || 0 == len) && len <= UINT32_MAX);
+    hash = json_hash_key(key, len);
+    mask = table->capacity - 1;
+    for (slot = hash & mask; NULL != table->slots[slot].key; slot = (slot + 1) & mask) {
+        const json_key_slot *s = &table->slots[slot];
+        if (s->hash == hash && s->len == len && 0 == memcmp(s->key, key, len)) {
+            return s->key;
+        }
+    }
+
+    if (2 * (table->count + 1) > table->capacity) {
+        json_key_table_grow(table);
+        mask = table->capacity - 1;
+        for (slot = hash & mask; NULL != table->slots[slot].key; slot = (slot + 1) & mask) {
+        }
+    }
+
+    copy = (char *)json_arena_alloc(&table->arena, JSON_KEY_HASH_SIZE + len + 1) + JSON_KEY_HASH_SIZE;
+    *(uint32_t *)(copy - JSON_KEY_HASH_SIZE) = hash;
+    memcpy(copy, key, len);
+    copy[len] = '\0';
+
+    table->slots[slot].key = copy;
+    table->slots[slot].len = (uint32_t)len;
+    table->slots[slot].hash = hash;
+    table->count++;
+    return copy;
+}
+
+/* room for a NUL-terminated string over u and size */
+typedef char json_inline_string_fits[JSON_INLINE_STRING_MAX < offsetof(json_value, type) ? 1 : -1];
+
+#define JSON_STRING_PTR(value) ((value)->inline_size ? (const char *)(value) : (const char *)(value)->u.str)
+#define JSON_STRING_LEN(value) ((value)->inline_size ? (size_t)((value)->inline_size - 1) : (size_t)(value)->size)
+
+/* makes value an owned copy of len bytes, in the node when short, else from arena or malloc */
+static void json_string_copy(json_value *value, const char *s, size_t len, json_arena *arena) {
+    char *str;
+
+    if (len <= JSON_INLINE_STRING_MAX) {
+        str = (char *)value;
+        value->inline_size = (unsigned char)(len + 1);
+    } else {
+        str = (char *)(arena ? json_arena_alloc(arena, len + 1) : JSON_MALLOC(len + 1));
+        value->u.str = str;
+        value->size = (uint32_t)len;
+        value->inline_size = 0;
+    }
+    memcpy(str, s, len);
+    str[len] = '\0';
+    value->type = JSON_STRING;
+    value->flags = 0;
+}
+
+/* a string or key from json_parse_string_raw: a view when allowed, else a copy */
+static int json_string_value(json_context *context, json_value *value, const char *str, size_t len, int borrowed) {
+    if (len > UINT32_MAX) {
+        return JSON_PARSE_TOO_LARGE;
+    }
+    if (borrowed && (context->flags & JSON_PARSE_STRING_VIEWS)) {
+        value->u.str = (char *)str;
+        value->size = (uint32_t)len;
+        value->inline_size = 0;
+        value->type = JSON_STRING;
+        value->flags = JSON_FLAG_STRING_VIEW;
+    } else {
+        json_string_copy(value, str, len, context->arena);
+    }
+    return JSON_PARSE_OK;
+}
+
+/* an object key: the table's string under JSON_PARSE_INTERN_KEYS, else like any other */
+static int json_key_value(json_context *context, json_value *key, const char *str, size_t len, int borrowed) {
+    if (NULL == context->keys) {
+        return json_string_value(context, key, str, len, borrowed);
+    }
+    if (len > UINT32_MAX) {
+        return JSON_PARSE_TOO_LARGE;
+    }
+    key->u.str = (char *)json_key_table_intern(context->keys, str, len);
+    key->size = (uint32_t)len;
+    key->inline_size = 0;
+    key->type = JSON_STRING;
+    key->flags = JSON_FLAG_INTERNED;
+    return JSON_PARSE_OK;
+}
+
+static int json_parse_string(json_context *context, json_value *value) {
+    int ret, borrowed; const char *str; size_t len;
+
+    if ((ret = json_parse_string_raw(context, &str, &len, &borrowed)) == JSON_PARSE_OK) {
+        ret = json_string_value(context, value, str, len, borrowed);
+    }
+
+    return ret;
+}
+
+/*
+ * Lazy mode: arrays and objects below the one being parsed are only
+ * checked, with nothing built, and kept as a reference to their text. The
+ * getters that look inside such a value parse it in place on first use,
+ * one level again, see json_value_expand. Text is checked once: what lies
+ * inside a value being expanded is only bracket-matched, 64 bytes at a time.
+ */
+typedef struct json_lazy json_lazy;
+
+struct json_lazy {
+    const char *json, *end; /* the array or object text */
+    json_arena *arena; /* NULL: malloc'd nodes, this record included */
+    unsigned flags; /* JSON_PARSE_* of the parse */
+    json_key_table *keys;
+};
+
+static int json_skip_value(json_context *context);
+
+/* the end of the array or object at p, by its brackets alone: checked text always balances */
+static const char* json_skip_container(const char *p, const char *end) {
+    json_block_carry carry = { 0, 0 };
+    size_t depth = 0;
+
+    for (; p < end; p += 64) {
+        json_block_masks masks;
+        uint64_t op;
+
+        json_classify_block(p, end, &masks);
+        op = masks.op & ~json_block_strings(&masks, &carry);
+
+        for (; 0 != op; op &= op - 1) {
+            int i = json_ctz64(op);
+            switch (p[i]) {
+                case '[': case '{':
+                    depth++;
+                    break;
+                case ']': case '}':
+                    if (0 == --depth) {
+                        return p + i + 1;
+                    }
+                    break;
+            }
         }
     }
+
+    return end;
+}
+
+static int json_parse_lazy(json_context *context, json_value *value) {
+    const char *json = context->json;
+    json_lazy *lazy;
+    int ret;
+
+    if (context->checked) {
+        context->json = json_skip_container(json, context->end);
+    } else if ((ret = json_skip_value(context)) != JSON_PARSE_OK) {
+        /* a skipped value fails the way the parser would fail on it */
+        return ret;
+    }
+
+    lazy = (json_lazy *)json_context_alloc(context, sizeof(json_lazy));
+    lazy->json = json;
+    lazy->end = context->json;
+    lazy->arena = context->arena;
+    lazy->flags = context->flags;
+    lazy->keys = context->keys;
+
+    value->type = '[' == *json ? JSON_ARRAY : JSON_OBJECT;
+    value->flags = JSON_FLAG_LAZY;
+    value->u.lazy = lazy;
+    return JSON_PARSE_OK;
+}
+
+/*
+ * Parses a JSON_FLAG_LAZY value in place. Its text passed json_skip_value,
+ * so only an array or object beyond UINT32_MAX entries can still fail,
+ * which leaves it empty; the getter that asked has already checked the type.
+ */
+static void json_value_expand(json_value *value) {
+    json_lazy *lazy = value->u.lazy;
+    json_type type = value->type;
+    json_context context;
+
+    json_context_init(&context, lazy->json, lazy->end - lazy->json, lazy->arena, NULL);
+    context.flags = lazy->flags;
+    context.keys = lazy->keys;
+    context.checked = 1;
+    json_value_init(value);
+    if (JSON_PARSE_OK != json_parse_value(&context, value)) {
+        value->type = type;
+        value->u.elements = NULL;
+        value->size = 0;
+    }
+
+    assert(0 == context.top);
+    JSON_FREE(context.stack);
+    if (NULL == lazy->arena) {
+        JSON_FREE(lazy);
+    }
+}
+
+#define JSON_EXPAND(value) \
+    do {\
+        if ((value)->flags & JSON_FLAG_LAZY) {\
+            json_value_expand((json_value *)(value));\
+        }\
+    } while(0)
+
+/* an element or member value, left for later in lazy mode when it is an array or object */
+static int json_parse_child(json_context *context, json_value *value) {
+    if ((context->flags & JSON_PARSE_LAZY) && context->json < context->end &&
+        ('[' == *context->json || '{' == *context->json)) {
+        return json_parse_lazy(context, value);
+    }
+    return json_parse_value(context, value);
+}
+
+/*
+ * array = %x5B ws [ value *( ws %x2C ws value ) ] ws %x5D
+ */
+/* moves the size elements on top of the stack into a new array value */
+static void json_context_pop_array(json_context *context, json_value *value, size_t size) {
+    size_t s = sizeof(json_value) * size;
+
+    value->type = JSON_ARRAY;
+    value->flags = 0;
+    value->size = (uint32_t)size;
+    value->u.elements = s ? (json_value *)json_context_alloc(context, s) : NULL;
+    if (s) {
+        memcpy(value->u.elements, json_context_pop(context, s), s);
+    }
 }
 
-static int json_parse_string(json_context *context, json_value *value) {
-    int ret; char *str; size_t len;
+static int json_parse_array(json_context *context, json_value *value) {
+    size_t size = 0 ,i = 0;
+    int ret = 0;
+    EXPECT(context, '[');
+
+    json_parse_whitespace(context);
+
+    if (']' == PEEK(context)) {
+        context->json ++;
+        value->type = JSON_ARRAY;
+        value->size = 0;
+        value->u.elements = NULL;
+        return JSON_PARSE_OK;
+    }
+
+    for (;;) {
+        json_value element;
+        json_value_init(&element);
+
+        if (UINT32_MAX == size) {
+            ret = JSON_PARSE_TOO_LARGE;
+            break;
+        }
+
+        if ((ret = json_parse_child(context, &element)) != JSON_PARSE_OK) {
+            break;
+        }
+
+        memcpy(json_context_push(context, sizeof(json_value)), &element, sizeof(json_value));
+        size++;
+
+        json_parse_whitespace(context);
+
+        if (PEEK(context) == ',') {
+            context->json ++;
+            json_parse_whitespace(context);
+        } else if (PEEK(context) == ']') {
+            context->json ++;
+            json_context_pop_array(context, value, size);
+            return JSON_PARSE_OK;
+        } else {
+            ret = JSON_PARSE_MISS_COMMA_OR_SQUARE_BRACKET;
+            break;
+        }
+    }
+
+    for ( i = 0; i < size; ++i) {
+        json_context_free_value(context, json_context_pop(context, sizeof(json_value)));
+    }
+
+    return ret;
+}
+
+/*
+ * member = string ws %x3A ws value
+ * object = %x7B ws [ member *( ws %x2C ws member ) ] ws %x7D
+ *
+ */
+/*
+ * Objects of JSON_OBJECT_INDEX_MIN_SIZE members or more carry a header just
+ * before u.members. json_find_object_value builds a hash index of the
+ * keys into it on first use, from the document arena when there is one.
+ */
+#ifndef JSON_OBJECT_INDEX_MIN_SIZE
+#define JSON_OBJECT_INDEX_MIN_SIZE 32
+#endif
+
+typedef struct {
+    json_arena *arena; /* NULL for malloc'd trees */
+    uint32_t *index; /* open addressing, member position + 1 per slot, 0 when empty */
+} json_object_header;
+
+#define JSON_OBJECT_HEADER_SIZE JSON_ARENA_ALIGN(sizeof(json_object_header))
+#define JSON_OBJECT_HEADER(value) \
+    ((json_object_header *)((char *)(value)->u.members - JSON_OBJECT_HEADER_SIZE))
+#define JSON_OBJECT_INDEXED(value) \
+    ((value)->size >= JSON_OBJECT_INDEX_MIN_SIZE && (value)->size < UINT32_MAX)
+
+/* moves the size members on top of the stack into a new object value */
+static void json_context_pop_object(json_context *context, json_value *value, size_t size) {
+    size_t s = sizeof(json_member) * size;
+
+    value->type = JSON_OBJECT;
+    value->flags = 0;
+    value->size = (uint32_t)size;
+    if (0 == size) {
+        value->u.members = NULL;
+    } else if (JSON_OBJECT_INDEXED(value)) {
+        json_object_header *header = (json_object_header *)json_context_alloc(context, JSON_OBJECT_HEADER_SIZE + s);
+        header->arena = context->arena;
+        header->index = NULL;
+        value->u.members = (json_member *)((char *)header + JSON_OBJECT_HEADER_SIZE);
+    } else {
+        value->u.members = (json_member *)json_context_alloc(context, s);
+    }
+    if (s) {
+        memcpy(value->u.members, json_context_pop(context, s), s);
+    }
+}
+
+static int json_parse_object(json_context *context, json_value *value) {
+    size_t size = 0 ,i = 0;
+    int ret = 0;
+    json_member member;
+    const char *str;
+    size_t len;
+    int borrowed;
+    EXPECT(context, '{');
+
+    json_parse_whitespace(context);
+
+    if ('}' == PEEK(context)) {
+        context->json ++;
+        value->type = JSON_OBJECT;
+        value->size = 0;
+        value->u.members = NULL;
+        return JSON_PARSE_OK;
+    }
+
+    json_value_init(&member.key);
+
+    for (;;) {
+        json_value_init(&member.value);
+
+        if (UINT32_MAX == size) {
+            ret = JSON_PARSE_TOO_LARGE;
+            break;
+        }
+
+        /* parse key to member.key */
+        if ('\"' !=  PEEK(context)) {
+            ret = JSON_PARSE_MISS_KEY;
+            break;
+        }
+
+        if ((ret = json_parse_string_raw(context, &str, &len, &borrowed)) != JSON_PARSE_OK ||
+            (ret = json_key_value(context, &member.key, str, len, borrowed)) != JSON_PARSE_OK) {
+            break;
+        }
+
+        /*parse ws colon ws*/
+        json_parse_whitespace(context);
+
+        if (':' != PEEK(context)) {
+            ret = JSON_PARSE_MISS_COLON;
+            break;
+        }
+
+        context->json ++;
+
+        json_parse_whitespace(context);
+        /* parse value */
+        if ((ret = json_parse_child(context, &member.value)) != JSON_PARSE_OK) {
+            break;
+        }
+
+        memcpy(json_context_push(context, sizeof(json_member)), &member, sizeof(json_member));
+        size++;
+        json_value_init(&member.key);
+
+        /* parse ws [comma | right-curly-brace] ws */
+        json_parse_whitespace(context);
+        if (',' == PEEK(context)) {
+            context->json ++;
+            json_parse_whitespace(context);
+        } else if ('}' == PEEK(context)) {
+            context->json ++;
+            json_context_pop_object(context, value, size);
+            return JSON_PARSE_OK;
+        } else {
+            ret = JSON_PARSE_MISS_COMMA_OR_CURLY_BRACKET;
+            break;
+        }
+    }
+
+    json_context_free_value(context, &member.key);
+    for ( i = 0; i < size; ++i) {
+        json_member *mem = json_context_pop(context, sizeof(json_member));
+        json_context_free_value(context, &mem->key);
+        json_context_free_value(context, &mem->value);
+    }
+
+    return ret;
+}
+
+/* value = null / false / true */
+static int json_parse_value(json_context *context, json_value *value) {
+    if (context->json == context->end) {
+        return JSON_PARSE_EXPECT_VALUE;
+    }
+
+    switch (*context->json) {
+        case 'n': return json_parse_literal(context, value, "null", JSON_NULL);
+        case 't': return json_parse_literal(context, value, "true", JSON_TRUE);
+        case 'f': return json_parse_literal(context, value, "false", JSON_FALSE);
+        case '\"': return json_parse_string(context, value);
+        case '[': return json_parse_array(context, value);
+        case '{': return json_parse_object(context, value);
+        default : return json_parse_number(context, value);
+    }
+}
+
+/* parses one value with a context whose stack is kept between calls */
+static int json_parse_context(json_context *context, json_value *value, const char *json, size_t len) {
+    context->json = json;
+    context->end = json + len;
+    json_value_init(value);
+    json_parse_whitespace(context);
+    return json_parse_value(context, value);
+}
+
+int json_parse(json_value* value, const char* json) {
+    assert(json != NULL);
+    return json_parse_n(value, json, strlen(json));
+}
+
+int json_parse_n(json_value* value, const char* json, size_t len) {
+    return json_parse_ex(value, json, len, NULL);
+}
+
+int json_parse_ex(json_value* value, const char* json, size_t len, const json_parse_options *options) {
+    json_context context;
+    int ret;
+    assert(value != NULL && (json != NULL || 0 == len));
+    json_context_init(&context, json, len, NULL, options);
+
+    ret = json_parse_context(&context, value, json, len);
+
+    assert(0 == context.top);
+    JSON_FREE(context.stack);
+
+    return ret;
+}
+
+json_document* json_document_create(void) {
+    json_document *doc = (json_document *)JSON_MALLOC(sizeof(json_document));
+
+    doc->arena.head = NULL;
+    doc->arena.next_size = 0;
+    doc->workers = NULL;
+    doc->worker_count = 0;
+    json_value_init(&doc->root);
+
+    return doc;
+}
+
+static void json_document_release(json_document *doc) {
+    size_t i;
+
+    json_arena_release(&doc->arena);
+    for (i = 0; i < doc->worker_count; i++) {
+        json_arena_release(&doc->workers[i]);
+    }
+    JSON_FREE(doc->workers);
+    doc->workers = NULL;
+    doc->worker_count = 0;
+    json_value_init(&doc->root);
+}
+
+void json_document_free(json_document *doc) {
+    if (NULL == doc) {
+        return;
+    }
+
+    json_document_release(doc);
+    JSON_FREE(doc);
+}
+
+json_value* json_document_root(json_document *doc) {
+    assert(NULL != doc);
+    return &doc->root;
+}
+
+int json_parse_into(json_document *doc, const char *json) {
+    assert(NULL != json);
+    return json_parse_into_n(doc, json, strlen(json));
+}
+
+int json_parse_into_n(json_document *doc, const char *json, size_t len) {
+    return json_parse_into_ex(doc, json, len, NULL);
+}
+
+int json_parse_into_ex(json_document *doc, const char *json, size_t len, const json_parse_options *options) {
+    json_context context;
+    int ret;
+    assert(NULL != doc && (NULL != json || 0 == len));
+
+    json_document_release(doc);
+    /* the tree is usually about as large as its text, size the first block after it */
+    doc->arena.next_size = len;
+
+    json_context_init(&context, json, len, &doc->arena, options);
+
+    json_parse_whitespace(&context);
+
+    if (JSON_PARSE_OK != (ret = json_parse_value(&context, &doc->root))) {
+        json_document_release(doc);
+    }
+
+    assert(0 == context.top);
+    JSON_FREE(context.stack);
+
+    return ret;
+}
+
+/*
+ * Reusable parser. The stack is handed from one parse to the next instead
+ * of being freed, and the arena is rewound rather than released: after a
+ * message that needed several blocks it is rebuilt as one block of their
+ * total, so the next message of that size fits without allocating. Both
+ * are cut back once they hold more than retain bytes.
+ */
+#ifndef JSON_PARSER_RETAIN_SIZE
+#define JSON_PARSER_RETAIN_SIZE (1024 * 1024)
+#endif
+
+struct json_parser {
+    char *stack; size_t stack_size, stack_init;
+    json_arena arena;
+    size_t retain;
+    json_value root; /* of json_parser_parse_into */
+};
+
+/* gives an empty arena its first block, of size bytes */
+static void json_arena_reserve(json_arena *arena, size_t size) {
+    json_arena_block *block = (json_arena_block *)JSON_MALLOC(JSON_ARENA_HEADER_SIZE + size);
+
+    block->size = size;
+    block->top = 0;
+    block->next = NULL;
+    arena->head = block;
+    arena->next_size = size * 2;
+}
+
+/* empties the arena, keeping its memory as a single block when that is at most keep bytes */
+static void json_arena_rewind(json_arena *arena, size_t keep) {
+    json_arena_block *block = arena->head;
+    size_t total = 0;
+
+    if (NULL == block) {
+        return;
+    }
+    if (NULL == block->next && block->size <= keep) {
+        block->top = 0;
+        return;
+    }
+
+    for (; NULL != block; block = block->next) {
+        total += block->size;
+    }
+    json_arena_release(arena);
+    if (total <= keep) {
+        json_arena_reserve(arena, total);
+    }
+}
+
+json_parser* json_parser_create(const json_parser_config *config) {
+    json_parser *parser = (json_parser *)JSON_MALLOC(sizeof(json_parser));
+
+    parser->stack_init = config && config->stack_size ? config->stack_size : JSON_PARSE_STACK_INIT_SIZE;
+    parser->retain = config && config->retain_size ? config->retain_size : JSON_PARSER_RETAIN_SIZE;
+    parser->stack_size = parser->stack_init;
+    parser->stack = (char *)JSON_MALLOC(parser->stack_size);
+    parser->arena.head = NULL;
+    parser->arena.next_size = 0;
+    if (config && config->arena_size) {
+        json_arena_reserve(&parser->arena, config->arena_size);
+    }
+    json_value_init(&parser->root);
+
+    return parser;
+}
+
+void json_parser_free(json_parser *parser) {
+    if (NULL == parser) {
+        return;
+    }
+
+    JSON_FREE(parser->stack);
+    json_arena_release(&parser->arena);
+    JSON_FREE(parser);
+}
+
+/* a stack grown past retain by an outlier goes back to its initial size */
+static void json_parser_trim_stack(json_parser *parser) {
+    if (parser->stack_size > parser->retain && parser->stack_size > parser->stack_init) {
+        parser->stack = (char *)JSON_REALLOC(parser->stack, parser->stack_init);
+        parser->stack_size = parser->stack_init;
+    }
+}
+
+void json_parser_reset(json_parser *parser) {
+    assert(NULL != parser);
+
+    json_arena_rewind(&parser->arena, parser->retain);
+    json_value_init(&parser->root);
+    json_parser_trim_stack(parser);
+}
+
+static int json_parser_run(json_parser *parser, json_value *value, json_arena *arena,
+                           const char *json, size_t len, const json_parse_options *options) {
+    json_context context;
+    int ret;
+
+    json_context_init(&context, json, len, arena, options);
+    context.stack = parser->stack;
+    context.size = parser->stack_size;
+
+    ret = json_parse_context(&context, value, json, len);
+
+    assert(0 == context.top);
+    parser->stack = context.stack;
+    parser->stack_size = context.size;
+    return ret;
+}
+
+int json_parser_parse(json_parser *parser, json_value *value, const char *json, size_t len,
+                      const json_parse_options *options) {
+    int ret;
+    assert(NULL != parser && NULL != value && (NULL != json || 0 == len));
+
+    ret = json_parser_run(parser, value, NULL, json, len, options);
+    json_parser_trim_stack(parser);
+    return ret;
+}
+
+int json_parser_parse_into(json_parser *parser, const char *json, size_t len, const json_parse_options *options) {
+    int ret;
+    assert(NULL != parser && (NULL != json || 0 == len));
+
+    json_parser_reset(parser);
+    if (NULL == parser->arena.head) {
+        /* as json_parse_into_ex, size the first block after the text */
+        parser->arena.next_size = len;
+    }
+    if (JSON_PARSE_OK != (ret = json_parser_run(parser, &parser->root, &parser->arena, json, len, options))) {
+        json_parser_reset(parser);
+    }
+    return ret;
+}
+
+json_value* json_parser_root(json_parser *parser) {
+    assert(NULL != parser);
+    return &parser->root;
+}
+
+void json_set_allocator(const json_allocator *allocator) {
+    if (NULL == allocator) {
+        json_alloc_hooks.malloc_fn = malloc;
+        json_alloc_hooks.realloc_fn = realloc;
+        json_alloc_hooks.free_fn = free;
+    } else {
+        assert(allocator->malloc_fn && allocator->realloc_fn && allocator->free_fn);
+        json_alloc_hooks = *allocator;
+    }
+}
+
+/*
+ * Push parser. The recursive parsers need the whole text at once, so the
+ * stream keeps their state explicitly: every open container is a frame on
+ * the context stack, its finished children pushed after it just as
+ * json_parse_array and json_parse_object stack them. Scalars and keys go
+ * through json_parse_value and json_parse_string_raw once the whole token
+ * is at hand; only a token cut by a chunk boundary is copied aside, so
+ * memory stays at the tree plus the longest single token. In event mode
+ * (a handler is set) nothing is built: tokens are reported as json_parse_sax
+ * reports them and frames only count their children, so memory stays at
+ * the nesting depth plus the longest token.
+ */
+typedef struct {
+    size_t parent; /* stack offset of the enclosing frame */
+    size_t size; /* finished children pushed after the frame */
+    json_type type; /* JSON_ARRAY or JSON_OBJECT */
+    json_value key; /* object: the key whose value is being parsed */
+} json_stream_frame;
+
+#define JSON_STREAM_FRAME_SIZE JSON_ARENA_ALIGN(sizeof(json_stream_frame))
+#define JSON_STREAM_NO_FRAME ((size_t)-1)
+#define JSON_STREAM_FRAME(stream) ((json_stream_frame *)((stream)->context.stack + (stream)->frame))
+#define JSON_STREAM_WORD_CHAR(ch) \
+    (ISDIGIT(ch) || ((ch) >= 'a' && (ch) <= 'z') || ((ch) >= 'A' && (ch) <= 'Z') || \
+     (ch) == '+' || (ch) == '-' || (ch) == '.')
+
+/* what the stream expects next */
+enum {
+    JSON_STREAM_VALUE,
+    JSON_STREAM_FIRST_VALUE, /* a value or ']' */
+    JSON_STREAM_KEY,
+    JSON_STREAM_FIRST_KEY, /* a key or '}' */
+    JSON_STREAM_COLON,
+    JSON_STREAM_NEXT, /* ',' or the closing bracket */
+    JSON_STREAM_DONE /* like json_parse, nothing after the root value is looked at */
+};
+
+struct json_stream {
+    json_context context;
+    size_t frame; /* the innermost open container */
+    int state, error;
+    char *token; size_t token_len, token_size; /* a scalar token split across chunks */
+    int token_escape; /* the split token ends on a backslash inside a string */
+    json_value root;
+    const json_sax_handler *handler; void *user; /* event mode, see json_stream_create_sax */
+};
+
+static int json_sax_value(json_context *context, const json_sax_handler *handler, void *user);
+
+static void json_stream_reset(json_stream *stream) {
+    stream->frame = JSON_STREAM_NO_FRAME;
+    stream->state = JSON_STREAM_VALUE;
+    stream->error = JSON_PARSE_OK;
+    stream->token_len = 0;
+    stream->token_escape = 0;
+    json_value_init(&stream->root);
+}
+
+static void json_stream_discard(json_stream *stream) {
+    json_context *context = &stream->context;
+    size_t i;
+
+    while (JSON_STREAM_NO_FRAME != stream->frame) {
+        json_stream_frame *frame = JSON_STREAM_FRAME(stream);
+        /* in event mode frames only count their children */
+        for (i = 0; NULL == stream->handler && i < frame->size; i++) {
+            if (JSON_ARRAY == frame->type) {
+                json_value_free(json_context_pop(context, sizeof(json_value)));
+            } else {
+                json_member *member = json_context_pop(context, sizeof(json_member));
+                json_value_free(&member->key);
+                json_value_free(&member->value);
+            }
+        }
+        json_value_free(&frame->key);
+        stream->frame = frame->parent;
+        json_context_pop(context, JSON_STREAM_FRAME_SIZE);
+    }
+    assert(0 == context->top);
+    json_value_free(&stream->root);
+}
+
+/*
+ * Hands a finished value to the innermost container, or makes it the root.
+ * In event mode value is NULL, the value having been reported already.
+ */
+static void json_stream_value(json_stream *stream, json_value *value) {
+    json_stream_frame *frame;
+
+    if (JSON_STREAM_NO_FRAME == stream->frame) {
+        if (NULL != value) {
+            stream->root = *value;
+        }
+        stream->state = JSON_STREAM_DONE;
+        return;
+    }
+
+    frame = JSON_STREAM_FRAME(stream);
+    if (NULL == value) {
+        frame->size++;
+        stream->state = JSON_STREAM_NEXT;
+        return;
+    }
+    if (UINT32_MAX == frame->size) {
+        json_value_free(value);
+        stream->error = JSON_PARSE_TOO_LARGE;
+        return;
+    }
+    if (JSON_ARRAY == frame->type) {
+        memcpy(json_context_push(&stream->context, sizeof(json_value)), value, sizeof(json_value));
+    } else {
+        json_member member;
+        member.key = frame->key;
+        member.value = *value;
+        json_value_init(&frame->key);
+        memcpy(json_context_push(&stream->context, sizeof(json_member)), &member, sizeof(json_member));
+    }
+    /* the push may have moved the stack */
+    JSON_STREAM_FRAME(stream)->size++;
+    stream->state = JSON_STREAM_NEXT;
+}
+
+static void json_stream_open(json_stream *stream, json_type type) {
+    json_stream_frame *frame = json_context_push(&stream->context, JSON_STREAM_FRAME_SIZE);
+
+    frame->parent = stream->frame;
+    frame->size = 0;
+    frame->type = type;
+    json_value_init(&frame->key);
+    stream->frame = (char *)frame - stream->context.stack;
+    stream->state = JSON_ARRAY == type ? JSON_STREAM_FIRST_VALUE : JSON_STREAM_FIRST_KEY;
+
+    if (NULL != stream->handler) {
+        int (*fn)(void *) = JSON_ARRAY == type ? stream->handler->start_array_fn : stream->handler->start_object_fn;
+        if (NULL != fn && 0 != fn(stream->user)) {
+            stream->error = JSON_PARSE_ABORTED;
+        }
+    }
+}
+
+static void json_stream_close(json_stream *stream) {
+    json_stream_frame *frame = JSON_STREAM_FRAME(stream);
+    size_t parent = frame->parent;
+    json_value value;
+
+    if (NULL != stream->handler) {
+        int (*fn)(void *, size_t) = JSON_ARRAY == frame->type ? stream->handler->end_array_fn : stream->handler->end_object_fn;
+        size_t size = frame->size;
+        json_context_pop(&stream->context, JSON_STREAM_FRAME_SIZE);
+        stream->frame = parent;
+        if (NULL != fn && 0 != fn(stream->user, size)) {
+            stream->error = JSON_PARSE_ABORTED;
+            return;
+        }
+        json_stream_value(stream, NULL);
+        return;
+    }
+
+    if (JSON_ARRAY == frame->type) {
+        json_context_pop_array(&stream->context, &value, frame->size);
+    } else {
+        json_context_pop_object(&stream->context, &value, frame->size);
+    }
+    json_context_pop(&stream->context, JSON_STREAM_FRAME_SIZE);
+    stream->frame = parent;
+    json_stream_value(stream, &value);
+}
+
+/*
+ * Scans on from p through the current token: a string when string is set,
+ * otherwise a run of number and literal characters. Returns its end with
+ * *complete set, or end with *complete clear when the chunk runs out first.
+ */
+static const char* json_stream_token_end(json_stream *stream, int string, const char *p, const char *end, int *complete) {
+    *complete = 0;
+    if (!string) {
+        while (p < end && JSON_STREAM_WORD_CHAR(*p)) {
+            p++;
+        }
+        *complete = p < end;
+        return p;
+    }
+
+    if (stream->token_escape) {
+        if (p == end) {
+            return end;
+        }
+        p++;
+        stream->token_escape = 0;
+    }
+    for (;;) {
+        p = json_scan.scan_string(p, end);
+        if (p == end) {
+            return end;
+        }
+        if ('\\' != *p) {
+            /* the closing quote, or a control character json_parse_string_raw will reject */
+            *complete = 1;
+            return p + 1;
+        }
+        if (p + 1 == end) {
+            stream->token_escape = 1;
+            return end;
+        }
+        p += 2;
+    }
+}
+
+static void json_stream_keep(json_stream *stream, const char *p, const char *end) {
+    size_t len = end - p;
+
+    if (stream->token_len + len > stream->token_size) {
+        while (stream->token_len + len > stream->token_size) {
+            stream->token_size = stream->token_size ? stream->token_size * 2 : 64;
+        }
+        stream->token = (char *)JSON_REALLOC(stream->token, stream->token_size);
+    }
+    memcpy(stream->token + stream->token_len, p, len);
+    stream->token_len += len;
+}
+
+/* parses the complete scalar or key in [p, end), returns where parsing stopped */
+static const char* json_stream_scalar(json_stream *stream, const char *p, const char *end) {
+    json_context *context = &stream->context;
+
+    context->json = p;
+    context->end = end;
+    if (JSON_STREAM_KEY == stream->state || JSON_STREAM_FIRST_KEY == stream->state) {
+        const char *str;
+        size_t len;
+        int borrowed;
+        if (JSON_PARSE_OK != (stream->error = json_parse_string_raw(context, &str, &len, &borrowed))) {
+            return context->json;
+        }
+        if (NULL != stream->handler) {
+            if (NULL != stream->handler->key_fn && 0 != stream->handler->key_fn(stream->user, str, len)) {
+                stream->error = JSON_PARSE_ABORTED;
+            }
+        } else {
+            stream->error = json_string_value(context, &JSON_STREAM_FRAME(stream)->key, str, len, borrowed);
+        }
+        if (JSON_PARSE_OK == stream->error) {
+            stream->state = JSON_STREAM_COLON;
+        }
+    } else if (NULL != stream->handler) {
+        if (JSON_PARSE_OK == (stream->error = json_sax_value(context, stream->handler, stream->user))) {
+            json_stream_value(stream, NULL);
+        }
+    } else {
+        json_value value;
+        json_value_init(&value);
+        if (JSON_PARSE_OK == (stream->error = json_parse_value(context, &value))) {
+            json_stream_value(stream, &value);
+        }
+    }
+    return context->json;
+}
+
+static void json_stream_run(json_stream *stream, const char *p, const char *end) {
+    while (p < end && JSON_PARSE_OK == stream->error) {
+        const char *token_end;
+        int complete;
+        char ch = *p;
+
+        if (ISWS(ch)) {
+            p = json_scan.skip_whitespace(p, end);
+            continue;
+        }
+
+        switch (stream->state) {
+            case JSON_STREAM_FIRST_VALUE:
+                if (']' == ch) {
+                    p++;
+                    json_stream_close(stream);
+                    continue;
+                }
+                /* fall through */
+            case JSON_STREAM_VALUE:
+                if ('[' == ch || '{' == ch) {
+                    p++;
+                    json_stream_open(stream, '[' == ch ? JSON_ARRAY : JSON_OBJECT);
+                    continue;
+                }
+                break;
+            case JSON_STREAM_FIRST_KEY:
+                if ('}' == ch) {
+                    p++;
+                    json_stream_close(stream);
+                    continue;
+                }
+                /* fall through */
+            case JSON_STREAM_KEY:
+                if ('\"' != ch) {
+                    stream->error = JSON_PARSE_MISS_KEY;
+                    continue;
+                }
+                break;
+            case JSON_STREAM_COLON:
+                if (':' != ch) {
+                    stream->error = JSON_PARSE_MISS_COLON;
+                    continue;
+                }
+                p++;
+                stream->state = JSON_STREAM_VALUE;
+                continue;
+            case JSON_STREAM_NEXT: {
+                int array = JSON_ARRAY == JSON_STREAM_FRAME(stream)->type;
+                if (',' == ch) {
+                    p++;
+                    stream->state = array ? JSON_STREAM_VALUE : JSON_STREAM_KEY;
+                } else if ((array ? ']' : '}') == ch) {
+                    p++;
+                    json_stream_close(stream);
+                } else {
+                    stream->error = array ? JSON_PARSE_MISS_COMMA_OR_SQUARE_BRACKET : JSON_PARSE_MISS_COMMA_OR_CURLY_BRACKET;
+                }
+                continue;
+            }
+            default:
+                return;
+        }
+
+        /* a scalar or a key starts at p */
+        if ('\"' == ch || JSON_STREAM_WORD_CHAR(ch)) {
+            stream->token_escape = 0;
+            token_end = json_stream_token_end(stream, '\"' == ch, p + 1, end, &complete);
+            if (!complete) {
+                json_stream_keep(stream, p, end);
+                return;
+            }
+        } else {
+            token_end = p + 1;
+        }
+        p = json_stream_scalar(stream, p, token_end);
+    }
+}
+
+/* parses the token held over from earlier chunks */
+static void json_stream_flush(json_stream *stream) {
+    size_t len = stream->token_len;
+    const char *stop;
+
+    stream->token_len = 0;
+    stop = json_stream_scalar(stream, stream->token, stream->token + len);
+    /* whatever the scalar parser left over cannot start a new token, only fail */
+    json_stream_run(stream, stop, stream->token + len);
+    assert(0 == stream->token_len);
+}
+
+json_stream* json_stream_create(void) {
+    json_stream *stream = (json_stream *)JSON_MALLOC(sizeof(json_stream));
+
+    json_context_init(&stream->context, NULL, 0, NULL, NULL);
+    stream->token = NULL;
+    stream->token_size = 0;
+    stream->handler = NULL;
+    stream->user = NULL;
+    json_stream_reset(stream);
+    return stream;
+}
+
+json_stream* json_stream_create_sax(const json_sax_handler *handler, void *user) {
+    json_stream *stream;
+
+    assert(NULL != handler);
+    stream = json_stream_create();
+    stream->handler = handler;
+    stream->user = user;
+    return stream;
+}
+
+void json_stream_free(json_stream *stream) {
+    if (NULL != stream) {
+        json_stream_discard(stream);
+        JSON_FREE(stream->context.stack);
+        JSON_FREE(stream->token);
+        JSON_FREE(stream);
+    }
+}
+
+int json_stream_feed(json_stream *stream, const char *chunk, size_t len) {
+    const char *p = chunk, *end = chunk + len;
+
+    assert(NULL != stream && (NULL != chunk || 0 == len));
+
+    if (JSON_PARSE_OK == stream->error && stream->token_len > 0) {
+        int complete;
+        const char *token_end = json_stream_token_end(stream, '\"' == stream->token[0], p, end, &complete);
+        json_stream_keep(stream, p, token_end);
+        if (!complete) {
+            return JSON_PARSE_OK;
+        }
+        p = token_end;
+        json_stream_flush(stream);
+    }
+
+    json_stream_run(stream, p, end);
+    return stream->error;
+}
+
+int json_stream_finish(json_stream *stream, json_value *value) {
+    int ret;
+
+    assert(NULL != stream && NULL != value);
+
+    /* the end of input completes a held token */
+    if (JSON_PARSE_OK == stream->error && stream->token_len > 0) {
+        json_stream_flush(stream);
+    }
+
+    if (JSON_PARSE_OK == (ret = stream->error)) {
+        switch (stream->state) {
+            case JSON_STREAM_VALUE:
+            case JSON_STREAM_FIRST_VALUE: ret = JSON_PARSE_EXPECT_VALUE; break;
+            case JSON_STREAM_KEY:
+            case JSON_STREAM_FIRST_KEY: ret = JSON_PARSE_MISS_KEY; break;
+            case JSON_STREAM_COLON: ret = JSON_PARSE_MISS_COLON; break;
+            case JSON_STREAM_NEXT:
+                ret = JSON_ARRAY == JSON_STREAM_FRAME(stream)->type ?
+                      JSON_PARSE_MISS_COMMA_OR_SQUARE_BRACKET : JSON_PARSE_MISS_COMMA_OR_CURLY_BRACKET;
+                break;
+            default: break;
+        }
+    }
+
+    json_value_init(value);
+    if (JSON_PARSE_OK == ret) {
+        *value = stream->root;
+        json_value_init(&stream->root);
+    }
+    json_stream_discard(stream);
+    json_stream_reset(stream);
+    return ret;
+}
+
+/*
+ * Event parsing: the token routines json_parse_value uses, but arrays and
+ * objects are only reported, never built. The context stack serves only to
+ * unescape strings, so memory does not grow with the document.
+ */
+#define JSON_SAX_EMIT(handler, fn, args) \
+    do {\
+        if (NULL != (handler)->fn && 0 != (handler)->fn args) {\
+            return JSON_PARSE_ABORTED;\
+        }\
+    } while(0)
+
+static int json_sax_value(json_context *context, const json_sax_handler *handler, void *user);
+
+static int json_sax_array(json_context *context, const json_sax_handler *handler, void *user) {
+    size_t size = 0;
+    int ret;
+    EXPECT(context, '[');
+
+    JSON_SAX_EMIT(handler, start_array_fn, (user));
+    json_parse_whitespace(context);
+
+    if (']' == PEEK(context)) {
+        context->json ++;
+        JSON_SAX_EMIT(handler, end_array_fn, (user, 0));
+        return JSON_PARSE_OK;
+    }
+
+    for (;;) {
+        if ((ret = json_sax_value(context, handler, user)) != JSON_PARSE_OK) {
+            return ret;
+        }
+        size++;
+
+        json_parse_whitespace(context);
+        if (',' == PEEK(context)) {
+            context->json ++;
+            json_parse_whitespace(context);
+        } else if (']' == PEEK(context)) {
+            context->json ++;
+            JSON_SAX_EMIT(handler, end_array_fn, (user, size));
+            return JSON_PARSE_OK;
+        } else {
+            return JSON_PARSE_MISS_COMMA_OR_SQUARE_BRACKET;
+        }
+    }
+}
+
+static int json_sax_object(json_context *context, const json_sax_handler *handler, void *user) {
+    size_t size = 0, len;
+    const char *str;
+    int ret, borrowed;
+    EXPECT(context, '{');
+
+    JSON_SAX_EMIT(handler, start_object_fn, (user));
+    json_parse_whitespace(context);
+
+    if ('}' == PEEK(context)) {
+        context->json ++;
+        JSON_SAX_EMIT(handler, end_object_fn, (user, 0));
+        return JSON_PARSE_OK;
+    }
+
+    for (;;) {
+        if ('\"' != PEEK(context)) {
+            return JSON_PARSE_MISS_KEY;
+        }
+        if ((ret = json_parse_string_raw(context, &str, &len, &borrowed)) != JSON_PARSE_OK) {
+            return ret;
+        }
+        JSON_SAX_EMIT(handler, key_fn, (user, str, len));
+
+        json_parse_whitespace(context);
+        if (':' != PEEK(context)) {
+            return JSON_PARSE_MISS_COLON;
+        }
+        context->json ++;
+        json_parse_whitespace(context);
+
+        if ((ret = json_sax_value(context, handler, user)) != JSON_PARSE_OK) {
+            return ret;
+        }
+        size++;
+
+        json_parse_whitespace(context);
+        if (',' == PEEK(context)) {
+            context->json ++;
+            json_parse_whitespace(context);
+        } else if ('}' == PEEK(context)) {
+            context->json ++;
+            JSON_SAX_EMIT(handler, end_object_fn, (user, size));
+            return JSON_PARSE_OK;
+        } else {
+            return JSON_PARSE_MISS_COMMA_OR_CURLY_BRACKET;
+        }
+    }
+}
+
+static int json_sax_value(json_context *context, const json_sax_handler *handler, void *user) {
+    json_value value;
+    const char *str;
+    size_t len;
+    int ret, borrowed;
+
+    switch (PEEK(context)) {
+        case '[': return json_sax_array(context, handler, user);
+        case '{': return json_sax_object(context, handler, user);
+        case '\"':
+            if ((ret = json_parse_string_raw(context, &str, &len, &borrowed)) != JSON_PARSE_OK) {
+                return ret;
+            }
+            JSON_SAX_EMIT(handler, string_fn, (user, str, len));
+            return JSON_PARSE_OK;
+        default:
+            /* literals and numbers parse into a json_value without allocating */
+            json_value_init(&value);
+            if ((ret = json_parse_value(context, &value)) != JSON_PARSE_OK) {
+                return ret;
+            }
+            if (JSON_NULL == value.type) {
+                JSON_SAX_EMIT(handler, null_fn, (user));
+            } else if (JSON_NUMBER == value.type) {
+                JSON_SAX_EMIT(handler, number_fn, (user, &value));
+            } else {
+                JSON_SAX_EMIT(handler, boolean_fn, (user, JSON_TRUE == value.type));
+            }
+            return JSON_PARSE_OK;
+    }
+}
+
+int json_parse_sax(const char *json, size_t len, const json_sax_handler *handler, void *user) {
+    json_context context;
+    int ret;
+    assert(NULL != handler && (NULL != json || 0 == len));
+    json_context_init(&context, json, len, NULL, NULL);
+
+    json_parse_whitespace(&context);
+    ret = json_sax_value(&context, handler, user);
+
+    JSON_FREE(context.stack);
+    return ret;
+}
+
+/*
+ * Paths: JSON Pointer and a JSONPath subset compile to the same list of
+ * steps. A step names a member, indexes an element, does either (pointer
+ * tokens made of digits), or takes every child. json_parse_path walks the
+ * text with the step list: members and elements off the path are checked
+ * by json_skip_value but never built, and only the values at the end of
+ * the path become trees.
+ */
+enum {
+    JSON_PATH_NAME,
+    JSON_PATH_INDEX,
+    JSON_PATH_NAME_OR_INDEX,
+    JSON_PATH_ANY
+};
+
+typedef struct {
+    int kind;
+    const char *name; size_t len; /* NAME, NAME_OR_INDEX */
+    size_t index; /* INDEX, NAME_OR_INDEX */
+} json_path_step;
+
+struct json_path {
+    json_path_step *steps;
+    size_t count;
+    char *names; /* the unescaped names, back to back */
+};
+
+/* room for as many steps and name bytes as the text could hold */
+static json_path* json_path_alloc(size_t len) {
+    json_path *path = (json_path *)JSON_MALLOC(sizeof(json_path));
+
+    path->steps = (json_path_step *)JSON_MALLOC((len + 1) * sizeof(json_path_step));
+    path->count = 0;
+    path->names = (char *)JSON_MALLOC(len + 1);
+    return path;
+}
+
+void json_path_free(json_path *path) {
+    if (NULL != path) {
+        JSON_FREE(path->steps);
+        JSON_FREE(path->names);
+        JSON_FREE(path);
+    }
+}
+
+/* a decimal index without leading zeros, as both syntaxes spell them */
+static int json_path_index(const char *p, size_t len, size_t *index) {
+    size_t i;
+
+    if (0 == len || (len > 1 && '0' == p[0]) || len > 18) {
+        return 0;
+    }
+    for (*index = 0, i = 0; i < len; i++) {
+        if (!ISDIGIT(p[i])) {
+            return 0;
+        }
+        *index = *index * 10 + (p[i] - '0');
+    }
+    return 1;
+}
+
+json_path* json_path_compile_pointer(const char *pointer, size_t len) {
+    json_path *path;
+    const char *p = pointer, *end = pointer + len;
+    char *name;
+
+    assert(NULL != pointer || 0 == len);
+    if (p != end && '/' != *p) {
+        return NULL;
+    }
+
+    path = json_path_alloc(len);
+    name = path->names;
+    while (p != end) {
+        json_path_step *step = &path->steps[path->count++];
+        step->name = name;
+        for (p++; p != end && '/' != *p; p++) {
+            if ('~' != *p) {
+                *name++ = *p;
+            } else if (p + 1 != end && ('0' == p[1] || '1' == p[1])) {
+                *name++ = '0' == *++p ? '~' : '/';
+            } else {
+                json_path_free(path);
+                return NULL;
+            }
+        }
+        step->len = name - step->name;
+        step->kind = json_path_index(step->name, step->len, &step->index) ? JSON_PATH_NAME_OR_INDEX : JSON_PATH_NAME;
+    }
+    return path;
+}
+
+json_path* json_path_compile(const char *text, size_t len) {
+    json_path *path;
+    const char *p = text, *end = text + len;
+    char *name;
+    int ok = 1;
+
+    assert(NULL != text || 0 == len);
+    if (p == end || '$' != *p++) {
+        return NULL;
+    }
+
+    path = json_path_alloc(len);
+    name = path->names;
+    while (ok && p != end) {
+        json_path_step *step = &path->steps[path->count++];
+        const char *start;
+
+        step->name = name;
+        if ('.' == *p) {
+            /* .name or .* */
+            for (start = ++p; p != end && '.' != *p && '[' != *p; p++) {
+                *name++ = *p;
+            }
+            if (p == start) {
+                ok = 0;
+                continue;
+            }
+            step->len = name - step->name;
+            step->kind = 1 == p - start && '*' == *start ? JSON_PATH_ANY : JSON_PATH_NAME;
+        } else if ('[' == *p && end - p > 2 && ('\'' == p[1] || '\"' == p[1])) {
+            /* ['name'] or ["name"], with backslash escaping the quote and itself */
+            char quote = p[1];
+            for (p += 2; p != end && quote != *p; p++) {
+                if ('\\' == *p && p + 1 != end && (quote == p[1] || '\\' == p[1])) {
+                    p++;
+                }
+                *name++ = *p;
+            }
+            step->len = name - step->name;
+            step->kind = JSON_PATH_NAME;
+            if ((ok = end - p >= 2 && ']' == p[1])) {
+                p += 2;
+            }
+        } else if ('[' == *p) {
+            /* [index] or [*] */
+            for (start = ++p; p != end && ']' != *p; p++) {
+            }
+            if (p != end && 1 == p - start && '*' == *start) {
+                step->kind = JSON_PATH_ANY;
+            } else if (p != end && json_path_index(start, p - start, &step->index)) {
+                step->kind = JSON_PATH_INDEX;
+            } else {
+                ok = 0;
+                continue;
+            }
+            p++;
+        } else {
+            ok = 0;
+        }
+    }
+
+    if (!ok) {
+        json_path_free(path);
+        return NULL;
+    }
+    return path;
+}
+
+static int json_path_step_key(const json_path_step *step, const char *key, size_t len) {
+    return JSON_PATH_ANY == step->kind ||
+           (JSON_PATH_INDEX != step->kind && step->len == len && 0 == memcmp(step->name, key, len));
+}
+
+static int json_path_step_index(const json_path_step *step, size_t index) {
+    return JSON_PATH_ANY == step->kind || (JSON_PATH_NAME != step->kind && step->index == index);
+}
+
+static int json_path_visit(const json_path *path, size_t depth, json_value *value, json_path_fn fn, void *user) {
+    const json_path_step *step;
+    size_t i;
+    int ret;
+
+    if (depth == path->count) {
+        return 0 != fn(user, value) ? JSON_PARSE_ABORTED : JSON_PARSE_OK;
+    }
+
+    step = &path->steps[depth];
+    if (JSON_ARRAY == value->type && JSON_PATH_NAME != step->kind) {
+        JSON_EXPAND(value);
+        for (i = 0; i < value->size; i++) {
+            if (json_path_step_index(step, i) &&
+                JSON_PARSE_OK != (ret = json_path_visit(path, depth + 1, &value->u.elements[i], fn, user))) {
+                return ret;
+            }
+        }
+    } else if (JSON_OBJECT == value->type && JSON_PATH_INDEX != step->kind) {
+        JSON_EXPAND(value);
+        for (i = 0; i < value->size; i++) {
+            json_member *m = &value->u.members[i];
+            if (json_path_step_key(step, JSON_STRING_PTR(&m->key), JSON_STRING_LEN(&m->key)) &&
+                JSON_PARSE_OK != (ret = json_path_visit(path, depth + 1, &m->value, fn, user))) {
+                return ret;
+            }
+        }
+    }
+    return JSON_PARSE_OK;
+}
+
+int json_path_each(const json_path *path, const json_value *value, json_path_fn fn, void *user) {
+    assert(NULL != path && NULL != value && NULL != fn);
+    return json_path_visit(path, 0, (json_value *)value, fn, user);
+}
+
+static int json_path_first(void *user, json_value *value) {
+    *(json_value **)user = value;
+    return 1;
+}
+
+json_value* json_path_find(const json_path *path, const json_value *value) {
+    json_value *found = (json_value *)value;
+    size_t i;
+
+    assert(NULL != path && NULL != value);
+    for (i = 0; i < path->count && NULL != found; i++) {
+        const json_path_step *step = &path->steps[i];
+        if (JSON_PATH_ANY == step->kind) {
+            /* fan out from here */
+            json_path walk = *path;
+            json_value *first = NULL;
+            walk.steps += i;
+            walk.count -= i;
+            json_path_visit(&walk, 0, found, json_path_first, &first);
+            return first;
+        }
+        if (JSON_ARRAY == found->type && JSON_PATH_NAME != step->kind) {
+            JSON_EXPAND(found);
+            found = step->index < found->size ? &found->u.elements[step->index] : NULL;
+        } else if (JSON_OBJECT == found->type && JSON_PATH_INDEX != step->kind) {
+            found = json_find_object_value(found, step->name, step->len);
+        } else {
+            found = NULL;
+        }
+    }
+    return found;
+}
+
+/*
+ * Validating skip: the checks of the parser with nothing built, copied or
+ * converted, so a skipped value fails with the error the parser would give.
+ */
+static int json_skip_value(json_context *context);
+
+/* json_parse_string_raw without the copy */
+static int json_skip_string(json_context *context) {
+    const char *p = context->json + 1, *end = context->end;
+    unsigned u;
+    int ret;
+
+    for (;;) {
+        const char *run = json_scan.scan_string(p, end);
+        if (JSON_UTF8_INVALID(context, p, run)) {
+            return JSON_PARSE_INVALID_UTF8;
+        }
+        p = run;
+        if (p == end) {
+            return JSON_PARSE_MISS_QUOTATION_MARK;
+        }
+        switch (*p++) {
+            case '\"':
+                context->json = p;
+                return JSON_PARSE_OK;
+            case '\\':
+                if (p == end) {
+                    return JSON_PARSE_MISS_QUOTATION_MARK;
+                }
+                switch (*p++) {
+                    case '\\': case '/': case '\"': case 'b': case 'f': case 'n': case 'r': case 't':
+                        break;
+                    case 'u':
+                        if ((ret = json_parse_unicode(context, &p, &u)) != JSON_PARSE_OK) {
+                            return ret;
+                        }
+                        break;
+                    default:
+                        return JSON_PARSE_MISS_QUOTATION_MARK;
+                }
+                break;
+            default:
+                return JSON_PARSE_INVALID_STRING_CHAR;
+        }
+    }
+}
+
+/* the grammar of json_parse_number, which fails on nothing else */
+static int json_skip_number(json_context *context) {
+    const char *p = context->json, *end = context->end;
+
+    if (p < end && '-' == *p) {
+        p++;
+    }
+    if (p < end && '0' == *p) {
+        p++;
+    } else if (p < end && ISDIGIT1TO9(*p)) {
+        while (++p < end && ISDIGIT(*p)) {}
+    } else {
+        return JSON_PARSE_INVALID_VALUE;
+    }
+    if (p < end && '.' == *p) {
+        if (!(++p < end && ISDIGIT(*p))) {
+            return JSON_PARSE_INVALID_VALUE;
+        }
+        while (++p < end && ISDIGIT(*p)) {}
+    }
+    if (p < end && ('e' == *p || 'E' == *p)) {
+        if (++p < end && ('-' == *p || '+' == *p)) {
+            p++;
+        }
+        if (!(p < end && ISDIGIT(*p))) {
+            return JSON_PARSE_INVALID_VALUE;
+        }
+        while (++p < end && ISDIGIT(*p)) {}
+    }
+
+    context->json = p;
+    return JSON_PARSE_OK;
+}
+
+static int json_skip_array(json_context *context) {
+    int ret;
+    EXPECT(context, '[');
+
+    json_parse_whitespace(context);
+    if (']' == PEEK(context)) {
+        context->json++;
+        return JSON_PARSE_OK;
+    }
+
+    for (;;) {
+        if ((ret = json_skip_value(context)) != JSON_PARSE_OK) {
+            return ret;
+        }
+
+        json_parse_whitespace(context);
+        if (',' == PEEK(context)) {
+            context->json++;
+            json_parse_whitespace(context);
+        } else if (']' == PEEK(context)) {
+            context->json++;
+            return JSON_PARSE_OK;
+        } else {
+            return JSON_PARSE_MISS_COMMA_OR_SQUARE_BRACKET;
+        }
+    }
+}
+
+static int json_skip_object(json_context *context) {
+    int ret;
+    EXPECT(context, '{');
+
+    json_parse_whitespace(context);
+    if ('}' == PEEK(context)) {
+        context->json++;
+        return JSON_PARSE_OK;
+    }
+
+    for (;;) {
+        if ('\"' != PEEK(context)) {
+            return JSON_PARSE_MISS_KEY;
+        }
+        if ((ret = json_skip_string(context)) != JSON_PARSE_OK) {
+            return ret;
+        }
+
+        json_parse_whitespace(context);
+        if (':' != PEEK(context)) {
+            return JSON_PARSE_MISS_COLON;
+        }
+        context->json++;
+        json_parse_whitespace(context);
+
+        if ((ret = json_skip_value(context)) != JSON_PARSE_OK) {
+            return ret;
+        }
+
+        json_parse_whitespace(context);
+        if (',' == PEEK(context)) {
+            context->json++;
+            json_parse_whitespace(context);
+        } else if ('}' == PEEK(context)) {
+            context->json++;
+            return JSON_PARSE_OK;
+        } else {
+            return JSON_PARSE_MISS_COMMA_OR_CURLY_BRACKET;
+        }
+    }
+}
+
+static int json_skip_value(json_context *context) {
+    json_value literal;
+
+    if (context->json == context->end) {
+        return JSON_PARSE_EXPECT_VALUE;
+    }
+
+    switch (*context->json) {
+        case 'n': return json_parse_literal(context, &literal, "null", JSON_NULL);
+        case 't': return json_parse_literal(context, &literal, "true", JSON_TRUE);
+        case 'f': return json_parse_literal(context, &literal, "false", JSON_FALSE);
+        case '\"': return json_skip_string(context);
+        case '[': return json_skip_array(context);
+        case '{': return json_skip_object(context);
+        default : return json_skip_number(context);
+    }
+}
+
+/* like json_sax_value, building the values at the end of the path and skipping the rest */
+static int json_path_parse(json_context *context, const json_path *path, size_t depth, json_path_fn fn, void *user) {
+    const json_path_step *step;
+    size_t i = 0, len;
+    const char *str;
+    int ret, borrowed, close;
+
+    if (depth == path->count) {
+        json_value value;
+        json_value_init(&value);
+        if (JSON_PARSE_OK != (ret = json_parse_value(context, &value))) {
+            return ret;
+        }
+        return 0 != fn(user, &value) ? JSON_PARSE_ABORTED : JSON_PARSE_OK;
+    }
+
+    step = &path->steps[depth];
+    if ('[' != PEEK(context) && '{' != PEEK(context)) {
+        return json_skip_value(context);
+    }
+
+    close = '[' == *context->json++ ? ']' : '}';
+    json_parse_whitespace(context);
+    if (close == PEEK(context)) {
+        context->json++;
+        return JSON_PARSE_OK;
+    }
+
+    for (;; i++) {
+        int match;
+        if (']' == close) {
+            match = JSON_PATH_NAME != step->kind && json_path_step_index(step, i);
+        } else {
+            if ('\"' != PEEK(context)) {
+                return JSON_PARSE_MISS_KEY;
+            }
+            if ((ret = json_parse_string_raw(context, &str, &len, &borrowed)) != JSON_PARSE_OK) {
+                return ret;
+            }
+            match = JSON_PATH_INDEX != step->kind && json_path_step_key(step, str, len);
+            json_parse_whitespace(context);
+            if (':' != PEEK(context)) {
+                return JSON_PARSE_MISS_COLON;
+            }
+            context->json++;
+            json_parse_whitespace(context);
+        }
+
+        ret = match ? json_path_parse(context, path, depth + 1, fn, user)
+                    : json_skip_value(context);
+        if (JSON_PARSE_OK != ret) {
+            return ret;
+        }
+
+        json_parse_whitespace(context);
+        if (',' == PEEK(context)) {
+            context->json++;
+            json_parse_whitespace(context);
+        } else if (close == PEEK(context)) {
+            context->json++;
+            return JSON_PARSE_OK;
+        } else {
+            return ']' == close ? JSON_PARSE_MISS_COMMA_OR_SQUARE_BRACKET : JSON_PARSE_MISS_COMMA_OR_CURLY_BRACKET;
+        }
+    }
+}
+
+int json_parse_path(const char *json, size_t len, const json_path *path, const json_parse_options *options,
+                    json_path_fn fn, void *user) {
+    json_context context;
+    int ret;
+    assert(NULL != path && NULL != fn && (NULL != json || 0 == len));
+    json_context_init(&context, json, len, NULL, options);
+
+    json_parse_whitespace(&context);
+    ret = json_path_parse(&context, path, 0, fn, user);
+
+    JSON_FREE(context.stack);
+    return ret;
+}
+
+/*
+ * Projection: a field set merges paths into one tree of steps. A node has
+ * its children by name and by index, the child every other member or
+ * element goes to, and whether its value is wanted whole. Pointer tokens
+ * made of digits go under both a name and an index; a wildcard goes into
+ * the other child and into every named and indexed one, and a named or
+ * indexed child starts as a copy of the other child, so a member or
+ * element only ever follows one node.
+ */
+typedef struct json_field_node json_field_node;
+
+struct json_field_node {
+    int kind; /* JSON_PATH_NAME or JSON_PATH_INDEX */
+    char *name; size_t len; /* NAME, owned */
+    size_t index; /* INDEX */
+    json_field_node *next; /* the next child of the same parent */
+    json_field_node *children, *other;
+    int whole;
+};
+
+struct json_field_set {
+    json_field_node root;
+};
+
+static void json_field_node_clear(json_field_node *node) {
+    json_field_node *child, *next;
+
+    for (child = node->children; NULL != child; child = next) {
+        next = child->next;
+        json_field_node_clear(child);
+        JSON_FREE(child);
+    }
+    if (NULL != node->other) {
+        json_field_node_clear(node->other);
+        JSON_FREE(node->other);
+    }
+    JSON_FREE(node->name);
+}
+
+/* copies the subtree of from below node, whose own step stays */
+static void json_field_node_copy(json_field_node *node, const json_field_node *from) {
+    const json_field_node *child;
+    json_field_node **tail = &node->children;
+
+    node->whole = from->whole;
+    for (child = from->children; NULL != child; child = child->next) {
+        json_field_node *copy = (json_field_node *)JSON_MALLOC(sizeof(json_field_node));
+        memset(copy, 0, sizeof(json_field_node));
+        copy->kind = child->kind;
+        copy->index = child->index;
+        copy->len = child->len;
+        if (JSON_PATH_NAME == child->kind) {
+            copy->name = (char *)JSON_MALLOC(child->len + 1);
+            memcpy(copy->name, child->name, child->len);
+        }
+        json_field_node_copy(copy, child);
+        *tail = copy;
+        tail = &copy->next;
+    }
+    if (NULL != from->other) {
+        node->other = (json_field_node *)JSON_MALLOC(sizeof(json_field_node));
+        memset(node->other, 0, sizeof(json_field_node));
+        json_field_node_copy(node->other, from->other);
+    }
+}
+
+static json_field_node* json_field_node_child(json_field_node *node, int kind, const char *name, size_t len,
+                                              size_t index) {
+    json_field_node *child;
+
+    for (child = node->children; NULL != child; child = child->next) {
+        if (kind == child->kind && (JSON_PATH_NAME == kind
+                                    ? len == child->len && 0 == memcmp(name, child->name, len)
+                                    : index == child->index)) {
+            return child;
+        }
+    }
+
+    child = (json_field_node *)JSON_MALLOC(sizeof(json_field_node));
+    memset(child, 0, sizeof(json_field_node));
+    child->kind = kind;
+    if (JSON_PATH_NAME == kind) {
+        child->name = (char *)JSON_MALLOC(len + 1);
+        memcpy(child->name, name, len);
+        child->len = len;
+    } else {
+        child->index = index;
+    }
+    if (NULL != node->other) {
+        json_field_node_copy(child, node->other);
+    }
+    child->next = node->children;
+    node->children = child;
+    return child;
+}
+
+static void json_field_node_add(json_field_node *node, const json_path_step *steps, size_t count) {
+    json_field_node *child;
+
+    if (0 == count) {
+        node->whole = 1;
+        return;
+    }
+
+    switch (steps->kind) {
+        case JSON_PATH_NAME:
+            child = json_field_node_child(node, JSON_PATH_NAME, steps->name, steps->len, 0);
+            json_field_node_add(child, steps + 1, count - 1);
+            break;
+        case JSON_PATH_INDEX:
+            child = json_field_node_child(node, JSON_PATH_INDEX, NULL, 0, steps->index);
+            json_field_node_add(child, steps + 1, count - 1);
+            break;
+        case JSON_PATH_NAME_OR_INDEX:
+            child = json_field_node_child(node, JSON_PATH_NAME, steps->name, steps->len, 0);
+            json_field_node_add(child, steps + 1, count - 1);
+            child = json_field_node_child(node, JSON_PATH_INDEX, NULL, 0, steps->index);
+            json_field_node_add(child, steps + 1, count - 1);
+            break;
+        default:
+            for (child = node->children; NULL != child; child = child->next) {
+                json_field_node_add(child, steps + 1, count - 1);
+            }
+            if (NULL == node->other) {
+                node->other = (json_field_node *)JSON_MALLOC(sizeof(json_field_node));
+                memset(node->other, 0, sizeof(json_field_node));
+            }
+            json_field_node_add(node->other, steps + 1, count - 1);
+    }
+}
+
+json_field_set* json_field_set_create(void) {
+    json_field_set *fields = (json_field_set *)JSON_MALLOC(sizeof(json_field_set));
+    memset(fields, 0, sizeof(json_field_set));
+    return fields;
+}
+
+void json_field_set_add(json_field_set *fields, const json_path *path) {
+    assert(NULL != fields && NULL != path);
+    json_field_node_add(&fields->root, path->steps, path->count);
+}
+
+void json_field_set_free(json_field_set *fields) {
+    if (NULL != fields) {
+        json_field_node_clear(&fields->root);
+        JSON_FREE(fields);
+    }
+}
+
+/* the node a member or element follows, NULL when it is not in the set */
+static const json_field_node* json_field_member(const json_field_node *node, const char *key, size_t len) {
+    const json_field_node *child;
+
+    for (child = node->children; NULL != child; child = child->next) {
+        if (JSON_PATH_NAME == child->kind && len == child->len && 0 == memcmp(key, child->name, len)) {
+            return child;
+        }
+    }
+    return node->other;
+}
+
+static const json_field_node* json_field_element(const json_field_node *node, size_t index) {
+    const json_field_node *child;
+
+    for (child = node->children; NULL != child; child = child->next) {
+        if (JSON_PATH_INDEX == child->kind && index == child->index) {
+            return child;
+        }
+    }
+    return node->other;
+}
+
+/* a value is kept whole, or followed when it is an array or object; scalars below the set are dropped */
+#define JSON_FIELD_KEEPS(node, context) \
+    ((node)->whole || '[' == PEEK(context) || '{' == PEEK(context))
+
+static int json_parse_projected_value(json_context *context, const json_field_node *node, json_value *value);
+
+static int json_parse_projected_array(json_context *context, const json_field_node *node, json_value *value) {
+    size_t size = 0, i;
+    int ret;
+    EXPECT(context, '[');
+
+    json_parse_whitespace(context);
+    if (']' == PEEK(context)) {
+        context->json++;
+        json_context_pop_array(context, value, 0);
+        return JSON_PARSE_OK;
+    }
+
+    for (;;) {
+        const json_field_node *child = json_field_element(node, size);
+        json_value element;
+        json_value_init(&element);
+
+        if (UINT32_MAX == size) {
+            ret = JSON_PARSE_TOO_LARGE;
+            break;
+        }
+        if (NULL == child || !JSON_FIELD_KEEPS(child, context)) {
+            /* left null, so that the elements kept keep their indexes */
+            if ((ret = json_skip_value(context)) != JSON_PARSE_OK) {
+                break;
+            }
+        } else if ((ret = json_parse_projected_value(context, child, &element)) != JSON_PARSE_OK) {
+            break;
+        }
+        memcpy(json_context_push(context, sizeof(json_value)), &element, sizeof(json_value));
+        size++;
+
+        json_parse_whitespace(context);
+        if (',' == PEEK(context)) {
+            context->json++;
+            json_parse_whitespace(context);
+        } else if (']' == PEEK(context)) {
+            context->json++;
+            json_context_pop_array(context, value, size);
+            return JSON_PARSE_OK;
+        } else {
+            ret = JSON_PARSE_MISS_COMMA_OR_SQUARE_BRACKET;
+            break;
+        }
+    }
+
+    for (i = 0; i < size; ++i) {
+        json_context_free_value(context, json_context_pop(context, sizeof(json_value)));
+    }
+    return ret;
+}
+
+static int json_parse_projected_object(json_context *context, const json_field_node *node, json_value *value) {
+    size_t size = 0, i, len;
+    int ret, borrowed;
+    const char *str;
+    json_member member;
+    EXPECT(context, '{');
+
+    json_parse_whitespace(context);
+    if ('}' == PEEK(context)) {
+        context->json++;
+        json_context_pop_object(context, value, 0);
+        return JSON_PARSE_OK;
+    }
+
+    for (;;) {
+        const json_field_node *child;
+
+        if ('\"' != PEEK(context)) {
+            ret = JSON_PARSE_MISS_KEY;
+            break;
+        }
+        if ((ret = json_parse_string_raw(context, &str, &len, &borrowed)) != JSON_PARSE_OK) {
+            break;
+        }
+        child = json_field_member(node, str, len);
+
+        json_parse_whitespace(context);
+        if (':' != PEEK(context)) {
+            ret = JSON_PARSE_MISS_COLON;
+            break;
+        }
+        context->json++;
+        json_parse_whitespace(context);
+
+        if (NULL == child || !JSON_FIELD_KEEPS(child, context)) {
+            if ((ret = json_skip_value(context)) != JSON_PARSE_OK) {
+                break;
+            }
+        } else {
+            json_value_init(&member.key);
+            json_value_init(&member.value);
+
+            if (UINT32_MAX == size) {
+                ret = JSON_PARSE_TOO_LARGE;
+                break;
+            }
+            /* nothing has been pushed since, so an unescaped key is still on top of the stack */
+            if ((ret = json_key_value(context, &member.key, str, len, borrowed)) != JSON_PARSE_OK) {
+                break;
+            }
+            if ((ret = json_parse_projected_value(context, child, &member.value)) != JSON_PARSE_OK) {
+                json_context_free_value(context, &member.key);
+                break;
+            }
+            memcpy(json_context_push(context, sizeof(json_member)), &member, sizeof(json_member));
+            size++;
+        }
+
+        json_parse_whitespace(context);
+        if (',' == PEEK(context)) {
+            context->json++;
+            json_parse_whitespace(context);
+        } else if ('}' == PEEK(context)) {
+            context->json++;
+            json_context_pop_object(context, value, size);
+            return JSON_PARSE_OK;
+        } else {
+            ret = JSON_PARSE_MISS_COMMA_OR_CURLY_BRACKET;
+            break;
+        }
+    }
+
+    for (i = 0; i < size; ++i) {
+        json_member *mem = json_context_pop(context, sizeof(json_member));
+        json_context_free_value(context, &mem->key);
+        json_context_free_value(context, &mem->value);
+    }
+    return ret;
+}
+
+static int json_parse_projected_value(json_context *context, const json_field_node *node, json_value *value) {
+    if (node->whole) {
+        return json_parse_value(context, value);
+    }
+    switch (PEEK(context)) {
+        case '[': return json_parse_projected_array(context, node, value);
+        case '{': return json_parse_projected_object(context, node, value);
+        default : return json_skip_value(context);
+    }
+}
+
+int json_parse_projected(json_value *value, const char *json, size_t len, const json_field_set *fields,
+                         const json_parse_options *options) {
+    json_context context;
+    int ret;
+    assert(NULL != value && NULL != fields && (NULL != json || 0 == len));
+    json_context_init(&context, json, len, NULL, options);
+
+    json_value_init(value);
+    json_parse_whitespace(&context);
+    ret = json_parse_projected_value(&context, &fields->root, value);
+
+    assert(0 == context.top);
+    JSON_FREE(context.stack);
+    return ret;
+}
+
+/*
+ * NDJSON: one value per line. The buffer is cut at newlines into batches of
+ * about JSON_NDJSON_BATCH_SIZE bytes; workers claim batches in order and
+ * parse their lines with a private context, and the calling thread hands
+ * the finished batches to the callback in input order. At most
+ * JSON_NDJSON_WINDOW batches per worker are parsed ahead of delivery.
+ */
+#ifndef JSON_NDJSON_BATCH_SIZE
+#define JSON_NDJSON_BATCH_SIZE (64 * 1024)
+#endif
+
+#ifndef JSON_NDJSON_WINDOW
+#define JSON_NDJSON_WINDOW 4
+#endif
+
+typedef struct {
+    json_value value;
+    size_t line; /* within the batch, from 0 */
+    int error;
+} json_ndjson_result;
+
+typedef struct {
+    const char *begin, *end; /* whole lines */
+    json_ndjson_result *results; size_t count, capacity; /* the lines that are not blank */
+    size_t lines;
+    int done;
+} json_ndjson_batch;
+
+static void json_ndjson_parse_batch(json_context *context, json_ndjson_batch *batch) {
+    const char *p = batch->begin, *end = batch->end;
+
+    batch->count = batch->lines = 0;
+    while (p < end) {
+        const char *newline = (const char *)memchr(p, '\n', end - p);
+        const char *line_end = newline ? newline : end;
+
+        if (json_scan.skip_whitespace(p, line_end) != line_end) {
+            json_ndjson_result *result;
+            if (batch->count == batch->capacity) {
+                batch->capacity = batch->capacity ? batch->capacity * 2 : 64;
+                batch->results = (json_ndjson_result *)JSON_REALLOC(batch->results, batch->capacity * sizeof(json_ndjson_result));
+            }
+            result = &batch->results[batch->count++];
+            result->line = batch->lines;
+            result->error = json_parse_context(context, &result->value, p, line_end - p);
+        }
+        batch->lines++;
+        p = newline ? newline + 1 : end;
+    }
+}
+
+/* hands one batch to fn, or only frees it once fn has asked to stop */
+static int json_ndjson_deliver(json_ndjson_batch *batch, size_t first_line, int ret, json_ndjson_fn fn, void *user) {
+    size_t i;
+
+    for (i = 0; i < batch->count; i++) {
+        json_ndjson_result *result = &batch->results[i];
+        if (JSON_PARSE_OK == ret && 0 != fn(user, first_line + result->line, result->error, &result->value)) {
+            ret = JSON_PARSE_ABORTED;
+        } else if (JSON_PARSE_OK != ret) {
+            json_value_free(&result->value);
+        }
+    }
+    return ret;
+}
+
+/* the next batch starting at p, cut after a newline */
+static const char* json_ndjson_cut(const char *p, const char *end) {
+    const char *newline;
+
+    if ((size_t)(end - p) <= JSON_NDJSON_BATCH_SIZE) {
+        return end;
+    }
+    newline = (const char *)memchr(p + JSON_NDJSON_BATCH_SIZE, '\n', end - p - JSON_NDJSON_BATCH_SIZE);
+    return newline ? newline + 1 : end;
+}
+
+static int json_ndjson_sequential(const char *json, const char *end, json_context *context, json_ndjson_fn fn, void *user) {
+    json_ndjson_batch batch;
+    size_t line = 1;
+    int ret = JSON_PARSE_OK;
+
+    batch.results = NULL;
+    batch.capacity = 0;
+    while (json < end && JSON_PARSE_OK == ret) {
+        batch.begin = json;
+        batch.end = json = json_ndjson_cut(json, end);
+        json_ndjson_parse_batch(context, &batch);
+        ret = json_ndjson_deliver(&batch, line, ret, fn, user);
+        line += batch.lines;
+    }
+    JSON_FREE(batch.results);
+    return ret;
+}
+
+#ifdef JSON_THREADS
+typedef struct {
+    const char *json, *end; /* the input not yet cut into batches */
+    const json_parse_options *options;
+    json_ndjson_batch *slots; /* batch k lives in slot k % window */
+    size_t window, next, delivered;
+    int stop;
+    pthread_mutex_t lock;
+    pthread_cond_t ready; /* a batch was parsed */
+    pthread_cond_t room; /* a slot was delivered and may take a new batch */
+} json_ndjson_pool;
+
+static void* json_ndjson_worker(void *arg) {
+    json_ndjson_pool *pool = (json_ndjson_pool *)arg;
+    json_context context;
+
+    json_context_init(&context, NULL, 0, NULL, pool->options);
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        json_ndjson_batch *batch;
+        while (!pool->stop && pool->json < pool->end && pool->next >= pool->delivered + pool->window) {
+            pthread_cond_wait(&pool->room, &pool->lock);
+        }
+        if (pool->stop || pool->json >= pool->end) {
+            break;
+        }
+        batch = &pool->slots[pool->next++ % pool->window];
+        batch->begin = pool->json;
+        batch->end = pool->json = json_ndjson_cut(pool->json, pool->end);
+        pthread_mutex_unlock(&pool->lock);
+
+        json_ndjson_parse_batch(&context, batch);
+
+        pthread_mutex_lock(&pool->lock);
+        batch->done = 1;
+        pthread_cond_broadcast(&pool->ready);
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    JSON_FREE(context.stack);
+    return NULL;
+}
+
+static int json_ndjson_parallel(const char *json, const char *end, int threads, const json_parse_options *options,
+                                json_context *context, json_ndjson_fn fn, void *user) {
+    json_ndjson_pool pool;
+    pthread_t *workers;
+    size_t k, line = 1;
+    int i, started = 0, ret = JSON_PARSE_OK;
+
+    pool.json = json;
+    pool.end = end;
+    pool.options = options;
+    pool.window = (size_t)threads * JSON_NDJSON_WINDOW;
+    pool.slots = (json_ndjson_batch *)JSON_MALLOC(pool.window * sizeof(json_ndjson_batch));
+    memset(pool.slots, 0, pool.window * sizeof(json_ndjson_batch));
+    pool.next = pool.delivered = 0;
+    pool.stop = 0;
+    pthread_mutex_init(&pool.lock, NULL);
+    pthread_cond_init(&pool.ready, NULL);
+    pthread_cond_init(&pool.room, NULL);
+
+    workers = (pthread_t *)JSON_MALLOC(threads * sizeof(pthread_t));
+    for (i = 0; i < threads; i++) {
+        if (0 == pthread_create(&workers[started], NULL, json_ndjson_worker, &pool)) {
+            started++;
+        }
+    }
+
+    if (0 == started) {
+        ret = json_ndjson_sequential(json, end, context, fn, user);
+    } else {
+        for (k = 0;; k++) {
+            json_ndjson_batch *batch = &pool.slots[k % pool.window];
+
+            pthread_mutex_lock(&pool.lock);
+            while (k < pool.next ? !batch->done : (!pool.stop && pool.json < pool.end)) {
+                pthread_cond_wait(&pool.ready, &pool.lock);
+            }
+            if (k >= pool.next) {
+                pthread_mutex_unlock(&pool.lock);
+                break;
+            }
+            pthread_mutex_unlock(&pool.lock);
+
+            ret = json_ndjson_deliver(batch, line, ret, fn, user);
+            line += batch->lines;
+
+            pthread_mutex_lock(&pool.lock);
+            batch->done = 0;
+            pool.delivered++;
+            pool.stop = JSON_PARSE_OK != ret;
+            pthread_cond_broadcast(&pool.room);
+            pthread_mutex_unlock(&pool.lock);
+        }
+    }
+
+    for (i = 0; i < started; i++) {
+        pthread_join(workers[i], NULL);
+    }
+    for (k = 0; k < pool.window; k++) {
+        JSON_FREE(pool.slots[k].results);
+    }
+    JSON_FREE(pool.slots);
+    JSON_FREE(workers);
+    pthread_mutex_destroy(&pool.lock);
+    pthread_cond_destroy(&pool.ready);
+    pthread_cond_destroy(&pool.room);
+    return ret;
+}
+#endif
+
+int json_parse_ndjson(const char *json, size_t len, int threads, const json_parse_options *options,
+                      json_ndjson_fn fn, void *user) {
+    json_context context;
+    int ret;
+
+    assert(NULL != fn && (NULL != json || 0 == len));
+    json_context_init(&context, NULL, 0, NULL, options);
+
+    /* pick the scanners before any worker can race to */
+    json_scan.skip_whitespace(json, json);
+
+#ifdef JSON_THREADS
+    if (threads <= 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = cpus > 0 ? (int)cpus : 1;
+    }
+    if (threads > 1 && len > JSON_NDJSON_BATCH_SIZE && NULL == context.keys) {
+        ret = json_ndjson_parallel(json, json + len, threads, options, &context, fn, user);
+    } else
+#endif
+    {
+        ret = json_ndjson_sequential(json, json + len, &context, fn, user);
+    }
+
+    JSON_FREE(context.stack);
+    return ret;
+}
+
+/*
+ * Files are mapped read-only and parsed in place. The kernel reads ahead of
+ * the parser and may drop clean pages behind it, so an event pass over a
+ * file larger than RAM needs only address space. What cannot be mapped
+ * (pipes, empty or special files, platforms without mmap) is read in
+ * chunks instead and fed to json_stream, in event mode for SAX, so that a
+ * pipe of any length is parsed in bounded memory.
+ */
+#ifndef JSON_FILE_CHUNK_SIZE
+#define JSON_FILE_CHUNK_SIZE (64 * 1024)
+#endif
+
+enum {
+    JSON_FILE_MAPPED,
+    JSON_FILE_UNMAPPED, /* readable, but not through a mapping */
+    JSON_FILE_ERROR
+};
+
+static int json_file_map(const char *path, const char **data, size_t *len) {
+#ifdef JSON_POSIX
+    struct stat st;
+    void *map;
+    int fd = open(path, O_RDONLY);
+
+    if (fd < 0) {
+        return JSON_FILE_ERROR;
+    }
+    if (0 != fstat(fd, &st) || !S_ISREG(st.st_mode) || 0 == st.st_size || (uint64_t)st.st_size > SIZE_MAX) {
+        close(fd);
+        return JSON_FILE_UNMAPPED;
+    }
+    map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (MAP_FAILED == map) {
+        return JSON_FILE_UNMAPPED;
+    }
+    posix_madvise(map, (size_t)st.st_size, POSIX_MADV_SEQUENTIAL);
+
+    *data = (const char *)map;
+    *len = (size_t)st.st_size;
+    return JSON_FILE_MAPPED;
+#else
+    (void)path;
+    (void)data;
+    (void)len;
+    return JSON_FILE_UNMAPPED;
+#endif
+}
+
+static void json_file_unmap(const char *data, size_t len) {
+#ifdef JSON_POSIX
+    munmap((void *)data, len);
+#else
+    (void)data;
+    (void)len;
+#endif
+}
+
+int json_parse_file(json_value *value, const char *path) {
+    const char *data;
+    size_t len;
+    char *chunk;
+    json_stream *stream;
+    FILE *file;
+    int ret = JSON_PARSE_OK;
+
+    assert(NULL != value && NULL != path);
+    json_value_init(value);
+
+    switch (json_file_map(path, &data, &len)) {
+        case JSON_FILE_MAPPED:
+            ret = json_parse_n(value, data, len);
+            json_file_unmap(data, len);
+            return ret;
+        case JSON_FILE_ERROR:
+            return JSON_PARSE_IO_ERROR;
+        default:
+            break;
+    }
+
+    if (NULL == (file = fopen(path, "rb"))) {
+        return JSON_PARSE_IO_ERROR;
+    }
+    stream = json_stream_create();
+    chunk = (char *)JSON_MALLOC(JSON_FILE_CHUNK_SIZE);
+    while (JSON_PARSE_OK == ret && 0 != (len = fread(chunk, 1, JSON_FILE_CHUNK_SIZE, file))) {
+        ret = json_stream_feed(stream, chunk, len);
+    }
+    /* a failed read cuts the text short, which must not pass for a syntax error */
+    if (ferror(file)) {
+        ret = JSON_PARSE_IO_ERROR;
+    } else if (JSON_PARSE_OK == ret) {
+        ret = json_stream_finish(stream, value);
+    }
+    JSON_FREE(chunk);
+    json_stream_free(stream);
+    fclose(file);
+    return ret;
+}
+
+int json_parse_file_sax(const char *path, const json_sax_handler *handler, void *user) {
+    const char *data;
+    char *chunk;
+    size_t len;
+    json_stream *stream;
+    json_value value;
+    FILE *file;
+    int ret = JSON_PARSE_OK;
+
+    assert(NULL != path && NULL != handler);
+
+    switch (json_file_map(path, &data, &len)) {
+        case JSON_FILE_MAPPED:
+            ret = json_parse_sax(data, len, handler, user);
+            json_file_unmap(data, len);
+            return ret;
+        case JSON_FILE_ERROR:
+            return JSON_PARSE_IO_ERROR;
+        default:
+            break;
+    }
+
+    if (NULL == (file = fopen(path, "rb"))) {
+        return JSON_PARSE_IO_ERROR;
+    }
+    stream = json_stream_create_sax(handler, user);
+    chunk = (char *)JSON_MALLOC(JSON_FILE_CHUNK_SIZE);
+    while (JSON_PARSE_OK == ret && 0 != (len = fread(chunk, 1, JSON_FILE_CHUNK_SIZE, file))) {
+        ret = json_stream_feed(stream, chunk, len);
+    }
+    if (ferror(file)) {
+        ret = JSON_PARSE_IO_ERROR;
+    } else if (JSON_PARSE_OK == ret) {
+        ret = json_stream_finish(stream, &value);
+    }
+    JSON_FREE(chunk);
+    json_stream_free(stream);
+    fclose(file);
+    return ret;
+}
+
+/*
+ * Parallel documents. A quote-aware pass cuts a top-level array into its
+ * elements, the element slots are allocated up front, and workers parse
+ * elements straight into them, each with its own stack and arena. The
+ * worker arenas then belong to the document. Whatever the split cannot
+ * handle, every syntax error included, is parsed again sequentially, so
+ * results and error codes are those of json_parse_into_ex.
+ */
+#ifndef JSON_PARALLEL_MIN_SIZE
+#define JSON_PARALLEL_MIN_SIZE (1024 * 1024)
+#endif
+
+#ifdef JSON_THREADS
+/*
+ * Records the opening '[' at p, each top-level ',' and the closing ']'.
+ * Returns 0 when the brackets do not balance before end.
+ */
+static int json_index_array(const char *p, const char *end, const char ***bounds, size_t *count) {
+    size_t depth = 0, capacity = 0;
+
+    *bounds = NULL;
+    *count = 0;
+    for (; p < end; p++) {
+        switch (*p) {
+            case '\"':
+                for (p++;;) {
+                    p = json_scan.scan_string(p, end);
+                    if (p >= end) {
+                        return 0;
+                    }
+                    if ('\"' == *p) {
+                        break;
+                    }
+                    /* a control character is left for the parser to reject */
+                    if ('\\' == *p++ && p < end) {
+                        p++;
+                    }
+                }
+                continue;
+            case '[':
+            case '{':
+                if (depth++ > 0) {
+                    continue;
+                }
+                break;
+            case ']':
+            case '}':
+                if (0 == depth) {
+                    return 0;
+                }
+                if (--depth > 0) {
+                    continue;
+                }
+                if (']' != *p) {
+                    return 0;
+                }
+                break;
+            case ',':
+                if (1 != depth) {
+                    continue;
+                }
+                break;
+            default:
+                continue;
+        }
+
+        if (*count == capacity) {
+            capacity = capacity ? capacity * 2 : 1024;
+            *bounds = (const char **)JSON_REALLOC((void *)*bounds, capacity * sizeof(const char *));
+        }
+        (*bounds)[(*count)++] = p;
+        if (0 == depth) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+typedef struct {
+    const char **bounds; /* element i lies between bounds[i] and bounds[i + 1] */
+    json_value *slots;
+    size_t count, next, batch;
+    const json_parse_options *options;
+    int failed;
+    pthread_mutex_t lock;
+} json_parallel_pool;
+
+typedef struct {
+    json_parallel_pool *pool;
+    json_arena *arena;
+} json_parallel_worker;
+
+static void* json_parallel_work(void *arg) {
+    json_parallel_worker *worker = (json_parallel_worker *)arg;
+    json_parallel_pool *pool = worker->pool;
+    json_context context;
+    size_t i, n;
+    int ok = 1;
+
+    json_context_init(&context, NULL, 0, worker->arena, pool->options);
+    while (ok) {
+        pthread_mutex_lock(&pool->lock);
+        i = pool->next;
+        n = pool->failed || i >= pool->count ? 0 : pool->count - i < pool->batch ? pool->count - i : pool->batch;
+        pool->next += n;
+        pthread_mutex_unlock(&pool->lock);
+        if (0 == n) {
+            break;
+        }
+
+        for (; n > 0 && ok; n--, i++) {
+            context.json = pool->bounds[i] + 1;
+            context.end = pool->bounds[i + 1];
+            json_value_init(&pool->slots[i]);
+            json_parse_whitespace(&context);
+            ok = JSON_PARSE_OK == json_parse_child(&context, &pool->slots[i]);
+            json_parse_whitespace(&context);
+            ok = ok && context.json == context.end;
+        }
+        if (!ok) {
+            pthread_mutex_lock(&pool->lock);
+            pool->failed = 1;
+            pthread_mutex_unlock(&pool->lock);
+        }
+    }
+
+    JSON_FREE(context.stack);
+    return NULL;
+}
+
+/* returns 0 when the text has to be parsed sequentially */
+static int json_parse_array_parallel(json_document *doc, const char *json, size_t len, int threads,
+                                     const json_parse_options *options) {
+    const char *p = json_scan.skip_whitespace(json, json + len);
+    json_parallel_pool pool;
+    json_parallel_worker *workers;
+    pthread_t *tids;
+    size_t bound_count;
+    int i, started = 0;
+
+    /* json_index_array sets it, but is not reached for anything but an array */
+    pool.bounds = NULL;
+    if (p == json + len || '[' != *p || !json_index_array(p, json + len, &pool.bounds, &bound_count) ||
+        bound_count - 1 > UINT32_MAX) {
+        JSON_FREE((void *)pool.bounds);
+        return 0;
+    }
+
+    json_document_release(doc);
+    pool.count = bound_count - 1;
+    pool.slots = (json_value *)json_arena_alloc(&doc->arena, pool.count * sizeof(json_value));
+    pool.next = 0;
+    pool.batch = pool.count / ((size_t)threads * 16) + 1;
+    pool.options = options;
+    pool.failed = 0;
+    pthread_mutex_init(&pool.lock, NULL);
+
+    doc->workers = (json_arena *)JSON_MALLOC(threads * sizeof(json_arena));
+    doc->worker_count = threads;
+    workers = (json_parallel_worker *)JSON_MALLOC(threads * sizeof(json_parallel_worker));
+    tids = (pthread_t *)JSON_MALLOC(threads * sizeof(pthread_t));
+    for (i = 0; i < threads; i++) {
+        doc->workers[i].head = NULL;
+        doc->workers[i].next_size = len / threads;
+        workers[i].pool = &pool;
+        workers[i].arena = &doc->workers[i];
+    }
+
+    /* the calling thread works as worker 0 */
+    for (i = 1; i < threads; i++) {
+        if (0 == pthread_create(&tids[started], NULL, json_parallel_work, &workers[i])) {
+            started++;
+        }
+    }
+    json_parallel_work(&workers[0]);
+    for (i = 0; i < started; i++) {
+        pthread_join(tids[i], NULL);
+    }
+
+    pthread_mutex_destroy(&pool.lock);
+    JSON_FREE(tids);
+    JSON_FREE(workers);
+    JSON_FREE((void *)pool.bounds);
+
+    if (pool.failed) {
+        json_document_release(doc);
+        return 0;
+    }
+    doc->root.type = JSON_ARRAY;
+    doc->root.size = (uint32_t)pool.count;
+    doc->root.u.elements = pool.slots;
+    return 1;
+}
+#endif
+
+int json_parse_into_parallel(json_document *doc, const char *json, size_t len, int threads,
+                             const json_parse_options *options) {
+    assert(NULL != doc && (NULL != json || 0 == len));
+
+#ifdef JSON_THREADS
+    if (threads <= 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = cpus > 0 ? (int)cpus : 1;
+    }
+    if (threads > 1 && len >= JSON_PARALLEL_MIN_SIZE && !(options && (options->flags & JSON_PARSE_INTERN_KEYS)) &&
+        json_parse_array_parallel(doc, json, len, threads, options)) {
+        return JSON_PARSE_OK;
+    }
+#else
+    (void)threads;
+#endif
+    return json_parse_into_ex(doc, json, len, options);
+}
+
+/*
+ * Tape parsing, in two stages. Stage one classifies the text 64 bytes at a
+ * time with the vector scanners and turns the masks into the positions of
+ * the structural characters: {}[]:, outside strings, opening quotes and the
+ * first byte of every literal or number. It runs one window ahead of stage
+ * two, which walks those positions with the token routines of
+ * json_parse_value and appends each value to a flat tape of 64-bit words:
+ *
+ *   [ / {       tag | index past the matching close, then the count
+ *   ] / }       tag | index of the opening word
+ *   "           tag | offset of the bytes in the text, then the length
+ *   c           same, for unescaped copies in tape->strings
+ *   l / u / d   tag, then the int64, uint64 or double bits
+ *   n / t / f   tag
+ *
+ * Word 0 is the root word, the value starts at 1. The json_tape_* accessors
+ * read values straight off the tape; no tree is ever built.
+ */
+#ifndef JSON_TAPE_WINDOW_SIZE
+#define JSON_TAPE_WINDOW_SIZE (64 * 1024) /* a multiple of 64 */
+#endif
+
+#ifndef JSON_TAPE_INIT_SIZE
+#define JSON_TAPE_INIT_SIZE 256
+#endif
+
+#define JSON_TAPE_PAYLOAD_MASK ((UINT64_C(1) << 56) - 1)
+#define JSON_TAPE_WORD(tag, payload) ((uint64_t)(tag) << 56 | (uint64_t)(payload))
+#define JSON_TAPE_TAG(word) ((int)((word) >> 56))
+#define JSON_TAPE_PAYLOAD(word) ((word) & JSON_TAPE_PAYLOAD_MASK)
+
+enum {
+    JSON_TAPE_ROOT = 'r',
+    JSON_TAPE_NULL = 'n',
+    JSON_TAPE_TRUE = 't',
+    JSON_TAPE_FALSE = 'f',
+    JSON_TAPE_INT64 = 'l',
+    JSON_TAPE_UINT64 = 'u',
+    JSON_TAPE_DOUBLE = 'd',
+    JSON_TAPE_STRING = '\"',
+    JSON_TAPE_STRING_COPY = 'c',
+    JSON_TAPE_ARRAY = '[',
+    JSON_TAPE_ARRAY_END = ']',
+    JSON_TAPE_OBJECT = '{',
+    JSON_TAPE_OBJECT_END = '}'
+};
+
+struct json_tape {
+    uint64_t *words; size_t size, capacity;
+    char *strings; size_t strings_size, strings_capacity; /* strings that had escapes, unescaped */
+    const char *json; /* text of the last parse, escape-free strings are read from it */
+    json_context context; /* scratch stack for unescaping */
+    uint32_t *structurals; /* stage one output for one window */
+};
+
+/* stage one state, carried from block to block and window to window */
+typedef struct {
+    const char *window, *next_window, *end;
+    uint32_t *positions; /* structural offsets from window */
+    size_t count, next;
+    const char *at; /* position of the character json_tape_peek returned */
+    const char *pending; /* junk right after a literal or number, reported as the next token */
+    json_block_carry strings;
+    uint64_t prev_scalar;
+} json_tape_index;
+
+/* stage one over the next window of the text */
+static void json_tape_index_window(json_tape_index *index) {
+    const char *p = index->next_window, *stop = index->end;
+    size_t count = 0;
+
+    if (stop - p > JSON_TAPE_WINDOW_SIZE) {
+        stop = p + JSON_TAPE_WINDOW_SIZE;
+    }
+    index->window = p;
+
+    for (; p < stop; p += 64) {
+        json_block_masks masks;
+        uint64_t in_string, scalar, structural;
+        uint32_t offset = (uint32_t)(p - index->window);
+
+        json_classify_block(p, stop, &masks);
+        in_string = json_block_strings(&masks, &index->strings);
+
+        scalar = ~(masks.op | masks.whitespace | masks.quote | in_string);
+        structural = (masks.op & ~in_string) | (masks.quote & in_string) |
+                     (scalar & ~(scalar << 1 | index->prev_scalar));
+        index->prev_scalar = scalar >> 63;
+
+        while (0 != structural) {
+            index->positions[count++] = offset + json_ctz64(structural);
+            structural &= structural - 1;
+        }
+    }
+
+    index->next_window = stop;
+    index->count = count;
+    index->next = 0;
+}
+
+/* the next structural character, '\0' past the end of the text; index->at is where it is */
+static char json_tape_peek(json_tape_index *index) {
+    if (NULL != index->pending) {
+        index->at = index->pending;
+        return *index->at;
+    }
+    while (index->next == index->count) {
+        if (index->next_window == index->end) {
+            index->at = index->end;
+            return '\0';
+        }
+        json_tape_index_window(index);
+    }
+    index->at = index->window + index->positions[index->next];
+    return *index->at;
+}
+
+static void json_tape_advance(json_tape_index *index) {
+    if (NULL != index->pending) {
+        index->pending = NULL;
+    } else {
+        index->next++;
+    }
+}
+
+/*
+ * A literal or number is a run of stage one that the token routine may stop
+ * short of, as in "1x": the rest of the run stands in for the next token so
+ * the caller fails on it like json_parse_value's callers do.
+ */
+static void json_tape_scalar_end(json_tape_index *index, const char *p) {
+    json_tape_advance(index);
+    json_tape_peek(index);
+    if (p != index->at) {
+        p = json_scan.skip_whitespace(p, index->at);
+        if (p != index->at) {
+            index->pending = p;
+        }
+    }
+}
+
+static uint64_t* json_tape_push(json_tape *tape, size_t n) {
+    uint64_t *ret;
+
+    if (tape->size + n > tape->capacity) {
+        if (0 == tape->capacity) {
+            tape->capacity = JSON_TAPE_INIT_SIZE;
+        }
+        while (tape->size + n > tape->capacity) {
+            tape->capacity += tape->capacity >> 1;
+        }
+        tape->words = (uint64_t *)JSON_REALLOC(tape->words, tape->capacity * sizeof(uint64_t));
+    }
+
+    ret = tape->words + tape->size;
+    tape->size += n;
+    return ret;
+}
+
+/* the string or key at tape->context.json */
+static int json_tape_string(json_tape *tape, json_tape_index *index) {
+    const char *str;
+    size_t len;
+    int borrowed, ret;
+    uint64_t *word;
+
+    if ((ret = json_parse_string_raw(&tape->context, &str, &len, &borrowed)) != JSON_PARSE_OK) {
+        return ret;
+    }
+
+    word = json_tape_push(tape, 2);
+    if (borrowed) {
+        word[0] = JSON_TAPE_WORD(JSON_TAPE_STRING, str - tape->json);
+    } else {
+        if (tape->strings_size + len > tape->strings_capacity) {
+            tape->strings_capacity = tape->strings_capacity * 2 + len;
+            tape->strings = (char *)JSON_REALLOC(tape->strings, tape->strings_capacity);
+        }
+        memcpy(tape->strings + tape->strings_size, str, len);
+        word[0] = JSON_TAPE_WORD(JSON_TAPE_STRING_COPY, tape->strings_size);
+        tape->strings_size += len;
+    }
+    word[1] = len;
+
+    json_tape_advance(index);
+    return JSON_PARSE_OK;
+}
+
+static void json_tape_close(json_tape *tape, size_t open, int tag, size_t size) {
+    *json_tape_push(tape, 1) = JSON_TAPE_WORD(tag, open);
+    tape->words[open] |= tape->size;
+    tape->words[open + 1] = size;
+}
+
+static int json_tape_value(json_tape *tape, json_tape_index *index);
+
+static int json_tape_array(json_tape *tape, json_tape_index *index) {
+    size_t open = tape->size, size = 0;
+    int ret;
+    char ch;
+
+    json_tape_push(tape, 2)[0] = JSON_TAPE_WORD(JSON_TAPE_ARRAY, 0);
+    json_tape_advance(index);
+
+    if (']' != json_tape_peek(index)) {
+        for (;;) {
+            if ((ret = json_tape_value(tape, index)) != JSON_PARSE_OK) {
+                return ret;
+            }
+            size++;
+
+            ch = json_tape_peek(index);
+            if (',' == ch) {
+                json_tape_advance(index);
+            } else if (']' == ch) {
+                break;
+            } else {
+                return JSON_PARSE_MISS_COMMA_OR_SQUARE_BRACKET;
+            }
+        }
+    }
+
+    json_tape_advance(index);
+    json_tape_close(tape, open, JSON_TAPE_ARRAY_END, size);
+    return JSON_PARSE_OK;
+}
+
+static int json_tape_object(json_tape *tape, json_tape_index *index) {
+    size_t open = tape->size, size = 0;
+    int ret;
+    char ch;
+
+    json_tape_push(tape, 2)[0] = JSON_TAPE_WORD(JSON_TAPE_OBJECT, 0);
+    json_tape_advance(index);
+
+    if ('}' != (ch = json_tape_peek(index))) {
+        for (;;) {
+            if ('\"' != ch) {
+                return JSON_PARSE_MISS_KEY;
+            }
+            tape->context.json = index->at;
+            if ((ret = json_tape_string(tape, index)) != JSON_PARSE_OK) {
+                return ret;
+            }
+
+            if (':' != json_tape_peek(index)) {
+                return JSON_PARSE_MISS_COLON;
+            }
+            json_tape_advance(index);
+
+            if ((ret = json_tape_value(tape, index)) != JSON_PARSE_OK) {
+                return ret;
+            }
+            size++;
+
+            ch = json_tape_peek(index);
+            if (',' == ch) {
+                json_tape_advance(index);
+                ch = json_tape_peek(index);
+            } else if ('}' == ch) {
+                break;
+            } else {
+                return JSON_PARSE_MISS_COMMA_OR_CURLY_BRACKET;
+            }
+        }
+    }
+
+    json_tape_advance(index);
+    json_tape_close(tape, open, JSON_TAPE_OBJECT_END, size);
+    return JSON_PARSE_OK;
+}
+
+static int json_tape_value(json_tape *tape, json_tape_index *index) {
+    json_context *context = &tape->context;
+    json_value scalar;
+    uint64_t *word;
+    int ret;
+    char ch = json_tape_peek(index);
+
+    if (index->at == index->end) {
+        return JSON_PARSE_EXPECT_VALUE;
+    }
+
+    context->json = index->at;
+    switch (ch) {
+        case '[': return json_tape_array(tape, index);
+        case '{': return json_tape_object(tape, index);
+        case '\"': return json_tape_string(tape, index);
+        case 'n': ret = json_parse_literal(context, &scalar, "null", JSON_NULL); break;
+        case 't': ret = json_parse_literal(context, &scalar, "true", JSON_TRUE); break;
+        case 'f': ret = json_parse_literal(context, &scalar, "false", JSON_FALSE); break;
+        default: ret = json_parse_number(context, &scalar); break;
+    }
+    if (JSON_PARSE_OK != ret) {
+        return ret;
+    }
+
+    switch (scalar.type) {
+        case JSON_NULL: *json_tape_push(tape, 1) = JSON_TAPE_WORD(JSON_TAPE_NULL, 0); break;
+        case JSON_TRUE: *json_tape_push(tape, 1) = JSON_TAPE_WORD(JSON_TAPE_TRUE, 0); break;
+        case JSON_FALSE: *json_tape_push(tape, 1) = JSON_TAPE_WORD(JSON_TAPE_FALSE, 0); break;
+        default:
+            word = json_tape_push(tape, 2);
+            if (scalar.flags & JSON_FLAG_INT64) {
+                word[0] = JSON_TAPE_WORD(JSON_TAPE_INT64, 0);
+                word[1] = (uint64_t)scalar.u.i64;
+            } else if (scalar.flags & JSON_FLAG_UINT64) {
+                word[0] = JSON_TAPE_WORD(JSON_TAPE_UINT64, 0);
+                word[1] = scalar.u.u64;
+            } else {
+                word[0] = JSON_TAPE_WORD(JSON_TAPE_DOUBLE, 0);
+                memcpy(&word[1], &scalar.u.number, sizeof(double));
+            }
+    }
+
+    json_tape_scalar_end(index, context->json);
+    return JSON_PARSE_OK;
+}
+
+json_tape* json_tape_create(void) {
+    json_tape *tape = (json_tape *)JSON_MALLOC(sizeof(json_tape));
+
+    tape->words = NULL;
+    tape->size = tape->capacity = 0;
+    tape->strings = NULL;
+    tape->strings_size = tape->strings_capacity = 0;
+    tape->json = NULL;
+    json_context_init(&tape->context, NULL, 0, NULL, NULL);
+    tape->structurals = (uint32_t *)JSON_MALLOC(JSON_TAPE_WINDOW_SIZE * sizeof(uint32_t));
+    /* a fresh tape reads as null, like a failed parse */
+    *json_tape_push(tape, 1) = JSON_TAPE_WORD(JSON_TAPE_ROOT, 2);
+    *json_tape_push(tape, 1) = JSON_TAPE_WORD(JSON_TAPE_NULL, 0);
+
+    return tape;
+}
+
+void json_tape_free(json_tape *tape) {
+    if (NULL != tape) {
+        JSON_FREE(tape->words);
+        JSON_FREE(tape->strings);
+        JSON_FREE(tape->context.stack);
+        JSON_FREE(tape->structurals);
+        JSON_FREE(tape);
+    }
+}
+
+int json_parse_tape(json_tape *tape, const char *json, size_t len) {
+    json_tape_index index;
+    int ret;
+    assert(NULL != tape && (NULL != json || 0 == len));
+
+    tape->size = tape->strings_size = 0;
+    tape->json = json;
+    tape->context.end = json + len;
+
+    index.next_window = json;
+    index.end = json + len;
+    index.positions = tape->structurals;
+    index.count = index.next = 0;
+    index.pending = NULL;
+    index.strings.prev_escaped = index.strings.prev_in_string = index.prev_scalar = 0;
+
+    json_tape_push(tape, 1);
+    if ((ret = json_tape_value(tape, &index)) != JSON_PARSE_OK) {
+        tape->size = 1;
+        tape->strings_size = 0;
+        *json_tape_push(tape, 1) = JSON_TAPE_WORD(JSON_TAPE_NULL, 0);
+    }
+    tape->words[0] = JSON_TAPE_WORD(JSON_TAPE_ROOT, tape->size);
+
+    assert(0 == tape->context.top);
+    return ret;
+}
+
+json_tape_ref json_tape_root(const json_tape *tape) {
+    (void)tape;
+    return 1;
+}
+
+json_type json_tape_get_type(const json_tape *tape, json_tape_ref ref) {
+    assert(NULL != tape && 0 < ref && ref < tape->size);
+    switch (JSON_TAPE_TAG(tape->words[ref])) {
+        case JSON_TAPE_TRUE: return JSON_TRUE;
+        case JSON_TAPE_FALSE: return JSON_FALSE;
+        case JSON_TAPE_INT64: case JSON_TAPE_UINT64: case JSON_TAPE_DOUBLE: return JSON_NUMBER;
+        case JSON_TAPE_STRING: case JSON_TAPE_STRING_COPY: return JSON_STRING;
+        case JSON_TAPE_ARRAY: return JSON_ARRAY;
+        case JSON_TAPE_OBJECT: return JSON_OBJECT;
+        default: return JSON_NULL;
+    }
+}
+
+int json_tape_get_boolean(const json_tape *tape, json_tape_ref ref) {
+    assert(JSON_TRUE == json_tape_get_type(tape, ref) || JSON_FALSE == json_tape_get_type(tape, ref));
+    return JSON_TAPE_TRUE == JSON_TAPE_TAG(tape->words[ref]);
+}
+
+void json_tape_get_number(const json_tape *tape, json_tape_ref ref, json_value *number) {
+    const uint64_t *word = tape->words + ref;
+    assert(JSON_NUMBER == json_tape_get_type(tape, ref) && NULL != number);
+
+    number->type = JSON_NUMBER;
+    switch (JSON_TAPE_TAG(word[0])) {
+        case JSON_TAPE_INT64:
+            number->u.i64 = (int64_t)word[1];
+            number->flags = JSON_FLAG_INT64;
+            break;
+        case JSON_TAPE_UINT64:
+            number->u.u64 = word[1];
+            number->flags = JSON_FLAG_UINT64;
+            break;
+        default:
+            memcpy(&number->u.number, &word[1], sizeof(double));
+            number->flags = 0;
+    }
+}
+
+const char* json_tape_get_string(const json_tape *tape, json_tape_ref ref, size_t *len) {
+    const uint64_t *word = tape->words + ref;
+    assert(JSON_STRING == json_tape_get_type(tape, ref) && NULL != len);
+
+    *len = (size_t)word[1];
+    if (JSON_TAPE_STRING == JSON_TAPE_TAG(word[0])) {
+        return tape->json + JSON_TAPE_PAYLOAD(word[0]);
+    }
+    return tape->strings + JSON_TAPE_PAYLOAD(word[0]);
+}
+
+size_t json_tape_get_size(const json_tape *tape, json_tape_ref ref) {
+    assert(JSON_ARRAY == json_tape_get_type(tape, ref) || JSON_OBJECT == json_tape_get_type(tape, ref));
+    return (size_t)tape->words[ref + 1];
+}
+
+/* the word after ref, 0 when that closes the enclosing container or ends the tape */
+static json_tape_ref json_tape_sibling(const json_tape *tape, json_tape_ref ref) {
+    int tag;
+
+    if (ref >= tape->size) {
+        return 0;
+    }
+    tag = JSON_TAPE_TAG(tape->words[ref]);
+    return JSON_TAPE_ARRAY_END == tag || JSON_TAPE_OBJECT_END == tag ? 0 : ref;
+}
+
+json_tape_ref json_tape_first(const json_tape *tape, json_tape_ref ref) {
+    assert(JSON_ARRAY == json_tape_get_type(tape, ref) || JSON_OBJECT == json_tape_get_type(tape, ref));
+    return json_tape_sibling(tape, ref + 2);
+}
+
+json_tape_ref json_tape_next(const json_tape *tape, json_tape_ref ref) {
+    uint64_t word;
+    assert(NULL != tape && 0 < ref && ref < tape->size);
+
+    word = tape->words[ref];
+    switch (JSON_TAPE_TAG(word)) {
+        case JSON_TAPE_NULL: case JSON_TAPE_TRUE: case JSON_TAPE_FALSE:
+            return json_tape_sibling(tape, ref + 1);
+        case JSON_TAPE_ARRAY: case JSON_TAPE_OBJECT:
+            return json_tape_sibling(tape, (json_tape_ref)JSON_TAPE_PAYLOAD(word));
+        default:
+            return json_tape_sibling(tape, ref + 2);
+    }
+}
+
+json_tape_ref json_tape_get_array_element(const json_tape *tape, json_tape_ref ref, size_t index) {
+    json_tape_ref element;
+    assert(JSON_ARRAY == json_tape_get_type(tape, ref) && index < json_tape_get_size(tape, ref));
+
+    for (element = json_tape_first(tape, ref); 0 != index; index--) {
+        element = json_tape_next(tape, element);
+    }
+    return element;
+}
+
+json_tape_ref json_tape_find_object_value(const json_tape *tape, json_tape_ref ref, const char *key, size_t len) {
+    json_tape_ref member;
+    assert(JSON_OBJECT == json_tape_get_type(tape, ref) && (NULL != key || 0 == len));
+
+    for (member = json_tape_first(tape, ref); 0 != member; member = json_tape_next(tape, member + 2)) {
+        size_t member_len;
+        const char *member_key = json_tape_get_string(tape, member, &member_len);
+        if (member_len == len && (0 == len || 0 == memcmp(member_key, key, len))) {
+            return member + 2;
+        }
+    }
+    return 0;
+}
+
+#define PUTS(context, str, length) \
+    do {\
+        memcpy(json_context_push(context, length), str, length);\
+    } while(0)
+
+
+static const char json_digit_pairs[] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+    "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+/* writes n in decimal at buffer (up to 20 bytes) and returns the end */
+static char* json_format_uint64(char *buffer, uint64_t n) {
+    char digits[20], *p = digits + sizeof(digits);
+    size_t len;
+
+    while (n >= 100) {
+        const char *pair = json_digit_pairs + (n % 100) * 2;
+        n /= 100;
+        *--p = pair[1];
+        *--p = pair[0];
+    }
+    if (n >= 10) {
+        *--p = json_digit_pairs[n * 2 + 1];
+        *--p = json_digit_pairs[n * 2];
+    } else {
+        *--p = (char)('0' + n);
+    }
+
+    len = digits + sizeof(digits) - p;
+    memcpy(buffer, p, len);
+    return buffer + len;
+}
+
+static char* json_format_int64(char *buffer, int64_t n) {
+    if (n < 0) {
+        *buffer++ = '-';
+        return json_format_uint64(buffer, 0 - (uint64_t)n);
+    }
+    return json_format_uint64(buffer, (uint64_t)n);
+}
+
+/*
+ * Shortest round-trip formatting of doubles (Ryu, Ulf Adams 2018): finds the
+ * fewest decimal digits that still parse back to the same bits, closest to
+ * the exact value when several qualify. Whole values below 2^53 take the
+ * integer formatter instead.
+ */
+#define JSON_DOUBLE_EXPONENT_BIAS 1023
+#define JSON_NUMBER_MAX_LENGTH 25 /* "-0.00000" and 17 digits, or "-d.dddddddddddddddde-308" */
+
+/* ceil(log2(5^e)) for e > 0, 1 for e == 0 */
+static int json_pow5_bits(int e) {
+    return (int)((((uint32_t)e * 1217359) >> 19) + 1);
+}
+
+/* floor(log10(2^e)) */
+static int json_log10_pow2(int e) {
+    return (int)(((uint32_t)e * 78913) >> 18);
+}
+
+/* floor(log10(5^e)) */
+static int json_log10_pow5(int e) {
+    return (int)(((uint32_t)e * 732923) >> 20);
+}
+
+static int json_multiple_of_pow5(uint64_t value, int p) {
+    int count = 0;
+    while (value % 5 == 0) {
+        value /= 5;
+        count++;
+    }
+    return count >= p;
+}
+
+/* (m * mul) >> j for a 125-bit table entry, 64 < j < 128 */
+static uint64_t json_mul_shift64(uint64_t m, const uint64_t *mul, int j) {
+    uint64_t high0, low0, high1, low1, sum_low, sum_high;
+    json_mul_64x64(m, mul[0], &high0, &low0);
+    json_mul_64x64(m, mul[1], &high1, &low1);
+    sum_low = low1 + high0;
+    sum_high = high1 + (sum_low < high0);
+    j -= 64;
+    return (sum_high << (64 - j)) | (sum_low >> j);
+}
+
+static void json_ryu(uint64_t ieee_mantissa, unsigned ieee_exponent, uint64_t *digits, int *exponent) {
+    uint64_t m2, mv, vr, vp, vm, output;
+    int e2, e10, q, removed = 0, last_removed = 0, vm_zeros = 0, vr_zeros = 0, accept_bounds;
+    unsigned mm_shift;
+
+    if (ieee_exponent == 0) {
+        e2 = 1 - JSON_DOUBLE_EXPONENT_BIAS - JSON_DOUBLE_MANTISSA_BITS - 2;
+        m2 = ieee_mantissa;
+    } else {
+        e2 = (int)ieee_exponent - JSON_DOUBLE_EXPONENT_BIAS - JSON_DOUBLE_MANTISSA_BITS - 2;
+        m2 = (UINT64_C(1) << JSON_DOUBLE_MANTISSA_BITS) | ieee_mantissa;
+    }
+    accept_bounds = (m2 & 1) == 0;
+
+    /* the halfway points to the neighbours are mv + 2 and mv - 1 - mm_shift, all scaled by 4 */
+    mv = 4 * m2;
+    mm_shift = ieee_mantissa != 0 || ieee_exponent <= 1;
+
+    if (e2 >= 0) {
+        const uint64_t *mul;
+        int k, i;
+        q = json_log10_pow2(e2) - (e2 > 3);
+        e10 = q;
+        k = JSON_POW5_INV_BITCOUNT + json_pow5_bits(q) - 1;
+        i = -e2 + q + k;
+        mul = json_pow5_inv_split[q];
+        vr = json_mul_shift64(mv, mul, i);
+        vp = json_mul_shift64(mv + 2, mul, i);
+        vm = json_mul_shift64(mv - 1 - mm_shift, mul, i);
+        if (q <= 21) {
+            /* only one of mp, mv and mm can be a multiple of 5, if any */
+            if (mv % 5 == 0) {
+                vr_zeros = json_multiple_of_pow5(mv, q);
+            } else if (accept_bounds) {
+                vm_zeros = json_multiple_of_pow5(mv - 1 - mm_shift, q);
+            } else {
+                vp -= json_multiple_of_pow5(mv + 2, q);
+            }
+        }
+    } else {
+        const uint64_t *mul;
+        int k, i, j;
+        q = json_log10_pow5(-e2) - (-e2 > 1);
+        e10 = q + e2;
+        i = -e2 - q;
+        k = json_pow5_bits(i) - JSON_POW5_BITCOUNT;
+        j = q - k;
+        mul = json_pow5_split[i];
+        vr = json_mul_shift64(mv, mul, j);
+        vp = json_mul_shift64(mv + 2, mul, j);
+        vm = json_mul_shift64(mv - 1 - mm_shift, mul, j);
+        if (q <= 1) {
+            /* mv = 4 * m2 always has two trailing zero bits, mm has one iff mm_shift */
+            vr_zeros = 1;
+            if (accept_bounds) {
+                vm_zeros = mm_shift == 1;
+            } else {
+                vp--;
+            }
+        } else if (q < 63) {
+            vr_zeros = (mv & ((UINT64_C(1) << q) - 1)) == 0;
+        }
+    }
+
+    if (vm_zeros || vr_zeros) {
+        /* rare: the interval ends exactly on decimal values, track the removed digits */
+        while (vp / 10 > vm / 10) {
+            vm_zeros &= vm % 10 == 0;
+            vr_zeros &= last_removed == 0;
+            last_removed = (int)(vr % 10);
+            vr /= 10;
+            vp /= 10;
+            vm /= 10;
+            removed++;
+        }
+        if (vm_zeros) {
+            while (vm % 10 == 0) {
+                vr_zeros &= last_removed == 0;
+                last_removed = (int)(vr % 10);
+                vr /= 10;
+                vp /= 10;
+                vm /= 10;
+                removed++;
+            }
+        }
+        if (vr_zeros && last_removed == 5 && vr % 2 == 0) {
+            last_removed = 4; /* exactly halfway, round to even */
+        }
+        output = vr + ((vr == vm && (!accept_bounds || !vm_zeros)) || last_removed >= 5);
+    } else {
+        int round_up = 0;
+        if (vp / 100 > vm / 100) {
+            round_up = vr % 100 >= 50;
+            vr /= 100;
+            vp /= 100;
+            vm /= 100;
+            removed += 2;
+        }
+        while (vp / 10 > vm / 10) {
+            round_up = vr % 10 >= 5;
+            vr /= 10;
+            vp /= 10;
+            vm /= 10;
+            removed++;
+        }
+        output = vr + (vr == vm || round_up);
+    }
+
+    /* rounding up can carry into a trailing zero */
+    while (output % 10 == 0) {
+        output /= 10;
+        removed++;
+    }
+    *digits = output;
+    *exponent = e10 + removed;
+}
+
+/* writes digits * 10^exponent in whichever of plain or exponent notation is shorter */
+static char* json_format_decimal(char *buffer, uint64_t digits, int exponent) {
+    char text[20];
+    int n = (int)(json_format_uint64(text, digits) - text), point = n + exponent, scientific, plain;
+
+    if (exponent >= 0) {
+        plain = point;
+    } else if (point > 0) {
+        plain = n + 1;
+    } else {
+        plain = n + 2 - point;
+    }
+    scientific = n + (n > 1) + 1 + (point - 1 < 0) +
+                 (abs(point - 1) >= 100 ? 3 : abs(point - 1) >= 10 ? 2 : 1);
+
+    if (plain <= scientific) {
+        if (exponent >= 0) {
+            memcpy(buffer, text, n);
+            memset(buffer + n, '0', exponent);
+        } else if (point > 0) {
+            memcpy(buffer, text, point);
+            buffer[point] = '.';
+            memcpy(buffer + point + 1, text + point, n - point);
+        } else {
+            buffer[0] = '0';
+            buffer[1] = '.';
+            memset(buffer + 2, '0', -point);
+            memcpy(buffer + 2 - point, text, n);
+        }
+        return buffer + plain;
+    }
+
+    *buffer++ = text[0];
+    if (n > 1) {
+        *buffer++ = '.';
+        memcpy(buffer, text + 1, n - 1);
+        buffer += n - 1;
+    }
+    *buffer++ = 'e';
+    return json_format_int64(buffer, point - 1);
+}
+
+/* writes a double (at most JSON_NUMBER_MAX_LENGTH bytes) and returns the end */
+static char* json_format_double(char *buffer, double d) {
+    uint64_t bits, ieee_mantissa, digits;
+    unsigned ieee_exponent;
+    int exponent;
+
+    memcpy(&bits, &d, sizeof(bits));
+    ieee_mantissa = bits & ((UINT64_C(1) << JSON_DOUBLE_MANTISSA_BITS) - 1);
+    ieee_exponent = (unsigned)(bits >> JSON_DOUBLE_MANTISSA_BITS) & JSON_DOUBLE_INFINITE_POWER;
+
+    if (ieee_exponent == JSON_DOUBLE_INFINITE_POWER) {
+        /* JSON has no spelling for inf and nan */
+        memcpy(buffer, "null", 4);
+        return buffer + 4;
+    }
+    if (bits >> 63) {
+        *buffer++ = '-';
+    }
+    if (ieee_exponent == 0 && ieee_mantissa == 0) {
+        *buffer = '0';
+        return buffer + 1;
+    }
+    if (ieee_exponent >= JSON_DOUBLE_EXPONENT_BIAS &&
+        ieee_exponent <= JSON_DOUBLE_EXPONENT_BIAS + JSON_DOUBLE_MANTISSA_BITS) {
+        int shift = JSON_DOUBLE_EXPONENT_BIAS + JSON_DOUBLE_MANTISSA_BITS - ieee_exponent;
+        uint64_t m2 = (UINT64_C(1) << JSON_DOUBLE_MANTISSA_BITS) | ieee_mantissa;
+        if ((m2 & ((UINT64_C(1) << shift) - 1)) == 0) {
+            return json_format_uint64(buffer, m2 >> shift);
+        }
+    }
+
+    json_ryu(ieee_mantissa, ieee_exponent, &digits, &exponent);
+    return json_format_decimal(buffer, digits, exponent);
+}
+
+/*
+ * json_stringify sizes the output buffer once with json_stringify_size, the
+ * writers below then fill it without growing it.
+ */
+#define JSON_STRINGIFY_NUMBER_SIZE JSON_NUMBER_MAX_LENGTH /* also covers int64 and uint64 */
+
+static size_t json_stringify_string_size(const char* s, size_t len) {
+    const char *end = s + len;
+    size_t size = len + 2;
+
+    /* only the characters the scanner stops at grow */
+    for (; (s = json_scan.scan_string(s, end)) != end; s++) {
+        switch (*s) {
+            case '\\': case '\"': case '\b': case '\f': case '\n': case '\r': case '\t':
+                size += 1; break;
+            default:
+                size += 5; /* \u00XX */
+        }
+    }
+
+    return size;
+}
+
+static size_t json_stringify_size(const json_value *value) {
+    size_t i, size;
+
+    switch (value->type) {
+        case JSON_NULL: return 4;
+        case JSON_TRUE: return 4;
+        case JSON_FALSE: return 5;
+        case JSON_NUMBER: return JSON_STRINGIFY_NUMBER_SIZE;
+        case JSON_STRING: return json_stringify_string_size(JSON_STRING_PTR(value), JSON_STRING_LEN(value));
+        case JSON_ARRAY:
+            JSON_EXPAND(value);
+            size = 2 + (value->size ? value->size - 1 : 0); /* brackets and commas */
+            for (i = 0; i < value->size; i++) {
+                size += json_stringify_size(&value->u.elements[i]);
+            }
+            return size;
+        case JSON_OBJECT:
+            JSON_EXPAND(value);
+            size = 2 + (value->size ? value->size - 1 : 0);
+            for (i = 0; i < value->size; i++) {
+                const json_member *member = &value->u.members[i];
+                size += json_stringify_string_size(JSON_STRING_PTR(&member->key), JSON_STRING_LEN(&member->key)) + 1; /* colon */
+                size += json_stringify_size(&member->value);
+            }
+            return size;
+    }
+
+    return 0;
+}
+
+/* the escape sequence of a '"', '\\' or control character, at most 6 bytes */
+static char* json_write_escape(char *p, unsigned char ch) {
+    static const char hex_digits[] = "0123456789ABCDEF";
+
+    *p++ = '\\';
+    switch (ch) {
+        case '\\': *p++ = '\\'; break;
+        case '\"': *p++ = '\"'; break;
+        case '\b': *p++ = 'b'; break;
+        case '\f': *p++ = 'f'; break;
+        case '\n': *p++ = 'n'; break;
+        case '\r': *p++ = 'r'; break;
+        case '\t': *p++ = 't'; break;
+        default:
+            *p++ = 'u'; *p++ = '0'; *p++ = '0';
+            *p++ = hex_digits[ch >> 4];
+            *p++ = hex_digits[ch & 15];
+    }
+    return p;
+}
+
+static void json_stringify_string(json_context *context, const char* s, size_t len) {
+    const char *end = s + len;
+    char *p;
+    assert(NULL != context && (NULL != s || 0 == len));
+
+    p = context->stack + context->top;
+
+    *p++ = '"';
+
+    for (;;) {
+        /* clean runs go over in one copy, found a vector at a time */
+        const char *run = json_scan.scan_string(s, end);
+        if (run != s) {
+            memcpy(p, s, run - s);
+            p += run - s;
+        }
+        if (run == end) {
+            break;
+        }
+        p = json_write_escape(p, (unsigned char)*run);
+        s = run + 1;
+    }
+
+    *p++ = '"';
+    context->top = p - context->stack;
+    assert(context->top <= context->size);
+}
+
+static void json_stringify_value(json_context *context, const json_value *value) {
+    size_t i;
+
+    switch (value->type) {
+        case JSON_NULL: {PUTS(context, "null", 4); }break;
+        case JSON_TRUE: {PUTS(context, "true", 4); }break;
+        case JSON_FALSE: {PUTS(context, "false", 5); }break;
+        case JSON_NUMBER: {
+            char* buffer = json_context_push(context, JSON_STRINGIFY_NUMBER_SIZE), *p;
+            if (value->flags & JSON_FLAG_INT64) {
+                p = json_format_int64(buffer, value->u.i64);
+            } else if (value->flags & JSON_FLAG_UINT64) {
+                p = json_format_uint64(buffer, value->u.u64);
+            } else {
+                p = json_format_double(buffer, value->u.number);
+            }
+            context->top -= JSON_STRINGIFY_NUMBER_SIZE - (p - buffer);
+        }break;
+        case JSON_STRING: {
+            json_stringify_string(context, JSON_STRING_PTR(value), JSON_STRING_LEN(value));
+        }break;
+        case JSON_ARRAY: {
+            PUTC(context, '[');
+            for (i = 0; i < value->size; i++) {
+                if (i > 0) {
+                    PUTC(context, ',');
+                }
+                json_stringify_value(context, &value->u.elements[i]);
+            }
+            PUTC(context, ']');
+        }break;
+        case JSON_OBJECT: {
+            PUTC(context, '{');
+            for (i = 0; i < value->size; i++) {
+                const json_member *member = &value->u.members[i];
+                if (i > 0) {
+                    PUTC(context, ',');
+                }
+                json_stringify_string(context, JSON_STRING_PTR(&member->key), JSON_STRING_LEN(&member->key));
+                PUTC(context, ':');
+                json_stringify_value(context, &member->value);
+            }
+            PUTC(context, '}');
+        }break;
+    }
+}
+
+char* json_stringify(const json_value* value, size_t* length) {
+    json_context context;
+    assert(NULL != value && NULL != length);
+
+    /* one allocation: the stack is sized for the whole output up front */
+    context.size = json_stringify_size(value) + 1;
+    context.stack = (char*)JSON_MALLOC(context.size);
+    context.top = 0;
 
-    if ((ret = json_parse_string_raw(context, &str, &len)) == JSON_PARSE_OK) {
-        json_set_string(value, str, len);
-    }
+    json_stringify_value(&context, value);
 
-    return ret;
+    *length = context.top;
+    PUTC(&context, '\0');
+
+    return context.stack;
 }
 
 /*
- * array = %x5B ws [ value *( ws %x2C ws value ) ] ws %x5D
+ * Writer: output goes to a sink through a fixed buffer, so the whole text
+ * is never held at once. Each flush hands the sink an array of chunks laid
+ * out for writev: the filled parts of the buffer and, within
+ * json_writer_value, the long escape-free runs of the tree's strings,
+ * passed by reference instead of being copied.
  */
-static int json_parse_array(json_context *context, json_value *value) {
-    size_t size = 0 ,i = 0;
-    int ret = 0;
-    EXPECT(context, '[');
-
-    json_parse_whitespace(context);
-
-    if (']' == *context->json) {
-        context->json ++;
-        value->type = JSON_ARRAY;
-        value->u.array.size = 0;
-        value->u.array.value = NULL;
-        return JSON_PARSE_OK;
-    }
+#ifndef JSON_WRITER_BUFFER_SIZE
+#define JSON_WRITER_BUFFER_SIZE (64 * 1024)
+#endif
 
-    for (;;) {
-        json_value element;
-        json_value_init(&element);
+/* escape-free string runs of at least this many bytes are passed by reference */
+#ifndef JSON_WRITER_REFERENCE_SIZE
+#define JSON_WRITER_REFERENCE_SIZE 1024
+#endif
 
-        if ((ret = json_parse_value(context, &element)) != JSON_PARSE_OK) {
-            break;
-        }
+/* chunks per flush, within the IOV_MAX of 16 POSIX guarantees at least */
+#define JSON_WRITER_CHUNKS 16
 
-        memcpy(json_context_push(context, sizeof(json_value)), &element, sizeof(json_value));
-        size++;
+/* room for the longest piece written in place: a number */
+#define JSON_WRITER_MIN_BUFFER_SIZE 64
 
-        json_parse_whitespace(context);
+/* per open array or object */
+enum {
+    JSON_WRITER_OBJECT = 1 << 0,
+    JSON_WRITER_ITEMS = 1 << 1, /* something written already, the next one needs a comma */
+    JSON_WRITER_KEY = 1 << 2 /* a key waits for its value */
+};
 
-        if (*context->json == ',') {
-            context->json ++;
-            json_parse_whitespace(context);
-        } else if (*context->json == ']') {
-            context->json ++;
-            value->type = JSON_ARRAY;
-            value->u.array.size = size;
-            size *= sizeof(json_value);
-            value->u.array.value = (json_value *)malloc(size);
-            memcpy(value->u.array.value, json_context_pop(context, size), size);
+struct json_writer {
+    json_write_fn fn;
+    void *user;
+    int fd; /* json_writer_create_fd */
+    int failure; /* the error a failing sink stands for */
+    int error; /* sticky */
+    char *buffer;
+    size_t size, top, mark; /* [mark, top) of the buffer is in no chunk yet */
+    json_chunk chunks[JSON_WRITER_CHUNKS];
+    size_t count;
+    unsigned char *levels;
+    size_t depth, capacity;
+    int borrow; /* set while writing a tree, which outlives the flush that ends it */
+};
 
-            return JSON_PARSE_OK;
-        } else {
-            ret = JSON_PARSE_MISS_COMMA_OR_SQUARE_BRACKET;
-            break;
-        }
+/* closes the buffered bytes not yet in a chunk into one */
+static void json_writer_cut(json_writer *writer) {
+    if (writer->top != writer->mark) {
+        writer->chunks[writer->count].data = writer->buffer + writer->mark;
+        writer->chunks[writer->count].len = writer->top - writer->mark;
+        writer->count++;
+        writer->mark = writer->top;
     }
+}
 
-    for ( i = 0; i < size; ++i) {
-        json_value_free(json_context_pop(context, sizeof(json_value)));
+static int json_writer_send(json_writer *writer) {
+    json_writer_cut(writer);
+    if (0 != writer->count && JSON_PARSE_OK == writer->error &&
+        0 != writer->fn(writer->user, writer->chunks, writer->count)) {
+        writer->error = writer->failure;
     }
+    writer->count = 0;
+    writer->top = writer->mark = 0;
+    return writer->error;
+}
 
-    return ret;
+/* at most JSON_WRITER_MIN_BUFFER_SIZE bytes at the end of the buffer */
+static char* json_writer_reserve(json_writer *writer, size_t size) {
+    assert(size <= JSON_WRITER_MIN_BUFFER_SIZE);
+    if (writer->size - writer->top < size) {
+        json_writer_send(writer);
+    }
+    return writer->buffer + writer->top;
 }
 
-/*
- * member = string ws %x3A ws value
- * object = %x7B ws [ member *( ws %x2C ws member ) ] ws %x7D
- *
- */
-static int json_parse_object(json_context *context, json_value *value) {
-    size_t size = 0 ,i = 0;
-    int ret = 0;
-    json_member member;
-    EXPECT(context, '{');
+static void json_writer_put(json_writer *writer, const char *s, size_t len) {
+    while (len > writer->size - writer->top) {
+        size_t room = writer->size - writer->top;
+        memcpy(writer->buffer + writer->top, s, room);
+        writer->top += room;
+        s += room;
+        len -= room;
+        json_writer_send(writer);
+    }
+    memcpy(writer->buffer + writer->top, s, len);
+    writer->top += len;
+}
 
-    json_parse_whitespace(context);
+#define JSON_WRITER_PUTC(writer, ch) \
+    do {\
+        *json_writer_reserve(writer, 1) = (ch);\
+        (writer)->top++;\
+    } while(0)
 
-    if ('}' == *context->json) {
-        context->json ++;
-        value->type = JSON_OBJECT;
-        value->u.object.size= 0;
-        value->u.object.member = NULL;
-        return JSON_PARSE_OK;
+static void json_writer_reference(json_writer *writer, const char *s, size_t len) {
+    json_writer_cut(writer);
+    writer->chunks[writer->count].data = s;
+    writer->chunks[writer->count].len = len;
+    writer->count++;
+    /* keep a slot free for the cut of the next flush */
+    if (writer->count >= JSON_WRITER_CHUNKS - 1) {
+        json_writer_send(writer);
     }
+}
 
-    member.key = NULL;
+static void json_writer_write_string(json_writer *writer, const char *s, size_t len) {
+    const char *end = s + len;
 
+    JSON_WRITER_PUTC(writer, '\"');
     for (;;) {
-        json_value_init(&member.value);
-
-        /* parse key to m.k, m.key_len */
-        if ('\"' !=  *context->json) {
-            ret = JSON_PARSE_MISS_KEY;
-            break;
+        /* the scanner stops at exactly the characters that need escaping */
+        const char *run = json_scan.scan_string(s, end);
+        if (writer->borrow && (size_t)(run - s) >= JSON_WRITER_REFERENCE_SIZE) {
+            json_writer_reference(writer, s, run - s);
+        } else {
+            json_writer_put(writer, s, run - s);
         }
-
-        char *str;
-        if ((ret = json_parse_string_raw(context, &str, &member.key_len)) != JSON_PARSE_OK) {
+        if (run == end) {
             break;
         }
+        writer->top = json_write_escape(json_writer_reserve(writer, 6), (unsigned char)*run) - writer->buffer;
+        s = run + 1;
+    }
+    JSON_WRITER_PUTC(writer, '\"');
+}
 
-        member.key = (char *)malloc(member.key_len + 1);
-        memcpy(member.key , str, member.key_len);
-        member.key[member.key_len] = '\0';
-
-        /*parse ws colon ws*/
-        json_parse_whitespace(context);
+static void json_writer_write_number(json_writer *writer, const json_value *value) {
+    char *buffer = json_writer_reserve(writer, JSON_STRINGIFY_NUMBER_SIZE), *p;
 
-        if (':' != *context->json) {
-            ret = JSON_PARSE_MISS_COLON;
-            break;
-        }
+    if (value->flags & JSON_FLAG_INT64) {
+        p = json_format_int64(buffer, value->u.i64);
+    } else if (value->flags & JSON_FLAG_UINT64) {
+        p = json_format_uint64(buffer, value->u.u64);
+    } else {
+        p = json_format_double(buffer, value->u.number);
+    }
+    writer->top = p - writer->buffer;
+}
 
-        context->json ++;
+static void json_writer_write_value(json_writer *writer, const json_value *value) {
+    size_t i;
 
-        json_parse_whitespace(context);
-        /* parse value */
-        if ((ret = json_parse_value(context, &member.value)) != JSON_PARSE_OK) {
+    switch (value->type) {
+        case JSON_NULL: json_writer_put(writer, "null", 4); break;
+        case JSON_TRUE: json_writer_put(writer, "true", 4); break;
+        case JSON_FALSE: json_writer_put(writer, "false", 5); break;
+        case JSON_NUMBER: json_writer_write_number(writer, value); break;
+        case JSON_STRING:
+            json_writer_write_string(writer, JSON_STRING_PTR(value), JSON_STRING_LEN(value));
             break;
-        }
-
-        memcpy(json_context_push(context, sizeof(json_member)), &member, sizeof(json_member));
-        size++;
-        member.key = NULL;
-
-        /* parse ws [comma | right-curly-brace] ws */
-        json_parse_whitespace(context);
-        if (',' == *context->json) {
-            context->json ++;
-            json_parse_whitespace(context);
-        } else if ('}' == *context->json) {
-            context->json ++;
-            size_t s = sizeof(json_member) * size;
+        case JSON_ARRAY:
+            JSON_EXPAND(value);
+            JSON_WRITER_PUTC(writer, '[');
+            for (i = 0; i < value->size; i++) {
+                if (i > 0) {
+                    JSON_WRITER_PUTC(writer, ',');
+                }
+                json_writer_write_value(writer, &value->u.elements[i]);
+            }
+            JSON_WRITER_PUTC(writer, ']');
+            break;
+        case JSON_OBJECT:
+            JSON_EXPAND(value);
+            JSON_WRITER_PUTC(writer, '{');
+            for (i = 0; i < value->size; i++) {
+                const json_member *member = &value->u.members[i];
+                if (i > 0) {
+                    JSON_WRITER_PUTC(writer, ',');
+                }
+                json_writer_write_string(writer, JSON_STRING_PTR(&member->key), JSON_STRING_LEN(&member->key));
+                JSON_WRITER_PUTC(writer, ':');
+                json_writer_write_value(writer, &member->value);
+            }
+            JSON_WRITER_PUTC(writer, '}');
+            break;
+    }
+}
 
-            value->type = JSON_OBJECT;
-            value->u.object.size = size;
-            value->u.object.member = (json_member *)malloc(s);
-            memcpy(value->u.object.member = (json_member *)malloc(s), json_context_pop(context, s), s);
+#ifdef JSON_POSIX
+static int json_writer_fd_write(void *user, const json_chunk *chunks, size_t count) {
+    struct iovec iov[JSON_WRITER_CHUNKS];
+    int fd = ((json_writer *)user)->fd;
+    size_t i, first = 0;
 
-            return JSON_PARSE_OK;
-        } else {
-            ret = JSON_PARSE_MISS_COMMA_OR_CURLY_BRACKET;
-            break;
+    for (i = 0; i < count; i++) {
+        iov[i].iov_base = (void *)chunks[i].data;
+        iov[i].iov_len = chunks[i].len;
+    }
+    while (first < count) {
+        ssize_t n = writev(fd, iov + first, (int)(count - first));
+        if (n < 0) {
+            if (EINTR == errno) {
+                continue;
+            }
+            return 1;
+        }
+        /* a short write: drop what went out and go on with the rest */
+        for (; first < count && (size_t)n >= iov[first].iov_len; first++) {
+            n -= iov[first].iov_len;
+        }
+        if (first < count) {
+            iov[first].iov_base = (char *)iov[first].iov_base + n;
+            iov[first].iov_len -= n;
         }
     }
+    return 0;
+}
+#endif
 
-    free(member.key);
-    for ( i = 0; i < size; ++i) {
-        json_member *mem = json_context_pop(context, sizeof(json_member));
-        free(mem->key);
-        json_value_free(&mem->value);
+json_writer* json_writer_create(json_write_fn fn, void *user, size_t buffer_size) {
+    json_writer *writer;
+    assert(NULL != fn);
+
+    writer = (json_writer *)JSON_MALLOC(sizeof(json_writer));
+    memset(writer, 0, sizeof(json_writer));
+    writer->fn = fn;
+    writer->user = user;
+    writer->fd = -1;
+    writer->failure = JSON_PARSE_ABORTED;
+    writer->size = 0 == buffer_size ? JSON_WRITER_BUFFER_SIZE : buffer_size;
+    if (writer->size < JSON_WRITER_MIN_BUFFER_SIZE) {
+        writer->size = JSON_WRITER_MIN_BUFFER_SIZE;
     }
+    writer->buffer = (char *)JSON_MALLOC(writer->size);
+    return writer;
+}
 
-    return ret;
+json_writer* json_writer_create_fd(int fd, size_t buffer_size) {
+#ifdef JSON_POSIX
+    json_writer *writer = json_writer_create(json_writer_fd_write, NULL, buffer_size);
+    writer->user = writer;
+    writer->fd = fd;
+    writer->failure = JSON_PARSE_IO_ERROR;
+    return writer;
+#else
+    (void)fd;
+    (void)buffer_size;
+    return NULL;
+#endif
 }
 
-/* value = null / false / true */
-static int json_parse_value(json_context *context, json_value *value) {
-    switch (*context->json) {
-        case 'n': return json_parse_literal(context, value, "null", JSON_NULL);
-        case 't': return json_parse_literal(context, value, "true", JSON_TRUE);
-        case 'f': return json_parse_literal(context, value, "false", JSON_FALSE);
-        case '\"': return json_parse_string(context, value);
-        case '[': return json_parse_array(context, value);
-        case '{': return json_parse_object(context, value);
-        case '\0': return JSON_PARSE_EXPECT_VALUE;
-        default : return json_parse_number(context, value);
+void json_writer_free(json_writer *writer) {
+    if (NULL != writer) {
+        JSON_FREE(writer->levels);
+        JSON_FREE(writer->buffer);
+        JSON_FREE(writer);
     }
 }
 
-int json_parse(json_value* value, const char* json) {
-    json_context context;
-    int ret;
-    assert(value != NULL);
-    context.json = json;
-    context.stack = NULL;
-    context.size = context.top = 0;
-
-    json_value_init(value);
-    json_parse_whitespace(&context);
+int json_writer_flush(json_writer *writer) {
+    assert(NULL != writer);
+    return json_writer_send(writer);
+}
 
-    if (JSON_PARSE_OK == (ret = json_parse_value(&context, value))) {
+/* the comma or the end of the key a value in the open array or object needs */
+static void json_writer_prefix(json_writer *writer) {
+    unsigned char *level;
 
+    if (0 == writer->depth) {
+        return;
     }
+    level = &writer->levels[writer->depth - 1];
+    if (*level & JSON_WRITER_OBJECT) {
+        /* a member value comes after its key */
+        assert(*level & JSON_WRITER_KEY);
+        *level &= ~JSON_WRITER_KEY;
+    } else {
+        if (*level & JSON_WRITER_ITEMS) {
+            JSON_WRITER_PUTC(writer, ',');
+        }
+        *level |= JSON_WRITER_ITEMS;
+    }
+}
 
-    assert(0 == context.top);
-    free(context.stack);
-
-    return ret;
+static int json_writer_begin(json_writer *writer, unsigned char level, char open) {
+    assert(NULL != writer);
+    json_writer_prefix(writer);
+    if (writer->depth == writer->capacity) {
+        writer->capacity = 0 == writer->capacity ? 16 : writer->capacity * 2;
+        writer->levels = (unsigned char *)JSON_REALLOC(writer->levels, writer->capacity);
+    }
+    writer->levels[writer->depth++] = level;
+    JSON_WRITER_PUTC(writer, open);
+    return writer->error;
 }
 
-#ifndef JSON_PARSE_STRINGIFY_INIT_SIZE
-#define JSON_PARSE_STRINGIFY_INIT_SIZE 256
-#endif
+static int json_writer_end(json_writer *writer, unsigned char level, char close) {
+    assert(NULL != writer && 0 != writer->depth);
+    /* the open array or object, with no key left waiting */
+    assert((writer->levels[writer->depth - 1] & (JSON_WRITER_OBJECT | JSON_WRITER_KEY)) == level);
+    (void)level;
+    writer->depth--;
+    JSON_WRITER_PUTC(writer, close);
+    return writer->error;
+}
 
-#define PUTS(context, str, length) \
-    do {\
-        memcpy(json_context_push(context, length), str, length);\
-    } while(0)
+int json_writer_begin_array(json_writer *writer) {
+    return json_writer_begin(writer, 0, '[');
+}
 
+int json_writer_end_array(json_writer *writer) {
+    return json_writer_end(writer, 0, ']');
+}
 
-static void json_stringify_string(json_context *context, const char* s, size_t len) {
-    static const char hex_digits[] = { '0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'A', 'B', 'C', 'D', 'E', 'F' };
-    size_t i = 0, size;
-    char* head, *p;
-    assert(NULL != context && NULL != s);
+int json_writer_begin_object(json_writer *writer) {
+    return json_writer_begin(writer, JSON_WRITER_OBJECT, '{');
+}
 
-    p = head = json_context_push(context, size = len * 6 + 2);
+int json_writer_end_object(json_writer *writer) {
+    return json_writer_end(writer, JSON_WRITER_OBJECT, '}');
+}
 
-    *p++ = '"';
+int json_writer_key(json_writer *writer, const char *key, size_t len) {
+    unsigned char *level;
+    assert(NULL != writer && 0 != writer->depth && (NULL != key || 0 == len));
 
-    for (i = 0; i < len; i++) {
-        unsigned char ch = (unsigned char)s[i];
-        switch (ch) {
-            case '\\': *p++ = '\\';*p++ = '\\'; break;
-            case '\"': *p++ = '\\';*p++ = '\"'; break;
-            case '\b': *p++ = '\\';*p++ = 'b'; break;
-            case '\f': *p++ = '\\';*p++ = 'f'; break;
-            case '\n': *p++ = '\\';*p++ = 'n'; break;
-            case '\r': *p++ = '\\';*p++ = 'r'; break;
-            case '\t': *p++ = '\\';*p++ = 't'; break;
-
-            default: {
-                if (ch < 0x20) {
-                    *p++ = '\\'; *p++ = 'u'; *p++ = '0'; *p++ = '0';
-                    *p++ = hex_digits[ch >> 4];
-                    *p++ = hex_digits[ch & 15];
-                } else {
-                    *p++ = s[i];
-                }
-            }
-        }
+    level = &writer->levels[writer->depth - 1];
+    assert((*level & JSON_WRITER_OBJECT) && !(*level & JSON_WRITER_KEY));
+    if (*level & JSON_WRITER_ITEMS) {
+        JSON_WRITER_PUTC(writer, ',');
     }
+    *level |= JSON_WRITER_ITEMS | JSON_WRITER_KEY;
+    json_writer_write_string(writer, key, len);
+    JSON_WRITER_PUTC(writer, ':');
+    return writer->error;
+}
 
-    *p++ = '"';
-    context->top -= size - (p - head);
+int json_writer_value(json_writer *writer, const json_value *value) {
+    assert(NULL != writer && NULL != value);
+    json_writer_prefix(writer);
+    writer->borrow = 1;
+    json_writer_write_value(writer, value);
+    writer->borrow = 0;
+    /* the chunks may point into the tree, which the caller is free to change next */
+    if (0 != writer->count) {
+        json_writer_send(writer);
+    }
+    return writer->error;
 }
 
-char* json_stringify(const json_value* value, size_t* length) {
-    json_context context;
-    char *json;
-    assert(NULL != value && NULL != length);
+int json_writer_string(json_writer *writer, const char *s, size_t len) {
+    assert(NULL != writer && (NULL != s || 0 == len));
+    json_writer_prefix(writer);
+    json_writer_write_string(writer, s, len);
+    return writer->error;
+}
 
-    context.stack = (char*)malloc(context.size = JSON_PARSE_STRINGIFY_INIT_SIZE);
+int json_writer_number(json_writer *writer, double number) {
+    json_value value;
+    assert(NULL != writer);
+    value.type = JSON_NUMBER;
+    value.flags = 0;
+    value.u.number = number;
+    json_writer_prefix(writer);
+    json_writer_write_number(writer, &value);
+    return writer->error;
+}
 
-    switch (value->type) {
-        case JSON_NULL: {PUTS(&context, "null", 4); }break;
-        case JSON_TRUE: {PUTS(&context, "true", 4); }break;
-        case JSON_FALSE: {PUTS(&context, "false", 5); }break;
-        case JSON_NUMBER: {
-            char* buffer = json_context_push(&context, 32);
-            int num_len = sprintf(buffer, "%.17g", value->u.number);
-            context.top -= 32 - num_len;
-        }break;
-        case JSON_STRING: {
-            json_stringify_string(&context, value->u.string.str, value->u.string.len);
-        }break;
-        case JSON_ARRAY:break;
-        case JSON_OBJECT:break;
-    }
+int json_writer_int64(json_writer *writer, int64_t number) {
+    json_value value;
+    assert(NULL != writer);
+    value.type = JSON_NUMBER;
+    value.flags = JSON_FLAG_INT64;
+    value.u.i64 = number;
+    json_writer_prefix(writer);
+    json_writer_write_number(writer, &value);
+    return writer->error;
+}
 
-    *length = context.top ;
+int json_writer_uint64(json_writer *writer, uint64_t number) {
+    json_value value;
+    assert(NULL != writer);
+    value.type = JSON_NUMBER;
+    value.flags = JSON_FLAG_UINT64;
+    value.u.u64 = number;
+    json_writer_prefix(writer);
+    json_writer_write_number(writer, &value);
+    return writer->error;
+}
 
-    PUTC(&context, '\0');
-    json = context.stack;
+int json_writer_boolean(json_writer *writer, int b) {
+    assert(NULL != writer);
+    json_writer_prefix(writer);
+    if (b) {
+        json_writer_put(writer, "true", 4);
+    } else {
+        json_writer_put(writer, "false", 5);
+    }
+    return writer->error;
+}
 
-    return json;
+int json_writer_null(json_writer *writer) {
+    assert(NULL != writer);
+    json_writer_prefix(writer);
+    json_writer_put(writer, "null", 4);
+    return writer->error;
 }
 
 double json_get_number(const json_value *value) {
     assert(value != NULL && JSON_NUMBER == value->type);
+    if (value->flags & JSON_FLAG_INT64) {
+        return (double)value->u.i64;
+    }
+    if (value->flags & JSON_FLAG_UINT64) {
+        return (double)value->u.u64;
+    }
     return value->u.number;
 }
 
+int json_is_int64(const json_value *value) {
+    assert(value != NULL);
+    return JSON_NUMBER == value->type && (value->flags & JSON_FLAG_INT64);
+}
+
+int json_is_uint64(const json_value *value) {
+    assert(value != NULL);
+    return JSON_NUMBER == value->type
+        && ((value->flags & JSON_FLAG_UINT64) || ((value->flags & JSON_FLAG_INT64) && value->u.i64 >= 0));
+}
+
+int64_t json_get_int64(const json_value *value) {
+    assert(json_is_int64(value));
+    return value->u.i64;
+}
+
+uint64_t json_get_uint64(const json_value *value) {
+    assert(json_is_uint64(value));
+    return (value->flags & JSON_FLAG_UINT64) ? value->u.u64 : (uint64_t)value->u.i64;
+}
+
+void json_set_int64(json_value *value, int64_t number) {
+    assert(value != NULL);
+    json_value_free(value);
+    value->u.i64 = number;
+    value->type = JSON_NUMBER;
+    value->flags = JSON_FLAG_INT64;
+}
+
+void json_set_uint64(json_value *value, uint64_t number) {
+    assert(value != NULL);
+    if (number <= (uint64_t)INT64_MAX) {
+        json_set_int64(value, (int64_t)number);
+        return;
+    }
+    json_value_free(value);
+    value->u.u64 = number;
+    value->type = JSON_NUMBER;
+    value->flags = JSON_FLAG_UINT64;
+}
+
 void json_set_number(json_value *value, double number) {
     assert(value != NULL);
     json_value_free(value);
@@ -525,39 +5390,35 @@ void json_set_boolean(json_value *value, int b) {
 size_t json_get_string_length(const json_value *value)
 {
     assert(NULL != value && JSON_STRING == value->type);
-    return value->u.string.len;
+    return JSON_STRING_LEN(value);
 }
 
 
 const char* json_get_string(const json_value *value) {
     assert(NULL != value && JSON_STRING == value->type);
-    return value->u.string.str;
+    return JSON_STRING_PTR(value);
 }
 
 
 void json_set_string(json_value *value, const char * s, size_t len) {
-    assert(NULL != value && (NULL != s || 0 == len));
+    assert(NULL != value && (NULL != s || 0 == len) && len <= UINT32_MAX);
 
     json_value_free(value);
-
-    value->u.string.str = (char *)malloc(len + 1);
-    memcpy(value->u.string.str, s, len);
-    value->u.string.str[len] = '\0';
-    value->u.string.len = len;
-
-    value->type = JSON_STRING;
+    json_string_copy(value, s, len, NULL);
 }
 
 json_value* json_get_array_element(const json_value *value, unsigned index)
 {
     assert(NULL != value && JSON_ARRAY == value->type);
-    return &value->u.array.value[index];
+    JSON_EXPAND(value);
+    return &value->u.elements[index];
 }
 
 size_t json_get_array_size(const json_value *value)
 {
     assert(NULL != value && JSON_ARRAY == value->type);
-    return value->u.array.size;
+    JSON_EXPAND(value);
+    return value->size;
 }
 
 json_type json_get_type(const json_value *value) {
@@ -568,42 +5429,175 @@ json_type json_get_type(const json_value *value) {
 
 size_t json_get_object_size(const json_value *value) {
     assert(NULL != value && JSON_OBJECT == value->type);
-    return value->u.object.size;
+    JSON_EXPAND(value);
+    return value->size;
 }
 
 const char* json_get_object_key(const json_value *value, unsigned index) {
     assert(NULL != value && JSON_OBJECT == value->type);
-    assert(index < value->u.object.size);
-    return (const char *) value->u.object.member[index].key;
+    JSON_EXPAND(value);
+    assert(index < value->size);
+    return JSON_STRING_PTR(&value->u.members[index].key);
 }
 
 size_t json_get_object_key_length(const json_value *value, unsigned index) {
     assert(NULL != value && JSON_OBJECT == value->type);
-    assert(index < value->u.object.size);
-    return value->u.object.member[index].key_len;
+    JSON_EXPAND(value);
+    assert(index < value->size);
+    return JSON_STRING_LEN(&value->u.members[index].key);
 }
 
 json_value* json_get_object_value(const json_value *value, unsigned index) {
     assert(NULL != value && JSON_OBJECT == value->type);
-    assert(index < value->u.object.size);
-    return &value->u.object.member[index].value;
+    JSON_EXPAND(value);
+    assert(index < value->size);
+    return &value->u.members[index].value;
+}
+
+static int json_member_key_equals(const json_member *m, const char *key, size_t len) {
+    return JSON_STRING_LEN(&m->key) == len && (0 == len || 0 == memcmp(JSON_STRING_PTR(&m->key), key, len));
+}
+
+/* twice the member count rounded up to a power of two keeps probe chains short */
+static size_t json_object_index_capacity(size_t size) {
+    size_t capacity = 1;
+
+    while (capacity < size * 2) {
+        capacity <<= 1;
+    }
+    return capacity;
+}
+
+static uint32_t* json_object_index_build(const json_value *value) {
+    json_object_header *header = JSON_OBJECT_HEADER(value);
+    size_t capacity = json_object_index_capacity(value->size), mask = capacity - 1, i, slot;
+    uint32_t *index;
+
+    if (NULL != header->arena) {
+        index = (uint32_t *)json_arena_alloc(header->arena, capacity * sizeof(uint32_t));
+    } else {
+        index = (uint32_t *)JSON_MALLOC(capacity * sizeof(uint32_t));
+    }
+    if (NULL == index) {
+        return NULL;
+    }
+    memset(index, 0, capacity * sizeof(uint32_t));
+
+    /* linear probing meets earlier members first, so duplicate keys resolve to the first one */
+    for (i = 0; i < value->size; i++) {
+        const json_member *m = &value->u.members[i];
+        for (slot = json_hash_key(JSON_STRING_PTR(&m->key), JSON_STRING_LEN(&m->key)) & mask; 0 != index[slot]; slot = (slot + 1) & mask) {
+        }
+        index[slot] = (uint32_t)(i + 1);
+    }
+
+    header->index = index;
+    return index;
+}
+
+json_value* json_find_object_value(const json_value *value, const char *key, size_t len) {
+    json_member *member;
+    size_t i, size;
+
+    assert(NULL != value && JSON_OBJECT == value->type);
+    assert(NULL != key || 0 == len);
+    JSON_EXPAND(value);
+
+    member = value->u.members;
+    size = value->size;
+
+    if (JSON_OBJECT_INDEXED(value)) {
+        uint32_t *index = JSON_OBJECT_HEADER(value)->index;
+        if (NULL != index || NULL != (index = json_object_index_build(value))) {
+            size_t mask = json_object_index_capacity(size) - 1, slot;
+            for (slot = json_hash_key(key, len) & mask; 0 != index[slot]; slot = (slot + 1) & mask) {
+                json_member *m = &member[index[slot] - 1];
+                if (json_member_key_equals(m, key, len)) {
+                    return &m->value;
+                }
+            }
+            return NULL;
+        }
+    }
+
+    for (i = 0; i < size; i++) {
+        if (json_member_key_equals(&member[i], key, len)) {
+            return &member[i].value;
+        }
+    }
+    return NULL;
+}
+
+/* an interned key is equal to a member key only when it is the same string */
+#define JSON_KEY_IS(m, key) ((m)->key.u.str == (key) && ((m)->key.flags & JSON_FLAG_INTERNED))
+
+json_value* json_find_interned_value(const json_value *value, const char *key) {
+    json_member *member;
+    size_t i, size;
+
+    assert(NULL != value && JSON_OBJECT == value->type && NULL != key);
+    JSON_EXPAND(value);
+
+    member = value->u.members;
+    size = value->size;
+
+    if (JSON_OBJECT_INDEXED(value)) {
+        uint32_t *index = JSON_OBJECT_HEADER(value)->index;
+        if (NULL != index || NULL != (index = json_object_index_build(value))) {
+            size_t mask = json_object_index_capacity(size) - 1, slot;
+            for (slot = JSON_KEY_HASH(key) & mask; 0 != index[slot]; slot = (slot + 1) & mask) {
+                json_member *m = &member[index[slot] - 1];
+                if (JSON_KEY_IS(m, key)) {
+                    return &m->value;
+                }
+            }
+            return NULL;
+        }
+    }
+
+    for (i = 0; i < size; i++) {
+        if (JSON_KEY_IS(&member[i], key)) {
+            return &member[i].value;
+        }
+    }
+    return NULL;
 }
 
 void json_value_free(json_value *value) {
-    int i = 0;
+    size_t i = 0;
 
     assert(NULL != value);
 
-    if (JSON_STRING == value->type) {
-        free(value->u.string.str);
+    if (value->flags & JSON_FLAG_LAZY) {
+        if (NULL == value->u.lazy->arena) {
+            JSON_FREE(value->u.lazy);
+        }
+    } else if (JSON_STRING == value->type) {
+        if (!(value->flags & (JSON_FLAG_STRING_VIEW | JSON_FLAG_INTERNED)) && !value->inline_size) {
+            JSON_FREE(value->u.str);
+        }
     } else if (JSON_ARRAY == value->type) {
 
-        for (i = 0; i < value->u.array.size; ++i) {
-            json_value_free(&value->u.array.value[i]);
+        for (i = 0; i < value->size; ++i) {
+            json_value_free(&value->u.elements[i]);
+        }
+
+        JSON_FREE(value->u.elements);
+    } else if (JSON_OBJECT == value->type) {
+
+        for (i = 0; i < value->size; ++i) {
+            json_value_free(&value->u.members[i].key);
+            json_value_free(&value->u.members[i].value);
         }
 
-        free(value->u.array.value);
+        if (JSON_OBJECT_INDEXED(value)) {
+            JSON_FREE(JSON_OBJECT_HEADER(value)->index);
+            JSON_FREE(JSON_OBJECT_HEADER(value));
+        } else {
+            JSON_FREE(value->u.members);
+        }
     }
 
     value->type = JSON_NULL;
+    value->flags = 0;
 }
@@ -2,6 +2,7 @@
 #define JSON_PARSER_H_
 
 #include <stdlib.h>
+#include <stdint.h>
 
 typedef enum {
 	JSON_NULL,
@@ -16,23 +17,93 @@ typedef enum {
 
 typedef struct json_value json_value;
 typedef struct json_member json_member;
+typedef struct json_document json_document;
+typedef struct json_stream json_stream;
+typedef struct json_key_table json_key_table;
 
+/*
+ * 16 bytes a node. Strings up to JSON_INLINE_STRING_MAX bytes that the value
+ * owns sit in the node itself, over u and size; the getters hide which.
+ */
 struct json_value {
     union {
-        struct {json_member *member; size_t size;}object;
-        struct {json_value *value; size_t size;} array;
-        struct {char *str; size_t len;} string;
+        json_member *members; /* JSON_OBJECT */
+        json_value *elements; /* JSON_ARRAY */
+        char *str; /* JSON_STRING */
         double number;
+        int64_t i64; /* JSON_NUMBER with JSON_FLAG_INT64 */
+        uint64_t u64; /* JSON_NUMBER with JSON_FLAG_UINT64 */
+        struct json_lazy *lazy; /* JSON_ARRAY or JSON_OBJECT with JSON_FLAG_LAZY */
     } u;
-
-	json_type type;
+    uint32_t size; /* string length, element or member count */
+    unsigned char type; /* json_type */
+    unsigned char flags; /* JSON_FLAG_* */
+    unsigned char inline_size; /* JSON_STRING: length + 1 when stored inline, else 0 */
 };
 
+#define JSON_INLINE_STRING_MAX 11
+
+/* key and value side by side, the key a JSON_STRING */
 struct json_member {
-    char *key; size_t key_len; /* member key string, key string length */
+    json_value key;
     json_value value;
 };
 
+/* json_value.flags */
+enum {
+    /* the string borrows its bytes from the parsed text: not owned, not NUL-terminated */
+    JSON_FLAG_STRING_VIEW = 1 << 0,
+    /*
+     * The number is an integer literal (no fraction or exponent) kept
+     * exactly in u.i64, or in u.u64 when above INT64_MAX.
+     */
+    JSON_FLAG_INT64 = 1 << 1,
+    JSON_FLAG_UINT64 = 1 << 2,
+    /* an array or object of a JSON_PARSE_LAZY tree that has not been looked into yet */
+    JSON_FLAG_LAZY = 1 << 3,
+    /* the key string belongs to a json_key_table: not owned, NUL-terminated */
+    JSON_FLAG_INTERNED = 1 << 4
+};
+
+/* json_parse_options.flags */
+enum {
+    /*
+     * Escape-free strings and keys become views into the input buffer, which
+     * must outlive the tree. Only strings with escapes are copied.
+     */
+    JSON_PARSE_STRING_VIEWS = 1 << 0,
+    /*
+     * Only the outermost array or object is parsed. Those nested in it are
+     * checked and skipped, then parsed, one level at a time, the first time
+     * json_get_array_* / json_get_object_* / json_find_object_value or
+     * json_stringify looks inside them; that call mutates the tree. The
+     * input must outlive the tree. Malformed input fails the parse with the
+     * error json_parse would give, skipped values included.
+     */
+    JSON_PARSE_LAZY = 1 << 1,
+    /*
+     * Object keys point into json_parse_options.keys instead of being
+     * copied, one string per distinct key across every parse sharing the
+     * table, which must outlive those trees. Takes precedence over
+     * JSON_PARSE_STRING_VIEWS for keys. A table serves one parse at a
+     * time, so the threaded parsers run on one thread with it.
+     */
+    JSON_PARSE_INTERN_KEYS = 1 << 2,
+    /*
+     * Strings and keys must be well-formed UTF-8 (RFC 3629: no overlong
+     * forms, surrogates or code points above U+10FFFF), else the parse
+     * fails with JSON_PARSE_INVALID_UTF8. A \u escape of a low surrogate
+     * must follow a high one, else JSON_PARSE_INVALID_UNICODE_SURROGATE.
+     * Without it any byte from 0x20 up is taken as it is.
+     */
+    JSON_PARSE_VALIDATE_UTF8 = 1 << 3
+};
+
+typedef struct {
+    unsigned flags; /* JSON_PARSE_* */
+    json_key_table *keys; /* read only with JSON_PARSE_INTERN_KEYS */
+} json_parse_options;
+
 enum {
 	JSON_PARSE_OK = 0,
 	JSON_PARSE_EXPECT_VALUE,
@@ -44,26 +115,303 @@ enum {
     JSON_PARSE_MISS_COMMA_OR_SQUARE_BRACKET,
     JSON_PARSE_MISS_KEY,
     JSON_PARSE_MISS_COLON,
-    JSON_PARSE_MISS_COMMA_OR_CURLY_BRACKET
+    JSON_PARSE_MISS_COMMA_OR_CURLY_BRACKET,
+    JSON_PARSE_ABORTED, /* a callback asked to stop */
+    JSON_PARSE_IO_ERROR, /* the file could not be opened, read or written */
+    JSON_PARSE_TOO_LARGE, /* a string, array or object beyond UINT32_MAX bytes or entries */
+    JSON_PARSE_INVALID_UTF8 /* malformed UTF-8 in a string, see JSON_PARSE_VALIDATE_UTF8 */
 };
 
-#define json_value_init(v) do {(v)->type = JSON_NULL;} while(0)
+/* malloc_fn, realloc_fn and free_fn must all be set; they back every allocation of the library */
+typedef struct {
+    void *(*malloc_fn)(size_t size);
+    void *(*realloc_fn)(void *ptr, size_t size);
+    void (*free_fn)(void *ptr);
+} json_allocator;
+
+#define json_value_init(v) do {(v)->type = JSON_NULL; (v)->flags = 0;} while(0)
 #define json_set_null(v) do {json_value_free((v));} while(0)
 
 
 char* json_stringify(const json_value* v, size_t* length);
 int json_parse(json_value* v, const char* json);
+/* parses exactly len bytes of json, which needs no NUL terminator */
+int json_parse_n(json_value* v, const char* json, size_t len);
+/* options may be NULL for the defaults */
+int json_parse_ex(json_value* v, const char* json, size_t len, const json_parse_options *options);
 json_type json_get_type(const json_value *value);
 
+/*
+ * Document mode: nodes, keys and string bytes of the tree are bump-allocated
+ * from a few large blocks owned by the document, and json_document_free
+ * releases all of them at once. Never pass document nodes to json_value_free
+ * or the json_set_* functions.
+ */
+json_document* json_document_create(void);
+void json_document_free(json_document *doc);
+int json_parse_into(json_document *doc, const char *json);
+int json_parse_into_n(json_document *doc, const char *json, size_t len);
+int json_parse_into_ex(json_document *doc, const char *json, size_t len, const json_parse_options *options);
+json_value* json_document_root(json_document *doc);
+/*
+ * Like json_parse_into_ex, but a large top-level array has its elements
+ * parsed on threads workers (0 for one per online CPU).
+ */
+int json_parse_into_parallel(json_document *doc, const char *json, size_t len, int threads,
+                             const json_parse_options *options);
+
+/*
+ * Reusable parser for many small messages: its stack, and the arena behind
+ * json_parser_parse_into, stay allocated from one parse to the next. The
+ * tree of json_parser_parse_into lives in the parser until the next parse
+ * or json_parser_reset; json_parser_parse builds ordinary malloc'd trees.
+ * Memory held beyond retain_size after an outlier message is given back at
+ * the end of json_parser_parse, and at the next parse or reset for the arena.
+ */
+typedef struct json_parser json_parser;
+
+typedef struct {
+    size_t stack_size; /* initial stack bytes, 0 for the default */
+    size_t arena_size; /* arena bytes allocated up front, 0 for none */
+    size_t retain_size; /* most bytes the stack and the arena each keep, 0 for 1 MB */
+} json_parser_config;
+
+/* config may be NULL for the defaults */
+json_parser* json_parser_create(const json_parser_config *config);
+void json_parser_free(json_parser *parser);
+int json_parser_parse(json_parser *parser, json_value *value, const char *json, size_t len,
+                      const json_parse_options *options);
+int json_parser_parse_into(json_parser *parser, const char *json, size_t len, const json_parse_options *options);
+json_value* json_parser_root(json_parser *parser);
+/* drops the json_parser_parse_into tree, keeping memory up to retain_size */
+void json_parser_reset(json_parser *parser);
+
+/*
+ * Streaming: feed the text in chunks of any size, split anywhere, then call
+ * json_stream_finish for the tree. Chunks need not outlive the call, only
+ * the tree and the longest token are kept. json_stream_feed returns the
+ * first error as soon as it is seen and keeps returning it; finish resets
+ * the stream for the next document.
+ */
+json_stream* json_stream_create(void);
+void json_stream_free(json_stream *stream);
+int json_stream_feed(json_stream *stream, const char *chunk, size_t len);
+int json_stream_finish(json_stream *stream, json_value *value);
+
+/*
+ * Event parsing: json_parse_sax reports each token to the handler in
+ * document order and builds no tree. Callbacks may be NULL and return 0 to
+ * go on; anything else stops the parse with JSON_PARSE_ABORTED. Strings and
+ * keys are valid only during the call and are not NUL-terminated; numbers
+ * come as a JSON_NUMBER value for json_get_number / json_get_int64.
+ * end_*_fn receive the number of elements or members.
+ */
+typedef struct {
+    int (*null_fn)(void *user);
+    int (*boolean_fn)(void *user, int b);
+    int (*number_fn)(void *user, const json_value *number);
+    int (*string_fn)(void *user, const char *str, size_t len);
+    int (*key_fn)(void *user, const char *key, size_t len);
+    int (*start_object_fn)(void *user);
+    int (*end_object_fn)(void *user, size_t size);
+    int (*start_array_fn)(void *user);
+    int (*end_array_fn)(void *user, size_t size);
+} json_sax_handler;
+
+int json_parse_sax(const char *json, size_t len, const json_sax_handler *handler, void *user);
+/*
+ * A json_stream that reports to handler as json_parse_sax does instead of
+ * building a tree, in memory bounded by the nesting depth and the longest
+ * token; json_stream_finish then leaves its value null.
+ */
+json_stream* json_stream_create_sax(const json_sax_handler *handler, void *user);
+
+/*
+ * Paths, compiled once and evaluated on any number of trees or texts.
+ * json_path_compile_pointer takes an RFC 6901 JSON Pointer: "" for the
+ * whole document, "/a/0/b~1c" for a member "b/c" of element 0 of member
+ * "a"; a token of digits indexes arrays and names object members alike.
+ * json_path_compile takes a JSONPath subset: $ followed by .name, ['name']
+ * or ["name"], [index], .* and [*]. Both return NULL for malformed paths.
+ *
+ * json_path_find returns the first value the path reaches, or NULL;
+ * json_path_each hands fn every one in document order, the tree still
+ * owning them. json_parse_path parses json and builds only the values the
+ * path reaches, everything else is checked but skipped: fn owns each value
+ * and must json_value_free it. fn returns nonzero to stop, which makes
+ * both return JSON_PARSE_ABORTED.
+ */
+typedef struct json_path json_path;
+typedef int (*json_path_fn)(void *user, json_value *value);
+
+json_path* json_path_compile_pointer(const char *pointer, size_t len);
+json_path* json_path_compile(const char *path, size_t len);
+void json_path_free(json_path *path);
+json_value* json_path_find(const json_path *path, const json_value *value);
+int json_path_each(const json_path *path, const json_value *value, json_path_fn fn, void *user);
+/* options may be NULL */
+int json_parse_path(const char *json, size_t len, const json_path *path, const json_parse_options *options,
+                    json_path_fn fn, void *user);
+
+/*
+ * Projection: json_parse_projected builds only what the paths of a field
+ * set reach, with the arrays and objects that lead there; every other
+ * member or element is checked and skipped without being built, so errors
+ * are those of json_parse_ex. A member off every path is dropped; an
+ * array element off every path is left null in its slot, so the set's
+ * paths find the same values in the projected tree as in the full one.
+ * A scalar where a path goes on counts as off it. A set is built by
+ * json_field_set_add once and can serve any number of parses; the paths
+ * may be freed after they are added.
+ */
+typedef struct json_field_set json_field_set;
+
+json_field_set* json_field_set_create(void);
+void json_field_set_add(json_field_set *fields, const json_path *path);
+void json_field_set_free(json_field_set *fields);
+/* options may be NULL; value is left null when the root itself is dropped */
+int json_parse_projected(json_value *value, const char *json, size_t len, const json_field_set *fields,
+                         const json_parse_options *options);
+
+/*
+ * Tape parsing: a second backend, in two stages. The first marks structural
+ * characters with the vector scanners, the second walks them into a flat
+ * tape that the json_tape_* accessors read in place, with no tree built.
+ * Errors are those of json_parse_n; a failed parse leaves a null root.
+ * Escape-free strings are read from json, which must outlive the tape's
+ * next parse. Strings are not NUL-terminated.
+ *
+ * A json_tape_ref is a value's position on its tape and 0 stands for none.
+ * json_tape_first gives the first element of an array, or the first key of
+ * an object; json_tape_next steps over a whole value, so from a key it gets
+ * to the key's value and from there to the next key:
+ *
+ *   for (r = json_tape_first(tape, array); r; r = json_tape_next(tape, r))
+ */
+typedef struct json_tape json_tape;
+typedef size_t json_tape_ref;
+
+json_tape* json_tape_create(void);
+void json_tape_free(json_tape *tape);
+int json_parse_tape(json_tape *tape, const char *json, size_t len);
+json_tape_ref json_tape_root(const json_tape *tape);
+
+json_type json_tape_get_type(const json_tape *tape, json_tape_ref ref);
+int json_tape_get_boolean(const json_tape *tape, json_tape_ref ref);
+/* fills number with a JSON_NUMBER value for json_get_number / json_get_int64 */
+void json_tape_get_number(const json_tape *tape, json_tape_ref ref, json_value *number);
+/* strings and object keys */
+const char* json_tape_get_string(const json_tape *tape, json_tape_ref ref, size_t *len);
+/* elements of an array, members of an object */
+size_t json_tape_get_size(const json_tape *tape, json_tape_ref ref);
+json_tape_ref json_tape_first(const json_tape *tape, json_tape_ref ref);
+json_tape_ref json_tape_next(const json_tape *tape, json_tape_ref ref);
+/* both walk the container from its start */
+json_tape_ref json_tape_get_array_element(const json_tape *tape, json_tape_ref ref, size_t index);
+json_tape_ref json_tape_find_object_value(const json_tape *tape, json_tape_ref ref, const char *key, size_t len);
+
+/*
+ * NDJSON: parses every non-blank line of json as a document, on threads
+ * workers (0 for one per online CPU), and calls fn in input order with the
+ * 1-based line number, the line's JSON_PARSE_* result and its value. fn
+ * owns the value and must json_value_free it; it returns nonzero to stop,
+ * making json_parse_ndjson return JSON_PARSE_ABORTED. options may be NULL;
+ * with JSON_PARSE_STRING_VIEWS the values borrow from json.
+ */
+typedef int (*json_ndjson_fn)(void *user, size_t line, int error, json_value *value);
+
+int json_parse_ndjson(const char *json, size_t len, int threads, const json_parse_options *options,
+                      json_ndjson_fn fn, void *user);
+
+/*
+ * Files: mapped read-only and parsed in place with no copy of the text;
+ * json_parse_file_sax is the way through files larger than memory.
+ * Unmappable files such as pipes are read in chunks instead, through a
+ * json_stream, so json_parse_file_sax stays in bounded memory there too.
+ */
+int json_parse_file(json_value *value, const char *path);
+int json_parse_file_sax(const char *path, const json_sax_handler *handler, void *user);
+
+/*
+ * Writer: produces JSON into a buffer of buffer_size bytes (0 for 64 KB)
+ * and flushes it to a sink whenever it fills, so output of any size takes
+ * no more memory than that. The sink gets the pending output as an array
+ * of chunks, shaped for writev; json_writer_value passes long escape-free
+ * runs of the tree's strings by reference, valid for that call only. The
+ * sink returns nonzero to fail. A failure sticks: every later call returns
+ * JSON_PARSE_ABORTED, or JSON_PARSE_IO_ERROR for a descriptor, and writes
+ * nothing.
+ *
+ * Values either come whole from a tree, json_writer_value, or are built
+ * piece by piece: begin and end arrays and objects, and precede each
+ * member value with json_writer_key. Commas are placed by the writer.
+ * Output still in the buffer is dropped by json_writer_free, so the last
+ * call before it is json_writer_flush.
+ */
+typedef struct json_writer json_writer;
+
+typedef struct {
+    const char *data;
+    size_t len;
+} json_chunk;
+
+typedef int (*json_write_fn)(void *user, const json_chunk *chunks, size_t count);
+
+json_writer* json_writer_create(json_write_fn fn, void *user, size_t buffer_size);
+/* NULL where there are no file descriptors; the writer does not close fd */
+json_writer* json_writer_create_fd(int fd, size_t buffer_size);
+void json_writer_free(json_writer *writer);
+int json_writer_flush(json_writer *writer);
+
+int json_writer_value(json_writer *writer, const json_value *value);
+int json_writer_begin_array(json_writer *writer);
+int json_writer_end_array(json_writer *writer);
+int json_writer_begin_object(json_writer *writer);
+int json_writer_end_object(json_writer *writer);
+int json_writer_key(json_writer *writer, const char *key, size_t len);
+int json_writer_string(json_writer *writer, const char *s, size_t len);
+int json_writer_number(json_writer *writer, double number);
+int json_writer_int64(json_writer *writer, int64_t number);
+int json_writer_uint64(json_writer *writer, uint64_t number);
+int json_writer_boolean(json_writer *writer, int b);
+int json_writer_null(json_writer *writer);
+
+/* vector instruction sets the scanners may use, see json_set_simd */
+enum {
+    JSON_SIMD_NONE = 0,
+    JSON_SIMD_SSE2,
+    JSON_SIMD_AVX2
+};
+
+/*
+ * The best level supported by the CPU is picked once, on first use; this
+ * caps it. Returns the level actually in effect. The scanners are shared
+ * by every parse without locking, so call it before other threads start
+ * parsing, not while they are.
+ */
+int json_set_simd(int level);
+
+/* NULL restores malloc/realloc/free; buffers from json_stringify come from malloc_fn */
+void json_set_allocator(const json_allocator *allocator);
+
 void json_value_free(json_value *value);
 
 double json_get_number(const json_value *value);
 void json_set_number(json_value *value, double number);
 
+/* whether the number holds an integer literal that fits the type */
+int json_is_int64(const json_value *value);
+int json_is_uint64(const json_value *value);
+int64_t json_get_int64(const json_value *value);
+uint64_t json_get_uint64(const json_value *value);
+void json_set_int64(json_value *value, int64_t number);
+void json_set_uint64(json_value *value, uint64_t number);
+
 int json_get_boolean(const json_value *value);
 void json_set_boolean(json_value *value, int b);
 
 size_t json_get_string_length(const json_value *value);
+/* NUL-terminated unless the value carries JSON_FLAG_STRING_VIEW */
 const char* json_get_string(const json_value *value);
 void json_set_string(json_value *value, const char * s, size_t len);
 
@@ -71,9 +419,32 @@ json_value* json_get_array_element(const json_value *value, unsigned index);
 size_t json_get_array_size(const json_value *value);
 
 size_t json_get_object_size(const json_value *value);
+/* NUL-terminated unless the key's flags carry JSON_FLAG_STRING_VIEW */
 const char* json_get_object_key(const json_value *value, unsigned index);
 size_t json_get_object_key_length(const json_value *value, unsigned index);
 json_value* json_get_object_value(const json_value *value, unsigned index);
+/*
+ * The value of the first member named key (len bytes, may hold NUL), or NULL.
+ * Large objects build a hash index on the first call, so that call mutates
+ * the object and must not race with other readers of it.
+ */
+json_value* json_find_object_value(const json_value *value, const char *key, size_t len);
+
+/*
+ * Key interning, see JSON_PARSE_INTERN_KEYS. json_key_table_intern returns
+ * the table's NUL-terminated copy of key, the same pointer for equal keys,
+ * valid until json_key_table_free.
+ */
+json_key_table* json_key_table_create(void);
+void json_key_table_free(json_key_table *table);
+const char* json_key_table_intern(json_key_table *table, const char *key, size_t len);
+/* distinct keys held */
+size_t json_key_table_size(const json_key_table *table);
+/*
+ * json_find_object_value for an object parsed with the table key comes
+ * from: keys match by pointer, no bytes are compared.
+ */
+json_value* json_find_interned_value(const json_value *value, const char *key);
 
 
 #endif
@@ -0,0 +1,1385 @@
+#define _POSIX_C_SOURCE 200112L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "JsonParser.h"
+
+static volatile double bench_sink;
+static size_t alloc_count = 0;
+static size_t free_count = 0;
+static size_t alloc_bytes = 0;
+
+static void* count_malloc(size_t size) {
+    alloc_count++;
+    alloc_bytes += size;
+    return malloc(size);
+}
+
+static void* count_realloc(void *ptr, size_t size) {
+    if (NULL == ptr) {
+        alloc_count++;
+    }
+    alloc_bytes += size;
+    return realloc(ptr, size);
+}
+
+static void count_free(void *ptr) {
+    if (NULL != ptr) {
+        free_count++;
+    }
+    free(ptr);
+}
+
+static const json_allocator count_allocator = { count_malloc, count_realloc, count_free };
+
+static double elapsed_ms(clock_t start) {
+    return (double)(clock() - start) * 1000.0 / CLOCKS_PER_SEC;
+}
+
+/* wall time, for the threaded benchmarks where clock() adds up every thread */
+static double wall_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+typedef struct {
+    char *buf;
+    size_t len, cap;
+} bench_buffer;
+
+static void buffer_append(bench_buffer *b, const char *s) {
+    size_t n = strlen(s);
+    if (b->len + n + 1 > b->cap) {
+        while (b->len + n + 1 > b->cap) {
+            b->cap = b->cap ? b->cap * 2 : 4096;
+        }
+        b->buf = (char *)realloc(b->buf, b->cap);
+    }
+    memcpy(b->buf + b->len, s, n + 1);
+    b->len += n;
+}
+
+/* an event-log style array of small records, roughly 130 bytes each */
+static char* generate_records(size_t count, size_t *length) {
+    bench_buffer b = { NULL, 0, 0 };
+    char record[256];
+    size_t i;
+
+    buffer_append(&b, "[");
+    for (i = 0; i < count; i++) {
+        sprintf(record,
+                "%s{\"id\":%lu,\"name\":\"user%lu\",\"tags\":[\"alpha\",\"beta\"],"
+                "\"score\":%lu.25,\"active\":%s,\"note\":\"line\\nbreak\",\"parent\":null}",
+                i ? "," : "", (unsigned long)i, (unsigned long)(i * 7), (unsigned long)(i % 1000),
+                (i & 1) ? "true" : "false");
+        buffer_append(&b, record);
+    }
+    buffer_append(&b, "]");
+
+    *length = b.len;
+    return b.buf;
+}
+
+/* the same records pretty-printed with deep indentation, about 40% whitespace */
+static char* generate_pretty_records(size_t count, size_t *length) {
+    bench_buffer b = { NULL, 0, 0 };
+    char record[512];
+    size_t i;
+
+    buffer_append(&b, "[\n");
+    for (i = 0; i < count; i++) {
+        sprintf(record,
+                "        {\n"
+                "            \"id\" : %lu,\n"
+                "            \"name\" : \"user%lu\",\n"
+                "            \"tags\" : [\n"
+                "                \"alpha\",\n"
+                "                \"beta\"\n"
+                "            ],\n"
+                "            \"active\" : %s\n"
+                "        }%s\n",
+                (unsigned long)i, (unsigned long)(i * 7), (i & 1) ? "true" : "false",
+                i + 1 < count ? "," : "");
+        buffer_append(&b, record);
+    }
+    buffer_append(&b, "]\n");
+
+    *length = b.len;
+    return b.buf;
+}
+
+static double time_parse(const char *json, size_t length, int rounds) {
+    clock_t start = clock();
+    int i;
+
+    for (i = 0; i < rounds; i++) {
+        json_document *doc = json_document_create();
+        if (JSON_PARSE_OK != json_parse_into_n(doc, json, length)) {
+            fprintf(stderr, "json_parse_into_n failed\n");
+            exit(1);
+        }
+        json_document_free(doc);
+    }
+
+    return elapsed_ms(start) / rounds;
+}
+
+static void bench_whitespace(size_t records, int rounds) {
+    static const char *names[] = { "scalar", "sse2", "avx2" };
+    size_t length;
+    char *json = generate_pretty_records(records, &length);
+    int level;
+
+    printf("whitespace: %.1f MB pretty-printed input\n", length / (1024.0 * 1024.0));
+    time_parse(json, length, 1); /* warm up */
+    for (level = JSON_SIMD_NONE; level <= JSON_SIMD_AVX2; level++) {
+        double ms;
+        if (json_set_simd(level) != level) {
+            continue;
+        }
+        ms = time_parse(json, length, rounds);
+        printf("  %-6s %10.2f ms %10.1f MB/s\n", names[level], ms, length / (1024.0 * 1024.0) / (ms / 1000.0));
+    }
+    json_set_simd(JSON_SIMD_AVX2);
+
+    free(json);
+}
+
+/* an array of prose strings, one in eight carrying an escape */
+static char* generate_strings(size_t count, size_t *length) {
+    static const char *text =
+        "Lorem ipsum dolor sit amet, consectetur adipiscing elit, sed do eiusmod tempor "
+        "incididunt ut labore et dolore magna aliqua. Ut enim ad minim veniam, quis nostrud "
+        "exercitation ullamco laboris nisi ut aliquip ex ea commodo consequat.";
+    bench_buffer b = { NULL, 0, 0 };
+    size_t i;
+
+    buffer_append(&b, "[");
+    for (i = 0; i < count; i++) {
+        buffer_append(&b, i ? ",\"" : "\"");
+        buffer_append(&b, text);
+        buffer_append(&b, (i & 7) ? "\"" : " Duis aute irure \\\"dolor\\\".\"");
+    }
+    buffer_append(&b, "]");
+
+    *length = b.len;
+    return b.buf;
+}
+
+static void bench_strings(size_t records, int rounds) {
+    static const char *names[] = { "scalar", "sse2", "avx2" };
+    size_t length, out_length;
+    char *json = generate_strings(records, &length);
+    json_value value;
+    int level, r;
+
+    json_value_init(&value);
+    json_parse_n(&value, json, length);
+
+    printf("strings: %.1f MB string-heavy input, parse and stringify\n", length / (1024.0 * 1024.0));
+    time_parse(json, length, 1); /* warm up */
+    for (level = JSON_SIMD_NONE; level <= JSON_SIMD_AVX2; level++) {
+        double ms, stringify_ms;
+        clock_t start;
+        if (json_set_simd(level) != level) {
+            continue;
+        }
+        ms = time_parse(json, length, rounds);
+        start = clock();
+        for (r = 0; r < rounds; r++) {
+            free(json_stringify(&value, &out_length));
+        }
+        stringify_ms = elapsed_ms(start) / rounds;
+        printf("  %-6s %10.2f ms %10.1f MB/s %10.2f ms %10.1f MB/s\n", names[level],
+               ms, length / (1024.0 * 1024.0) / (ms / 1000.0),
+               stringify_ms, out_length / (1024.0 * 1024.0) / (stringify_ms / 1000.0));
+    }
+    json_set_simd(JSON_SIMD_AVX2);
+
+    json_value_free(&value);
+    free(json);
+}
+
+static double time_parse_ex(const char *json, size_t length, const json_parse_options *options, int rounds) {
+    clock_t start = clock();
+    int i;
+
+    for (i = 0; i < rounds; i++) {
+        json_document *doc = json_document_create();
+        if (JSON_PARSE_OK != json_parse_into_ex(doc, json, length, options)) {
+            fprintf(stderr, "json_parse_into_ex failed\n");
+            exit(1);
+        }
+        json_document_free(doc);
+    }
+
+    return elapsed_ms(start) / rounds;
+}
+
+/* the same strings in Greek, Chinese and emoji, two to four bytes a character */
+static char* generate_multilingual(size_t count, size_t *length) {
+    static const char *text =
+        "\xCE\x9A\xCE\xB1\xCE\xBB\xCE\xB7\xCE\xBC\xCE\xAD\xCF\x81\xCE\xB1 \xCE\xBA\xCF\x8C\xCF\x83\xCE\xBC\xCE\xB5, "
+        "\xE4\xBD\xA0\xE5\xA5\xBD\xEF\xBC\x8C\xE4\xB8\x96\xE7\x95\x8C\xE3\x80\x82\xE8\xBF\x99\xE6\x98\xAF\xE4\xB8\x80"
+        "\xE4\xB8\xAA\xE6\xB5\x8B\xE8\xAF\x95\xE5\xAD\x97\xE7\xAC\xA6\xE4\xB8\xB2 \xF0\x9F\x98\x80\xF0\x9F\x9A\x80 "
+        "lorem ipsum dolor sit amet, consectetur adipiscing elit \xE2\x82\xAC\xC2\xA3\xC2\xA5";
+    bench_buffer b = { NULL, 0, 0 };
+    size_t i;
+
+    buffer_append(&b, "[");
+    for (i = 0; i < count; i++) {
+        buffer_append(&b, i ? ",\"" : "\"");
+        buffer_append(&b, text);
+        buffer_append(&b, "\"");
+    }
+    buffer_append(&b, "]");
+
+    *length = b.len;
+    return b.buf;
+}
+
+static void bench_utf8(size_t records, int rounds) {
+    static const char *names[] = { "scalar", "sse2", "avx2" };
+    json_parse_options plain, validate;
+    char *inputs[2];
+    size_t lengths[2];
+    int level, k;
+
+    plain.flags = 0;
+    plain.keys = NULL;
+    validate.flags = JSON_PARSE_VALIDATE_UTF8;
+    validate.keys = NULL;
+    inputs[0] = generate_strings(records, &lengths[0]);
+    inputs[1] = generate_multilingual(records, &lengths[1]);
+
+    for (k = 0; k < 2; k++) {
+        printf("utf8: %.1f MB %s strings, parse and parse with JSON_PARSE_VALIDATE_UTF8\n",
+               lengths[k] / (1024.0 * 1024.0), k ? "multilingual" : "ASCII");
+        for (level = JSON_SIMD_NONE; level <= JSON_SIMD_AVX2; level++) {
+            double ms, validate_ms;
+            if (json_set_simd(level) != level) {
+                continue;
+            }
+            ms = time_parse_ex(inputs[k], lengths[k], &plain, rounds);
+            validate_ms = time_parse_ex(inputs[k], lengths[k], &validate, rounds);
+            printf("  %-6s %10.2f ms %10.2f ms %10.1f MB/s\n", names[level], ms, validate_ms,
+                   lengths[k] / (1024.0 * 1024.0) / (validate_ms / 1000.0));
+        }
+        json_set_simd(JSON_SIMD_AVX2);
+        free(inputs[k]);
+    }
+}
+
+/* telemetry-style samples: fixed-point readings, coordinates and a few exponents */
+static char* generate_numbers(size_t count, size_t *length) {
+    bench_buffer b = { NULL, 0, 0 };
+    char number[64];
+    size_t i;
+    unsigned long seed = 12345;
+
+    buffer_append(&b, "[");
+    for (i = 0; i < count * 8; i++) {
+        seed = seed * 1103515245 + 12345;
+        switch (i % 4) {
+            case 0: sprintf(number, "%.3f", (seed >> 8) % 100000 / 7.0); break;
+            case 1: sprintf(number, "%.17g", (double)(seed >> 4) / 3.0e9 - 20.0); break;
+            case 2: sprintf(number, "%.6e", (double)(seed >> 8) * 1.5e-12); break;
+            default: sprintf(number, "%lu", (seed >> 8) % 1000000); break;
+        }
+        buffer_append(&b, i ? "," : "");
+        buffer_append(&b, number);
+    }
+    buffer_append(&b, "]");
+
+    *length = b.len;
+    return b.buf;
+}
+
+static void bench_numbers(size_t records, int rounds) {
+    size_t length;
+    char *json = generate_numbers(records, &length), *p, *end;
+    double parse_ms, strtod_ms, sum = 0.0;
+    clock_t start;
+    int i;
+
+    printf("numbers: %.1f MB numeric array\n", length / (1024.0 * 1024.0));
+    time_parse(json, length, 1); /* warm up */
+    parse_ms = time_parse(json, length, rounds);
+
+    /* what the conversions alone used to cost through strtod */
+    start = clock();
+    for (i = 0; i < rounds; i++) {
+        for (p = json + 1, end = json + length - 1; p < end; p++) {
+            sum += strtod(p, &p);
+        }
+    }
+    strtod_ms = elapsed_ms(start) / rounds;
+
+    printf("  json_parse_into_n (whole parse) %10.2f ms %10.1f MB/s\n",
+           parse_ms, length / (1024.0 * 1024.0) / (parse_ms / 1000.0));
+    printf("  strtod over the same tokens     %10.2f ms %10.1f MB/s\n",
+           strtod_ms, length / (1024.0 * 1024.0) / (strtod_ms / 1000.0));
+    bench_sink = sum;
+
+    free(json);
+}
+
+/* stringify the numeric array; "%.17g" over the same values is the old formatter */
+static void bench_number_stringify(size_t records, int rounds) {
+    size_t length, out_length = 0, i, count;
+    char *json = generate_numbers(records, &length), number[32];
+    json_value value;
+    double stringify_ms, sprintf_ms;
+    clock_t start;
+    int r;
+
+    json_value_init(&value);
+    if (JSON_PARSE_OK != json_parse_n(&value, json, length)) {
+        fprintf(stderr, "json_parse_n failed\n");
+        exit(1);
+    }
+    count = json_get_array_size(&value);
+
+    start = clock();
+    for (r = 0; r < rounds; r++) {
+        free(json_stringify(&value, &out_length));
+    }
+    stringify_ms = elapsed_ms(start) / rounds;
+
+    start = clock();
+    for (r = 0; r < rounds; r++) {
+        for (i = 0; i < count; i++) {
+            bench_sink += sprintf(number, "%.17g", json_get_number(json_get_array_element(&value, i)));
+        }
+    }
+    sprintf_ms = elapsed_ms(start) / rounds;
+
+    printf("number stringify: %lu numbers, %.1f MB in, %.1f MB out\n",
+           (unsigned long)count, length / (1024.0 * 1024.0), out_length / (1024.0 * 1024.0));
+    printf("  json_stringify (shortest)   %10.2f ms %10.1f Mnum/s\n", stringify_ms, count / 1000.0 / stringify_ms);
+    printf("  sprintf(\"%%.17g\") alone    %10.2f ms %10.1f Mnum/s\n", sprintf_ms, count / 1000.0 / sprintf_ms);
+
+    json_value_free(&value);
+    free(json);
+}
+
+/* pulls every field out of wide objects, the way callers did before json_find_object_value */
+static json_value* find_linear(const json_value *o, const char *key, size_t len) {
+    size_t i;
+    for (i = 0; i < json_get_object_size(o); i++) {
+        if (json_get_object_key_length(o, i) == len && 0 == memcmp(json_get_object_key(o, i), key, len)) {
+            return json_get_object_value(o, i);
+        }
+    }
+    return NULL;
+}
+
+static void bench_lookup(int rounds) {
+    static const size_t widths[] = { 8, 64, 600 };
+    bench_buffer b;
+    char field[64];
+    json_value value;
+    size_t w, i, objects;
+    int r;
+
+    printf("lookup: every field of wide objects\n");
+    for (w = 0; w < sizeof(widths) / sizeof(widths[0]); w++) {
+        double linear_ms, find_ms, sum = 0.0;
+        clock_t start;
+
+        b.buf = NULL;
+        b.len = b.cap = 0;
+        objects = 400000 / widths[w];
+        buffer_append(&b, "[");
+        for (i = 0; i < objects; i++) {
+            size_t f;
+            buffer_append(&b, i ? ",{" : "{");
+            for (f = 0; f < widths[w]; f++) {
+                sprintf(field, "%s\"field_%lu\":%lu", f ? "," : "", (unsigned long)f, (unsigned long)f);
+                buffer_append(&b, field);
+            }
+            buffer_append(&b, "}");
+        }
+        buffer_append(&b, "]");
+
+        json_value_init(&value);
+        if (JSON_PARSE_OK != json_parse_n(&value, b.buf, b.len)) {
+            fprintf(stderr, "json_parse_n failed\n");
+            exit(1);
+        }
+
+        start = clock();
+        for (r = 0; r < rounds; r++) {
+            for (i = 0; i < objects; i++) {
+                const json_value *o = json_get_array_element(&value, i);
+                size_t f;
+                for (f = 0; f < widths[w]; f++) {
+                    sprintf(field, "field_%lu", (unsigned long)f);
+                    sum += json_get_number(find_linear(o, field, strlen(field)));
+                }
+            }
+        }
+        linear_ms = elapsed_ms(start) / rounds;
+
+        start = clock();
+        for (r = 0; r < rounds; r++) {
+            for (i = 0; i < objects; i++) {
+                const json_value *o = json_get_array_element(&value, i);
+                size_t f;
+                for (f = 0; f < widths[w]; f++) {
+                    sprintf(field, "field_%lu", (unsigned long)f);
+                    sum += json_get_number(json_find_object_value(o, field, strlen(field)));
+                }
+            }
+        }
+        find_ms = elapsed_ms(start) / rounds;
+
+        printf("  %4lu keys: linear scan %10.2f ms, json_find_object_value %10.2f ms\n",
+               (unsigned long)widths[w], linear_ms, find_ms);
+        bench_sink = sum;
+        json_value_free(&value);
+        free(b.buf);
+    }
+}
+
+/* counts the output and throws it away, as a socket would take it */
+static int discard_chunks(void *user, const json_chunk *chunks, size_t count) {
+    size_t i;
+
+    for (i = 0; i < count; i++) {
+        *(size_t *)user += chunks[i].len;
+    }
+    return 0;
+}
+
+static void bench_stringify(const char *json, size_t length, int rounds) {
+    json_value value;
+    double parse_ms, stringify_ms, writer_ms;
+    size_t out_length = 0, written = 0, allocs, bytes, writer_allocs, writer_bytes;
+    clock_t start;
+    int i;
+
+    json_value_init(&value);
+    start = clock();
+    for (i = 0; i < rounds; i++) {
+        json_value_free(&value);
+        if (JSON_PARSE_OK != json_parse_n(&value, json, length)) {
+            fprintf(stderr, "json_parse_n failed\n");
+            exit(1);
+        }
+    }
+    parse_ms = elapsed_ms(start) / rounds;
+
+    json_set_allocator(&count_allocator);
+    alloc_count = alloc_bytes = 0;
+    start = clock();
+    for (i = 0; i < rounds; i++) {
+        free(json_stringify(&value, &out_length));
+    }
+    stringify_ms = elapsed_ms(start) / rounds;
+    allocs = alloc_count / rounds;
+    bytes = alloc_bytes / rounds;
+
+    alloc_count = alloc_bytes = 0;
+    start = clock();
+    for (i = 0; i < rounds; i++) {
+        json_writer *writer = json_writer_create(discard_chunks, &written, 0);
+        json_writer_value(writer, &value);
+        json_writer_flush(writer);
+        json_writer_free(writer);
+    }
+    writer_ms = elapsed_ms(start) / rounds;
+    writer_allocs = alloc_count / rounds;
+    writer_bytes = alloc_bytes / rounds;
+    json_set_allocator(NULL);
+
+    printf("stringify: %.1f MB of records\n", length / (1024.0 * 1024.0));
+    printf("  json_parse_n   %10.2f ms %10.1f MB/s\n",
+           parse_ms, length / (1024.0 * 1024.0) / (parse_ms / 1000.0));
+    printf("  json_stringify %10.2f ms %10.1f MB/s %10lu allocations %10.1f MB\n",
+           stringify_ms, out_length / (1024.0 * 1024.0) / (stringify_ms / 1000.0), (unsigned long)allocs,
+           bytes / (1024.0 * 1024.0));
+    printf("  json_writer    %10.2f ms %10.1f MB/s %10lu allocations %10.1f MB\n",
+           writer_ms, written / rounds / (1024.0 * 1024.0) / (writer_ms / 1000.0), (unsigned long)writer_allocs,
+           writer_bytes / (1024.0 * 1024.0));
+
+    json_value_free(&value);
+}
+
+/* the records fed in 64 KB chunks, as they arrive off a socket */
+static void bench_stream(const char *json, size_t length, int rounds) {
+    json_stream *stream = json_stream_create();
+    json_value value;
+    double parse_ms, stream_ms;
+    clock_t start;
+    size_t i;
+    int r;
+
+    start = clock();
+    for (r = 0; r < rounds; r++) {
+        json_value_init(&value);
+        if (JSON_PARSE_OK != json_parse_n(&value, json, length)) {
+            fprintf(stderr, "json_parse_n failed\n");
+            exit(1);
+        }
+        json_value_free(&value);
+    }
+    parse_ms = elapsed_ms(start) / rounds;
+
+    start = clock();
+    for (r = 0; r < rounds; r++) {
+        for (i = 0; i < length; i += 65536) {
+            json_stream_feed(stream, json + i, length - i < 65536 ? length - i : 65536);
+        }
+        if (JSON_PARSE_OK != json_stream_finish(stream, &value)) {
+            fprintf(stderr, "json_stream_finish failed\n");
+            exit(1);
+        }
+        json_value_free(&value);
+    }
+    stream_ms = elapsed_ms(start) / rounds;
+    json_stream_free(stream);
+
+    printf("stream: %.1f MB in 64 KB chunks\n", length / (1024.0 * 1024.0));
+    printf("  json_parse_n (whole text)  %10.2f ms %10.1f MB/s\n",
+           parse_ms, length / (1024.0 * 1024.0) / (parse_ms / 1000.0));
+    printf("  json_stream_feed           %10.2f ms %10.1f MB/s\n",
+           stream_ms, length / (1024.0 * 1024.0) / (stream_ms / 1000.0));
+}
+
+/* a filter workload: count the records and sum their scores */
+typedef struct {
+    size_t records;
+    double score;
+    int in_score;
+} bench_filter;
+
+static int filter_key(void *user, const char *key, size_t len) {
+    ((bench_filter *)user)->in_score = 5 == len && 0 == memcmp(key, "score", 5);
+    return 0;
+}
+
+static int filter_number(void *user, const json_value *number) {
+    bench_filter *f = (bench_filter *)user;
+    if (f->in_score) {
+        f->score += json_get_number(number);
+    }
+    return 0;
+}
+
+static int filter_end_object(void *user, size_t size) {
+    ((bench_filter *)user)->records++;
+    (void)size;
+    return 0;
+}
+
+static void bench_sax(const char *json, size_t length, int rounds) {
+    static const json_sax_handler handler = {
+        NULL, NULL, filter_number, NULL, filter_key, NULL, filter_end_object, NULL, NULL
+    };
+    bench_filter f;
+    json_value value;
+    double tree_ms, sax_ms;
+    size_t tree_bytes, sax_bytes, i;
+    clock_t start;
+    int r;
+
+    json_set_allocator(&count_allocator);
+
+    alloc_bytes = 0;
+    start = clock();
+    for (r = 0; r < rounds; r++) {
+        f.records = 0;
+        f.score = 0.0;
+        json_value_init(&value);
+        if (JSON_PARSE_OK != json_parse_n(&value, json, length)) {
+            fprintf(stderr, "json_parse_n failed\n");
+            exit(1);
+        }
+        for (i = 0; i < json_get_array_size(&value); i++) {
+            f.records++;
+            f.score += json_get_number(json_find_object_value(json_get_array_element(&value, i), "score", 5));
+        }
+        json_value_free(&value);
+    }
+    tree_ms = elapsed_ms(start) / rounds;
+    tree_bytes = alloc_bytes / rounds;
+    bench_sink = f.score;
+
+    alloc_bytes = 0;
+    start = clock();
+    for (r = 0; r < rounds; r++) {
+        f.records = 0;
+        f.score = 0.0;
+        f.in_score = 0;
+        if (JSON_PARSE_OK != json_parse_sax(json, length, &handler, &f)) {
+            fprintf(stderr, "json_parse_sax failed\n");
+            exit(1);
+        }
+    }
+    sax_ms = elapsed_ms(start) / rounds;
+    sax_bytes = alloc_bytes / rounds;
+    bench_sink = f.score;
+
+    json_set_allocator(NULL);
+
+    printf("sax: count %lu records and sum a field\n", (unsigned long)f.records);
+    printf("  json_parse_n + lookups %10.2f ms %12lu bytes allocated\n", tree_ms, (unsigned long)tree_bytes);
+    printf("  json_parse_sax         %10.2f ms %12lu bytes allocated\n", sax_ms, (unsigned long)sax_bytes);
+}
+
+static int ndjson_line(void *user, size_t line, int error, json_value *value) {
+    if (JSON_PARSE_OK != error) {
+        fprintf(stderr, "line %lu: error %d\n", (unsigned long)line, error);
+        exit(1);
+    }
+    ++*(size_t *)user;
+    json_value_free(value);
+    return 0;
+}
+
+/* the records one per line, parsed on 1, 2, 4, ... workers up to the CPU count */
+static void bench_ndjson(size_t records, int rounds) {
+    bench_buffer b = { NULL, 0, 0 };
+    char record[256];
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    double base_ms = 0.0;
+    size_t i, lines = 0;
+    int threads, r;
+
+    for (i = 0; i < records; i++) {
+        sprintf(record,
+                "{\"id\":%lu,\"name\":\"user%lu\",\"tags\":[\"alpha\",\"beta\"],"
+                "\"score\":%lu.25,\"active\":%s,\"note\":\"line\\nbreak\",\"parent\":null}\n",
+                (unsigned long)i, (unsigned long)(i * 7), (unsigned long)(i % 1000), (i & 1) ? "true" : "false");
+        buffer_append(&b, record);
+    }
+
+    printf("ndjson: %lu lines, %.1f MB, %ld CPUs\n", (unsigned long)records, b.len / (1024.0 * 1024.0), cpus);
+    if (cpus < 1) {
+        cpus = 1;
+    }
+    for (threads = 1;; threads *= 2) {
+        double start, ms;
+        if (threads > cpus) {
+            threads = (int)cpus;
+        }
+        start = wall_ms();
+        for (r = 0; r < rounds; r++) {
+            json_parse_ndjson(b.buf, b.len, threads, NULL, ndjson_line, &lines);
+        }
+        ms = (wall_ms() - start) / rounds;
+        if (1 == threads) {
+            base_ms = ms;
+        }
+        printf("  %3d threads %10.2f ms %10.1f MB/s %6.2fx\n",
+               threads, ms, b.len / (1024.0 * 1024.0) / (ms / 1000.0), base_ms / ms);
+        if (threads >= cpus) {
+            break;
+        }
+    }
+    bench_sink = (double)lines;
+
+    free(b.buf);
+}
+
+/* the records from a file: fread into a buffer, then the mapped entry points */
+static void bench_file(const char *json, size_t length, int rounds) {
+    static const char *path = "json_parse_bench.tmp";
+    static const json_sax_handler handler = {
+        NULL, NULL, filter_number, NULL, filter_key, NULL, filter_end_object, NULL, NULL
+    };
+    FILE *file = fopen(path, "wb");
+    json_value value;
+    bench_filter f;
+    double start, read_ms, map_ms, sax_ms;
+    int r;
+
+    if (NULL == file || fwrite(json, 1, length, file) != length) {
+        fprintf(stderr, "cannot write %s\n", path);
+        exit(1);
+    }
+    fclose(file);
+
+    start = wall_ms();
+    for (r = 0; r < rounds; r++) {
+        char *buffer = (char *)malloc(length);
+        file = fopen(path, "rb");
+        if (fread(buffer, 1, length, file) != length || JSON_PARSE_OK != json_parse_n(&value, buffer, length)) {
+            fprintf(stderr, "fread + json_parse_n failed\n");
+            exit(1);
+        }
+        fclose(file);
+        free(buffer);
+        json_value_free(&value);
+    }
+    read_ms = (wall_ms() - start) / rounds;
+
+    start = wall_ms();
+    for (r = 0; r < rounds; r++) {
+        if (JSON_PARSE_OK != json_parse_file(&value, path)) {
+            fprintf(stderr, "json_parse_file failed\n");
+            exit(1);
+        }
+        json_value_free(&value);
+    }
+    map_ms = (wall_ms() - start) / rounds;
+
+    start = wall_ms();
+    for (r = 0; r < rounds; r++) {
+        f.records = 0;
+        f.score = 0.0;
+        f.in_score = 0;
+        if (JSON_PARSE_OK != json_parse_file_sax(path, &handler, &f)) {
+            fprintf(stderr, "json_parse_file_sax failed\n");
+            exit(1);
+        }
+    }
+    sax_ms = (wall_ms() - start) / rounds;
+    bench_sink = f.score;
+    remove(path);
+
+    printf("file: %.1f MB (page cache warm)\n", length / (1024.0 * 1024.0));
+    printf("  fread + json_parse_n  %10.2f ms\n", read_ms);
+    printf("  json_parse_file       %10.2f ms\n", map_ms);
+    printf("  json_parse_file_sax   %10.2f ms\n", sax_ms);
+}
+
+/* the records array parsed into a document on 1, 2, 4, ... workers up to the CPU count */
+static void bench_parallel(const char *json, size_t length, int rounds) {
+    json_document *doc = json_document_create();
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    double start, ms, base_ms;
+    int threads, r;
+
+    start = wall_ms();
+    for (r = 0; r < rounds; r++) {
+        if (JSON_PARSE_OK != json_parse_into_n(doc, json, length)) {
+            fprintf(stderr, "json_parse_into_n failed\n");
+            exit(1);
+        }
+    }
+    base_ms = (wall_ms() - start) / rounds;
+
+    printf("parallel: %.1f MB top-level array, %ld CPUs\n", length / (1024.0 * 1024.0), cpus);
+    printf("  json_parse_into_n        %10.2f ms %10.1f MB/s\n",
+           base_ms, length / (1024.0 * 1024.0) / (base_ms / 1000.0));
+    if (cpus < 1) {
+        cpus = 1;
+    }
+    for (threads = 1;; threads *= 2) {
+        if (threads > cpus) {
+            threads = (int)cpus;
+        }
+        start = wall_ms();
+        for (r = 0; r < rounds; r++) {
+            if (JSON_PARSE_OK != json_parse_into_parallel(doc, json, length, threads, NULL)) {
+                fprintf(stderr, "json_parse_into_parallel failed\n");
+                exit(1);
+            }
+        }
+        ms = (wall_ms() - start) / rounds;
+        printf("  %3d threads              %10.2f ms %10.1f MB/s %6.2fx\n",
+               threads, ms, length / (1024.0 * 1024.0) / (ms / 1000.0), base_ms / ms);
+        if (threads >= cpus) {
+            break;
+        }
+    }
+
+    json_document_free(doc);
+}
+
+/* wide records of 200 fields, half of them nested, of which a reader wants 3 */
+static char* generate_wide_records(size_t count, size_t *length) {
+    bench_buffer b = { NULL, 0, 0 };
+    char field[128];
+    size_t i, j;
+
+    buffer_append(&b, "[");
+    for (i = 0; i < count; i++) {
+        buffer_append(&b, i ? ",{" : "{");
+        for (j = 0; j < 200; j++) {
+            if (j % 2) {
+                sprintf(field, "%s\"f%lu\":{\"v\":[%lu,%lu.5,\"x%lu\"],\"ok\":true}", j ? "," : "",
+                        (unsigned long)j, (unsigned long)i, (unsigned long)j, (unsigned long)j);
+            } else {
+                sprintf(field, "%s\"f%lu\":%lu", j ? "," : "", (unsigned long)j, (unsigned long)(i + j));
+            }
+            buffer_append(&b, field);
+        }
+        buffer_append(&b, "}");
+    }
+    buffer_append(&b, "]");
+
+    *length = b.len;
+    return b.buf;
+}
+
+static double sum_wide_fields(json_document *doc) {
+    const json_value *root = json_document_root(doc);
+    double sum = 0.0;
+    size_t i;
+
+    for (i = 0; i < json_get_array_size(root); i++) {
+        const json_value *record = json_get_array_element(root, i);
+        sum += json_get_number(json_find_object_value(record, "f10", 3));
+        sum += json_get_number(json_find_object_value(record, "f150", 4));
+        sum += json_get_number(json_get_array_element(json_find_object_value(
+            json_find_object_value(record, "f77", 3), "v", 1), 1));
+    }
+    return sum;
+}
+
+static void bench_lazy(size_t records, int rounds) {
+    json_parse_options options;
+    json_document *doc = json_document_create();
+    size_t length;
+    char *json = generate_wide_records(records / 50, &length);
+    double eager_ms, lazy_ms, sum = 0.0;
+    clock_t start;
+    int r;
+
+    options.flags = 0;
+    start = clock();
+    for (r = 0; r < rounds; r++) {
+        json_parse_into_ex(doc, json, length, &options);
+        sum = sum_wide_fields(doc);
+    }
+    eager_ms = elapsed_ms(start) / rounds;
+    bench_sink = sum;
+
+    options.flags = JSON_PARSE_LAZY;
+    start = clock();
+    for (r = 0; r < rounds; r++) {
+        json_parse_into_ex(doc, json, length, &options);
+        sum = sum_wide_fields(doc);
+    }
+    lazy_ms = elapsed_ms(start) / rounds;
+    bench_sink = sum;
+
+    printf("lazy: %lu records of 200 fields, %.1f MB, 3 fields read per record\n",
+           (unsigned long)(records / 50), length / (1024.0 * 1024.0));
+    printf("  json_parse_into_ex             %10.2f ms\n", eager_ms);
+    printf("  json_parse_into_ex lazy        %10.2f ms\n", lazy_ms);
+
+    json_document_free(doc);
+    free(json);
+}
+
+static double time_tree_parse(const char *json, size_t length, int rounds) {
+    clock_t start = clock();
+    int i;
+
+    for (i = 0; i < rounds; i++) {
+        json_value value;
+        json_value_init(&value);
+        if (JSON_PARSE_OK != json_parse_n(&value, json, length)) {
+            fprintf(stderr, "json_parse_n failed\n");
+            exit(1);
+        }
+        json_value_free(&value);
+    }
+
+    return elapsed_ms(start) / rounds;
+}
+
+static double time_tape_parse(json_tape *tape, const char *json, size_t length, int rounds) {
+    clock_t start = clock();
+    int i;
+
+    for (i = 0; i < rounds; i++) {
+        if (JSON_PARSE_OK != json_parse_tape(tape, json, length)) {
+            fprintf(stderr, "json_parse_tape failed\n");
+            exit(1);
+        }
+    }
+
+    return elapsed_ms(start) / rounds;
+}
+
+static void bench_tape(const char *json, size_t length, size_t records, int rounds) {
+    json_tape *tape = json_tape_create();
+    json_tape_ref record;
+    json_value value, number;
+    size_t pretty_length, i;
+    char *pretty = generate_pretty_records(records, &pretty_length);
+    double tree_ms, tape_ms, score = 0.0;
+    clock_t start;
+    int r;
+
+    printf("tape: %.1f MB compact, %.1f MB pretty-printed\n",
+           length / (1024.0 * 1024.0), pretty_length / (1024.0 * 1024.0));
+    printf("  compact json_parse_n          %10.2f ms\n", time_tree_parse(json, length, rounds));
+    printf("  compact json_parse_into_n     %10.2f ms\n", time_parse(json, length, rounds));
+    printf("  compact json_parse_tape       %10.2f ms\n", time_tape_parse(tape, json, length, rounds));
+    printf("  pretty  json_parse_n          %10.2f ms\n", time_tree_parse(pretty, pretty_length, rounds));
+    printf("  pretty  json_parse_into_n     %10.2f ms\n", time_parse(pretty, pretty_length, rounds));
+    printf("  pretty  json_parse_tape       %10.2f ms\n", time_tape_parse(tape, pretty, pretty_length, rounds));
+
+    /* parse, then sum one field of every record */
+    start = clock();
+    for (r = 0; r < rounds; r++) {
+        json_value_init(&value);
+        json_parse_n(&value, json, length);
+        score = 0.0;
+        for (i = 0; i < json_get_array_size(&value); i++) {
+            score += json_get_number(json_find_object_value(json_get_array_element(&value, i), "score", 5));
+        }
+        json_value_free(&value);
+    }
+    tree_ms = elapsed_ms(start) / rounds;
+    bench_sink = score;
+
+    start = clock();
+    for (r = 0; r < rounds; r++) {
+        json_parse_tape(tape, json, length);
+        score = 0.0;
+        for (record = json_tape_first(tape, json_tape_root(tape)); 0 != record; record = json_tape_next(tape, record)) {
+            json_tape_get_number(tape, json_tape_find_object_value(tape, record, "score", 5), &number);
+            score += json_get_number(&number);
+        }
+    }
+    tape_ms = elapsed_ms(start) / rounds;
+    bench_sink = score;
+
+    printf("  parse + sum a field: tree %10.2f ms, tape %10.2f ms\n", tree_ms, tape_ms);
+
+    json_tape_free(tape);
+    free(pretty);
+}
+
+/* touches every node: numbers, string and key bytes, container sizes */
+static double walk_tree(const json_value *value) {
+    double sum = 0.0;
+    size_t i, n;
+
+    switch (json_get_type(value)) {
+        case JSON_NUMBER:
+            return json_get_number(value);
+        case JSON_STRING:
+            n = json_get_string_length(value);
+            return n ? (double)(unsigned char)json_get_string(value)[n - 1] : 0.0;
+        case JSON_ARRAY:
+            n = json_get_array_size(value);
+            for (i = 0; i < n; i++) {
+                sum += walk_tree(json_get_array_element(value, i));
+            }
+            return sum + (double)n;
+        case JSON_OBJECT:
+            n = json_get_object_size(value);
+            for (i = 0; i < n; i++) {
+                sum += (double)(unsigned char)json_get_object_key(value, i)[0];
+                sum += walk_tree(json_get_object_value(value, i));
+            }
+            return sum + (double)n;
+        default:
+            return 1.0;
+    }
+}
+
+static void bench_traverse(const char *json, size_t length, int rounds) {
+    json_document *doc = json_document_create();
+    json_value value;
+    double malloc_ms, arena_ms, find_ms, sum = 0.0;
+    size_t i, n;
+    clock_t start;
+    int r;
+
+    json_value_init(&value);
+    if (JSON_PARSE_OK != json_parse_n(&value, json, length) ||
+        JSON_PARSE_OK != json_parse_into_n(doc, json, length)) {
+        fprintf(stderr, "parse failed\n");
+        exit(1);
+    }
+
+    start = clock();
+    for (r = 0; r < rounds; r++) {
+        sum += walk_tree(&value);
+    }
+    malloc_ms = elapsed_ms(start) / rounds;
+
+    start = clock();
+    for (r = 0; r < rounds; r++) {
+        sum += walk_tree(json_document_root(doc));
+    }
+    arena_ms = elapsed_ms(start) / rounds;
+
+    n = json_get_array_size(&value);
+    start = clock();
+    for (r = 0; r < rounds; r++) {
+        for (i = 0; i < n; i++) {
+            const json_value *record = json_get_array_element(&value, i);
+            sum += json_get_string_length(json_find_object_value(record, "name", 4));
+            sum += json_get_number(json_find_object_value(record, "score", 5));
+        }
+    }
+    find_ms = elapsed_ms(start) / rounds;
+    bench_sink = sum;
+
+    printf("traverse: json_value %lu bytes, json_member %lu bytes\n",
+           (unsigned long)sizeof(json_value), (unsigned long)sizeof(json_member));
+    printf("  walk json_parse_n tree           %10.2f ms\n", malloc_ms);
+    printf("  walk json_parse_into_n tree      %10.2f ms\n", arena_ms);
+    printf("  find 2 keys per record           %10.2f ms\n", find_ms);
+
+    json_value_free(&value);
+    json_document_free(doc);
+}
+
+/* records sharing 20 key names, most too long to be stored inline */
+static char* generate_keyed_records(size_t count, size_t *length) {
+    static const char *keys[] = {
+        "transaction_id", "customer_account", "merchant_category", "amount", "currency_code",
+        "authorization_code", "terminal_identifier", "created_timestamp", "settled_timestamp", "status",
+        "card_network", "card_last_four", "billing_country", "shipping_country", "risk_score",
+        "risk_decision", "installment_count", "reference", "channel", "is_recurring"
+    };
+    bench_buffer b = { NULL, 0, 0 };
+    char field[128];
+    size_t i, j;
+
+    buffer_append(&b, "[");
+    for (i = 0; i < count; i++) {
+        buffer_append(&b, i ? ",{" : "{");
+        for (j = 0; j < 20; j++) {
+            sprintf(field, "%s\"%s\":%lu", j ? "," : "", keys[j], (unsigned long)(i * 20 + j) % 9973);
+            buffer_append(&b, field);
+        }
+        buffer_append(&b, "}");
+    }
+    buffer_append(&b, "]");
+
+    *length = b.len;
+    return b.buf;
+}
+
+static void bench_intern(size_t records, int rounds) {
+    json_parse_options options;
+    json_key_table *table = json_key_table_create();
+    json_value value;
+    size_t length, i, bytes[2], allocs[2];
+    char *json = generate_keyed_records(records / 4, &length);
+    const char *amount, *status, *risk;
+    double parse_ms[2], find_ms, interned_ms, sum = 0.0;
+    clock_t start;
+    int r, interned;
+
+    json_set_allocator(&count_allocator);
+    for (interned = 0; interned < 2; interned++) {
+        options.flags = interned ? JSON_PARSE_INTERN_KEYS : 0;
+        options.keys = table;
+        alloc_count = alloc_bytes = 0;
+        start = clock();
+        for (r = 0; r < rounds; r++) {
+            json_value_init(&value);
+            if (JSON_PARSE_OK != json_parse_ex(&value, json, length, &options)) {
+                fprintf(stderr, "json_parse_ex failed\n");
+                exit(1);
+            }
+            json_value_free(&value);
+        }
+        parse_ms[interned] = elapsed_ms(start) / rounds;
+        allocs[interned] = alloc_count / rounds;
+        bytes[interned] = alloc_bytes / rounds;
+    }
+    json_set_allocator(NULL);
+
+    json_value_init(&value);
+    json_parse_ex(&value, json, length, &options);
+    amount = json_key_table_intern(table, "amount", 6);
+    status = json_key_table_intern(table, "status", 6);
+    risk = json_key_table_intern(table, "risk_score", 10);
+
+    start = clock();
+    for (r = 0; r < rounds; r++) {
+        for (i = 0; i < json_get_array_size(&value); i++) {
+            const json_value *o = json_get_array_element(&value, i);
+            sum += json_get_number(json_find_object_value(o, "amount", 6));
+            sum += json_get_number(json_find_object_value(o, "status", 6));
+            sum += json_get_number(json_find_object_value(o, "risk_score", 10));
+        }
+    }
+    find_ms = elapsed_ms(start) / rounds;
+
+    start = clock();
+    for (r = 0; r < rounds; r++) {
+        for (i = 0; i < json_get_array_size(&value); i++) {
+            const json_value *o = json_get_array_element(&value, i);
+            sum += json_get_number(json_find_interned_value(o, amount));
+            sum += json_get_number(json_find_interned_value(o, status));
+            sum += json_get_number(json_find_interned_value(o, risk));
+        }
+    }
+    interned_ms = elapsed_ms(start) / rounds;
+    bench_sink = sum;
+
+    printf("intern: %lu records of 20 keys, %.1f MB, %lu distinct keys\n", (unsigned long)(records / 4),
+           length / (1024.0 * 1024.0), (unsigned long)json_key_table_size(table));
+    printf("  json_parse_ex                  %10.2f ms %10lu allocations %10.1f MB\n",
+           parse_ms[0], (unsigned long)allocs[0], bytes[0] / (1024.0 * 1024.0));
+    printf("  json_parse_ex interned keys    %10.2f ms %10lu allocations %10.1f MB\n",
+           parse_ms[1], (unsigned long)allocs[1], bytes[1] / (1024.0 * 1024.0));
+    printf("  find 3 keys: bytes %10.2f ms, pointers %10.2f ms\n", find_ms, interned_ms);
+
+    json_value_free(&value);
+    json_key_table_free(table);
+    free(json);
+}
+
+/* one small message after another, each parsed on its own */
+static void bench_parser(size_t records, int rounds) {
+    static const char *names[] = {
+        "json_parse_n + json_value_free", "json_parser_parse + free", "json_parse_into_n, one document",
+        "json_parser_parse_into"
+    };
+    json_parser *parser = json_parser_create(NULL);
+    json_document *doc = json_document_create();
+    size_t length, *offsets = (size_t *)malloc((records + 1) * sizeof(size_t)), i, n = 0;
+    char *json = generate_records(records, &length);
+    char *p;
+    int r, mode;
+
+    /* cut the array into its records */
+    for (p = json + 1; p < json + length - 1; p = strchr(p, '}') + 2) {
+        offsets[n++] = p - json;
+    }
+    offsets[n] = length + 1;
+
+    printf("parser: %lu messages of about %lu bytes\n", (unsigned long)n, (unsigned long)(length / n));
+    json_set_allocator(&count_allocator);
+    for (mode = 0; mode < 4; mode++) {
+        clock_t start = clock();
+        alloc_count = 0;
+        for (r = 0; r < rounds; r++) {
+            for (i = 0; i < n; i++) {
+                const char *message = json + offsets[i];
+                size_t message_length = offsets[i + 1] - offsets[i] - 1;
+                json_value value;
+                int ret;
+                json_value_init(&value);
+                switch (mode) {
+                    case 0:
+                        ret = json_parse_n(&value, message, message_length);
+                        json_value_free(&value);
+                        break;
+                    case 1:
+                        ret = json_parser_parse(parser, &value, message, message_length, NULL);
+                        json_value_free(&value);
+                        break;
+                    case 2:
+                        ret = json_parse_into_n(doc, message, message_length);
+                        break;
+                    default:
+                        ret = json_parser_parse_into(parser, message, message_length, NULL);
+                        break;
+                }
+                if (JSON_PARSE_OK != ret) {
+                    fprintf(stderr, "%s failed\n", names[mode]);
+                    exit(1);
+                }
+            }
+        }
+        printf("  %-32s %10.2f ms %10.2f allocations per message\n", names[mode],
+               elapsed_ms(start) / rounds, (double)alloc_count / rounds / n);
+    }
+    json_set_allocator(NULL);
+
+    json_document_free(doc);
+    json_parser_free(parser);
+    free(offsets);
+    free(json);
+}
+
+static int sum_path_value(void *user, json_value *value) {
+    *(double *)user += json_get_number(value);
+    json_value_free(value);
+    return 0;
+}
+
+static void bench_path(const char *json, size_t length, int rounds) {
+    json_path *pointer = json_path_compile_pointer("/tags/1", 7);
+    json_path *scores = json_path_compile("$[*].score", 10);
+    json_value value;
+    double hand_ms, path_ms, tree_ms, stream_ms, sum = 0.0;
+    size_t i, n;
+    clock_t start;
+    int r;
+
+    json_value_init(&value);
+    json_parse_n(&value, json, length);
+    n = json_get_array_size(&value);
+
+    start = clock();
+    for (r = 0; r < rounds; r++) {
+        for (i = 0; i < n; i++) {
+            const json_value *tags = json_find_object_value(json_get_array_element(&value, i), "tags", 4);
+            sum += json_get_string_length(json_get_array_element(tags, 1));
+        }
+    }
+    hand_ms = elapsed_ms(start) / rounds;
+
+    start = clock();
+    for (r = 0; r < rounds; r++) {
+        for (i = 0; i < n; i++) {
+            sum += json_get_string_length(json_path_find(pointer, json_get_array_element(&value, i)));
+        }
+    }
+    path_ms = elapsed_ms(start) / rounds;
+    json_value_free(&value);
+
+    /* one field of every record, from the text */
+    start = clock();
+    for (r = 0; r < rounds; r++) {
+        json_value_init(&value);
+        json_parse_n(&value, json, length);
+        for (i = 0; i < n; i++) {
+            sum += json_get_number(json_find_object_value(json_get_array_element(&value, i), "score", 5));
+        }
+        json_value_free(&value);
+    }
+    tree_ms = elapsed_ms(start) / rounds;
+
+    start = clock();
+    for (r = 0; r < rounds; r++) {
+        if (JSON_PARSE_OK != json_parse_path(json, length, scores, NULL, sum_path_value, &sum)) {
+            fprintf(stderr, "json_parse_path failed\n");
+            exit(1);
+        }
+    }
+    stream_ms = elapsed_ms(start) / rounds;
+    bench_sink = sum;
+
+    printf("path: /tags/1 of %lu records, $[*].score of %.1f MB\n", (unsigned long)n, length / (1024.0 * 1024.0));
+    printf("  by hand                        %10.2f ms\n", hand_ms);
+    printf("  json_path_find                 %10.2f ms\n", path_ms);
+    printf("  json_parse_n + lookups         %10.2f ms\n", tree_ms);
+    printf("  json_parse_path                %10.2f ms\n", stream_ms);
+
+    json_path_free(pointer);
+    json_path_free(scores);
+}
+
+/* the wide records again, three fields wanted out of 200 */
+static void bench_projected(size_t records, int rounds) {
+    static const char *names[] = { "json_parse_n + json_value_free", "json_parse_projected + free" };
+    static const char *paths[] = { "$[*].f10", "$[*].f150", "$[*].f77.v[1]" };
+    json_field_set *fields = json_field_set_create();
+    size_t length, i;
+    char *json = generate_wide_records(records / 50, &length);
+    int r, mode;
+
+    for (i = 0; i < sizeof(paths) / sizeof(paths[0]); i++) {
+        json_path *path = json_path_compile(paths[i], strlen(paths[i]));
+        json_field_set_add(fields, path);
+        json_path_free(path);
+    }
+
+    printf("projected: %lu records of 200 fields, %.1f MB, 3 fields kept per record\n",
+           (unsigned long)(records / 50), length / (1024.0 * 1024.0));
+    json_set_allocator(&count_allocator);
+    for (mode = 0; mode < 2; mode++) {
+        clock_t start = clock();
+        double sum = 0.0;
+        alloc_count = alloc_bytes = 0;
+        for (r = 0; r < rounds; r++) {
+            json_value value;
+            int ret;
+            json_value_init(&value);
+            ret = 0 == mode ? json_parse_n(&value, json, length)
+                            : json_parse_projected(&value, json, length, fields, NULL);
+            if (JSON_PARSE_OK != ret) {
+                fprintf(stderr, "%s failed\n", names[mode]);
+                exit(1);
+            }
+            for (i = 0; i < json_get_array_size(&value); i++) {
+                sum += json_get_number(json_find_object_value(json_get_array_element(&value, i), "f150", 4));
+            }
+            json_value_free(&value);
+        }
+        bench_sink = sum;
+        printf("  %-32s %10.2f ms %10lu allocations %10.1f MB\n", names[mode], elapsed_ms(start) / rounds,
+               (unsigned long)(alloc_count / rounds), alloc_bytes / (double)rounds / (1024.0 * 1024.0));
+    }
+    json_set_allocator(NULL);
+
+    json_field_set_free(fields);
+    free(json);
+}
+
+static void bench_document(const char *json, size_t length, int rounds) {
+    clock_t start;
+    int i;
+    double malloc_ms, arena_ms;
+    size_t malloc_allocs, arena_allocs;
+
+    json_set_allocator(&count_allocator);
+
+    alloc_count = free_count = 0;
+    start = clock();
+    for (i = 0; i < rounds; i++) {
+        json_value value;
+        json_value_init(&value);
+        if (JSON_PARSE_OK != json_parse(&value, json)) {
+            fprintf(stderr, "json_parse failed\n");
+            exit(1);
+        }
+        json_value_free(&value);
+    }
+    malloc_ms = elapsed_ms(start) / rounds;
+    malloc_allocs = alloc_count / rounds;
+
+    alloc_count = free_count = 0;
+    start = clock();
+    for (i = 0; i < rounds; i++) {
+        json_document *doc = json_document_create();
+        if (JSON_PARSE_OK != json_parse_into(doc, json)) {
+            fprintf(stderr, "json_parse_into failed\n");
+            exit(1);
+        }
+        json_document_free(doc);
+    }
+    arena_ms = elapsed_ms(start) / rounds;
+    arena_allocs = alloc_count / rounds;
+
+    json_set_allocator(NULL);
+
+    printf("document: %.1f MB input\n", length / (1024.0 * 1024.0));
+    printf("  json_parse + json_value_free     %10.2f ms %10lu allocations\n",
+           malloc_ms, (unsigned long)malloc_allocs);
+    printf("  json_parse_into + document_free  %10.2f ms %10lu allocations\n",
+           arena_ms, (unsigned long)arena_allocs);
+}
+
+int main(int argc, char const *argv[]) {
+    size_t records = argc > 1 ? (size_t)atol(argv[1]) : 200000;
+    int rounds = argc > 2 ? atoi(argv[2]) : 3;
+    size_t length;
+    char *json = generate_records(records, &length);
+
+    bench_document(json, length, rounds);
+    bench_traverse(json, length, rounds);
+    bench_stringify(json, length, rounds);
+    bench_stream(json, length, rounds);
+    bench_sax(json, length, rounds);
+    bench_ndjson(records, rounds);
+    bench_file(json, length, rounds);
+    bench_parallel(json, length, rounds);
+    bench_tape(json, length, records, rounds);
+    bench_lazy(records, rounds);
+    bench_intern(records, rounds);
+    bench_parser(records, rounds);
+    bench_path(json, length, rounds);
+    bench_projected(records, rounds);
+    bench_whitespace(records, rounds);
+    bench_strings(records, rounds);
+    bench_utf8(records, rounds);
+    bench_numbers(records, rounds);
+    bench_number_stringify(records, rounds);
+    bench_lookup(rounds);
+
+    free(json);
+    return 0;
+}
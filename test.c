@@ -21,6 +21,8 @@ static int test_pass = 0;
 #define EXPECT_TRUE(actual) EXPECT_EQ_BASE((actual) != 0, "true", "false", "%s")
 #define EXPECT_EQ_SIZE_T(expect, actual) EXPECT_EQ_BASE((expect) == (actual), expect, actual, "%lu")
 #define EXPECT_EQ_INT(expect, actual) EXPECT_EQ_BASE((expect) == (actual), expect, actual, "%d")
+#define EXPECT_EQ_INT64(expect, actual) EXPECT_EQ_BASE((expect) == (actual), (long)(expect), (long)(actual), "%ld")
+#define EXPECT_EQ_UINT64(expect, actual) EXPECT_EQ_BASE((expect) == (actual), (unsigned long)(expect), (unsigned long)(actual), "%lu")
 #define EXPECT_EQ_DOUBLE(expect, actual) EXPECT_EQ_BASE((expect) == (actual), expect, actual, "%f")
 #define EXPECT_EQ_STRING(expect, actual, alength) \
     EXPECT_EQ_BASE(sizeof(expect) - 1 == (alength) && memcmp(expect, actual, alength) == 0, expect, actual, "%s")
@@ -72,6 +74,147 @@ static void test_parse_number() {
     TEST_NUMBER(0.0, "1e-10000"); /* must underflow */
 }
 
+/* parse results must be bit-identical to the correctly rounded strtod */
+static void test_number_against_strtod(const char *json) {
+    json_value value;
+    double expect = strtod(json, NULL), actual = 0.0;
+
+    json_value_init(&value);
+    if (JSON_PARSE_OK == json_parse(&value, json)) {
+        actual = json_get_number(&value);
+    }
+    EXPECT_EQ_BASE(0 == memcmp(&expect, &actual, sizeof(double)), json, json, "%s");
+}
+
+static unsigned long test_random_state = 20161017;
+
+static unsigned long test_random() {
+    test_random_state = test_random_state * 1103515245 + 12345;
+    return (test_random_state >> 16) & 0x7FFF;
+}
+
+static void test_parse_number_roundtrip() {
+    static const char *boundaries[] = {
+        "2.2250738585072011e-308", "2.2250738585072012e-308", "2.2250738585072014e-308",
+        "4.9406564584124654e-324", "2.4703282292062327e-324", "2.4703282292062328e-324",
+        "1.7976931348623157e308", "1.7976931348623158e308", "1.7976931348623159e308",
+        "9007199254740993", "9007199254740992.5", "18446744073709551615", "18446744073709551616",
+        "0.1000000000000000055511151231257827021181583404541015625",
+        "0.1000000000000000055511151231257827021181583404541015624",
+        "0.1000000000000000055511151231257827021181583404541015626",
+        "2.470328229206232720882538e-324", "7.2057594037927933e16", "1e23", "8.988465674311579e307",
+        "123456789012345678901234567890e-30", "0.00000000000000000000000000000000001",
+        "1e-400", "1e400", "-1e400", "0e99999", "1e-99999", "1.5e-7", "-0.0e+00"
+    };
+    char json[128];
+    size_t i;
+
+    for (i = 0; i < sizeof(boundaries) / sizeof(boundaries[0]); i++) {
+        test_number_against_strtod(boundaries[i]);
+    }
+
+    /* random bit patterns printed at random precisions */
+    for (i = 0; i < 5000; i++) {
+        unsigned char bytes[sizeof(double)];
+        double d;
+        size_t j;
+
+        for (j = 0; j < sizeof(bytes); j++) {
+            bytes[j] = (unsigned char)test_random();
+        }
+        memcpy(&d, bytes, sizeof(d));
+        if (d != d || d - d != 0.0) {
+            continue; /* NaN and infinities are not JSON */
+        }
+        sprintf(json, "%.17g", d);
+        test_number_against_strtod(json);
+        sprintf(json, "%.*e", (int)(test_random() % 17), d);
+        test_number_against_strtod(json);
+    }
+
+    /* long mantissas beyond 19 digits with random exponents */
+    for (i = 0; i < 5000; i++) {
+        size_t digits = 1 + test_random() % 40, point = test_random() % (digits + 1), j;
+        char *p = json;
+
+        *p++ = '1' + test_random() % 9;
+        for (j = 1; j < digits; j++) {
+            if (j == point) {
+                *p++ = '.';
+            }
+            *p++ = '0' + test_random() % 10;
+        }
+        sprintf(p, "e%d", (int)(test_random() % 700) - 360);
+        test_number_against_strtod(json);
+    }
+}
+
+#define TEST_INT64(expect, json) \
+    do {\
+        json_value value;\
+        json_value_init(&value);\
+        EXPECT_EQ_INT(JSON_PARSE_OK, json_parse(&value, json));\
+        EXPECT_EQ_INT(JSON_NUMBER, json_get_type(&value));\
+        EXPECT_TRUE(json_is_int64(&value));\
+        EXPECT_EQ_INT64(expect, json_get_int64(&value));\
+    } while(0)
+
+#define TEST_UINT64(expect, json) \
+    do {\
+        json_value value;\
+        json_value_init(&value);\
+        EXPECT_EQ_INT(JSON_PARSE_OK, json_parse(&value, json));\
+        EXPECT_EQ_INT(JSON_NUMBER, json_get_type(&value));\
+        EXPECT_TRUE(!json_is_int64(&value) && json_is_uint64(&value));\
+        EXPECT_EQ_UINT64(expect, json_get_uint64(&value));\
+    } while(0)
+
+#define TEST_NOT_INTEGER(json) \
+    do {\
+        json_value value;\
+        json_value_init(&value);\
+        EXPECT_EQ_INT(JSON_PARSE_OK, json_parse(&value, json));\
+        EXPECT_EQ_INT(JSON_NUMBER, json_get_type(&value));\
+        EXPECT_TRUE(!json_is_int64(&value) && !json_is_uint64(&value));\
+    } while(0)
+
+static void test_parse_integer() {
+    json_value value;
+
+    TEST_INT64(0, "0");
+    TEST_INT64(-1, "-1");
+    TEST_INT64(1234567890123456789, "1234567890123456789");
+    TEST_INT64(9007199254740993, "9007199254740993"); /* 2^53 + 1, not a double */
+    TEST_INT64(INT64_MAX, "9223372036854775807");
+    TEST_INT64(INT64_MIN, "-9223372036854775808");
+    TEST_UINT64((uint64_t)INT64_MAX + 1, "9223372036854775808");
+    TEST_UINT64(UINT64_MAX, "18446744073709551615");
+
+    TEST_NOT_INTEGER("-0");
+    TEST_NOT_INTEGER("1.0");
+    TEST_NOT_INTEGER("1e3");
+    TEST_NOT_INTEGER("18446744073709551616");
+    TEST_NOT_INTEGER("-9223372036854775809");
+    TEST_NOT_INTEGER("100000000000000000000");
+
+    TEST_NUMBER(9007199254740992.0, "9007199254740993");
+    TEST_NUMBER(18446744073709551615.0, "18446744073709551615");
+
+    json_value_init(&value);
+    json_set_int64(&value, -42);
+    EXPECT_EQ_INT64(-42, json_get_int64(&value));
+    EXPECT_EQ_DOUBLE(-42.0, json_get_number(&value));
+    EXPECT_TRUE(!json_is_uint64(&value));
+    json_set_uint64(&value, 42);
+    EXPECT_TRUE(json_is_int64(&value));
+    EXPECT_EQ_UINT64(42, json_get_uint64(&value));
+    json_set_uint64(&value, UINT64_MAX);
+    EXPECT_TRUE(!json_is_int64(&value));
+    EXPECT_EQ_UINT64(UINT64_MAX, json_get_uint64(&value));
+    json_set_number(&value, 1.5);
+    EXPECT_TRUE(!json_is_int64(&value) && !json_is_uint64(&value));
+}
+
 #define TEST_ERROR(expect, json) \
     do {\
         json_value value;\
@@ -87,6 +230,8 @@ static void test_parse_invalid_number() {
     TEST_ERROR(JSON_PARSE_INVALID_VALUE, "+1");
     TEST_ERROR(JSON_PARSE_INVALID_VALUE, ".123"); /* at least one digit before '.' */
     TEST_ERROR(JSON_PARSE_INVALID_VALUE, "1.");   /* at least one digit after '.' */
+    TEST_ERROR(JSON_PARSE_INVALID_VALUE, "1e");   /* at least one digit in exponent */
+    TEST_ERROR(JSON_PARSE_INVALID_VALUE, "1e+");
     TEST_ERROR(JSON_PARSE_INVALID_VALUE, "INF");
     TEST_ERROR(JSON_PARSE_INVALID_VALUE, "inf");
     TEST_ERROR(JSON_PARSE_INVALID_VALUE, "NAN");
@@ -113,6 +258,7 @@ static void test_parse_string() {
     TEST_STRING("\xE2\x82\xAC", "\"\\u20AC\""); /* Euro sign U+20AC */
     TEST_STRING("\xF0\x9D\x84\x9E", "\"\\uD834\\uDD1E\"");  /* G clef sign U+1D11E */
     TEST_STRING("\xF0\x9D\x84\x9E", "\"\\ud834\\udd1e\"");  /* G clef sign U+1D11E */
+    TEST_STRING("\xF0\x9F\x98\x80", "\"\\uD83D\\uDE00\"");  /* grinning face U+1F600 */
 }
 
 static void test_access_number() {
@@ -136,6 +282,17 @@ static void test_access_string() {
 
     EXPECT_EQ_SIZE_T((size_t)4 ,json_get_string_length(&value));
 
+    /* moving across the inline limit in both directions */
+    json_set_string(&value, "twelve bytes", 12);
+    EXPECT_EQ_STRING("twelve bytes", json_get_string(&value), 12);
+    json_set_string(&value, "eleven byte", 11);
+    EXPECT_EQ_STRING("eleven byte", json_get_string(&value), 11);
+    EXPECT_TRUE(json_get_string(&value) == (const char *)&value);
+    json_set_string(&value, "a\0b", 3);
+    EXPECT_EQ_STRING("a\0b", json_get_string(&value), 3);
+    json_set_string(&value, "long enough to need its own block", 33);
+    EXPECT_EQ_STRING("long enough to need its own block", json_get_string(&value), 33);
+
     json_set_null(&value);
 }
 
@@ -304,6 +461,1458 @@ static void test_parse_object() {
     json_value_free(&v);
 }
 
+#define TEST_PARSE_N(expect, json, len) \
+    do {\
+        json_value value;\
+        json_value_init(&value);\
+        EXPECT_EQ_INT(expect, json_parse_n(&value, json, len));\
+        json_value_free(&value);\
+    } while (0)
+
+static void test_parse_n() {
+    json_value value;
+    /* none of these buffers is terminated at len */
+    const char buffer[] = { '[', '1', ',', '"', 'a', 'b', '"', ']', '9', '9' };
+    const char string_with_nul[] = { '"', 'a', '\0', 'b', '"' };
+
+    json_value_init(&value);
+    EXPECT_EQ_INT(JSON_PARSE_OK, json_parse_n(&value, buffer, 8));
+    EXPECT_EQ_SIZE_T((size_t)2, json_get_array_size(&value));
+    EXPECT_EQ_DOUBLE(1.0, json_get_number(json_get_array_element(&value, 0)));
+    EXPECT_EQ_STRING("ab", json_get_string(json_get_array_element(&value, 1)),
+                     json_get_string_length(json_get_array_element(&value, 1)));
+    json_value_free(&value);
+
+    json_value_init(&value);
+    EXPECT_EQ_INT(JSON_PARSE_OK, json_parse_n(&value, "123456", 3));
+    EXPECT_EQ_DOUBLE(123.0, json_get_number(&value));
+    EXPECT_EQ_INT(JSON_PARSE_OK, json_parse_n(&value, "1.5e10", 3));
+    EXPECT_EQ_DOUBLE(1.5, json_get_number(&value));
+
+    TEST_PARSE_N(JSON_PARSE_OK, "nullx", 4);
+    TEST_PARSE_N(JSON_PARSE_EXPECT_VALUE, "null", 0);
+    TEST_PARSE_N(JSON_PARSE_EXPECT_VALUE, "  null", 2);
+    TEST_PARSE_N(JSON_PARSE_INVALID_VALUE, "true", 3);
+    TEST_PARSE_N(JSON_PARSE_INVALID_VALUE, "1.5", 2);
+    TEST_PARSE_N(JSON_PARSE_INVALID_VALUE, "1e5", 2);
+    TEST_PARSE_N(JSON_PARSE_MISS_QUOTATION_MARK, "\"abc\"", 4);
+    TEST_PARSE_N(JSON_PARSE_MISS_QUOTATION_MARK, "\"a\\\"", 3);
+    TEST_PARSE_N(JSON_PARSE_INVALID_UNICODE_HEX, "\"\\u0024\"", 6);
+    TEST_PARSE_N(JSON_PARSE_INVALID_UNICODE_SURROGATE, "\"\\uD834\\uDD1E\"", 8);
+    TEST_PARSE_N(JSON_PARSE_INVALID_STRING_CHAR, string_with_nul, sizeof(string_with_nul));
+    TEST_PARSE_N(JSON_PARSE_MISS_COMMA_OR_SQUARE_BRACKET, buffer, 7);
+    TEST_PARSE_N(JSON_PARSE_EXPECT_VALUE, buffer, 3);
+    TEST_PARSE_N(JSON_PARSE_MISS_COLON, "{\"a\":1}", 4);
+    TEST_PARSE_N(JSON_PARSE_MISS_COMMA_OR_CURLY_BRACKET, "{\"a\":1}", 6);
+}
+
+static void test_parse_whitespace() {
+    static const char json[] =
+        "{\n"
+        "    \"a\" :\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t [\r\n"
+        "        1 ,                                                      2\n"
+        "    ]                                 ,\n"
+        "    \"b\"  \n  \n  \n  \n  \n  \n  \n  \n  \n  \n  \n  \n  \n  \n  \n  :  \"c\"\n"
+        "}                                                                    ";
+    int level;
+
+    for (level = JSON_SIMD_NONE; level <= JSON_SIMD_AVX2; level++) {
+        json_value value;
+        size_t i;
+
+        json_set_simd(level);
+
+        json_value_init(&value);
+        EXPECT_EQ_INT(JSON_PARSE_OK, json_parse(&value, json));
+        EXPECT_EQ_SIZE_T((size_t)2, json_get_object_size(&value));
+        EXPECT_EQ_SIZE_T((size_t)2, json_get_array_size(json_get_object_value(&value, 0)));
+        EXPECT_EQ_DOUBLE(2.0, json_get_number(json_get_array_element(json_get_object_value(&value, 0), 1)));
+        EXPECT_EQ_STRING("c", json_get_string(json_get_object_value(&value, 1)),
+                         json_get_string_length(json_get_object_value(&value, 1)));
+        json_value_free(&value);
+
+        /* every run length against the 16 and 32 byte strides, ending at the buffer end */
+        for (i = 0; i < 70; i++) {
+            char buffer[80];
+            memset(buffer, ' ', sizeof(buffer));
+            buffer[i] = '1';
+            TEST_PARSE_N(JSON_PARSE_OK, buffer, i + 1);
+            TEST_PARSE_N(JSON_PARSE_EXPECT_VALUE, buffer, i);
+        }
+    }
+
+    json_set_simd(JSON_SIMD_AVX2);
+}
+
+static void test_parse_string_runs() {
+    int level;
+
+    for (level = JSON_SIMD_NONE; level <= JSON_SIMD_AVX2; level++) {
+        size_t i;
+
+        json_set_simd(level);
+
+        /* escapes, non-ASCII bytes and control characters at every offset of the vector strides */
+        for (i = 0; i < 70; i++) {
+            char json[96], expect[96];
+            json_value value;
+
+            memset(json, 'a', sizeof(json));
+            memset(expect, 'a', sizeof(expect));
+            json[0] = '"';
+            json[i + 1] = '\\'; json[i + 2] = 'n';
+            expect[i] = '\n';
+            json[i + 3] = '\xE2'; json[i + 4] = '\x82'; json[i + 5] = '\xAC';
+            expect[i + 1] = '\xE2'; expect[i + 2] = '\x82'; expect[i + 3] = '\xAC';
+            json[80] = '"';
+
+            json_value_init(&value);
+            EXPECT_EQ_INT(JSON_PARSE_OK, json_parse_n(&value, json, 81));
+            EXPECT_EQ_SIZE_T((size_t)78, json_get_string_length(&value));
+            EXPECT_TRUE(0 == memcmp(expect, json_get_string(&value), 78));
+            json_value_free(&value);
+
+            json[i + 1] = '\x1F';
+            TEST_PARSE_N(JSON_PARSE_INVALID_STRING_CHAR, json, 81);
+            json[i + 1] = 'a';
+            TEST_PARSE_N(JSON_PARSE_MISS_QUOTATION_MARK, json, i + 2);
+        }
+    }
+
+    json_set_simd(JSON_SIMD_AVX2);
+}
+
+static int test_parse_utf8_n(const char *json, size_t len) {
+    json_parse_options options;
+    json_value v;
+    int ret;
+
+    options.flags = JSON_PARSE_VALIDATE_UTF8;
+    options.keys = NULL;
+    json_value_init(&v);
+    ret = json_parse_ex(&v, json, len, &options);
+    json_value_free(&v);
+    return ret;
+}
+
+static void test_parse_utf8() {
+    static const char *const valid[] = {
+        "\xC2\x80", "\xDF\xBF", "\xE0\xA0\x80", "\xE2\x82\xAC", "\xED\x9F\xBF", "\xEE\x80\x80", "\xEF\xBF\xBF",
+        "\xF0\x90\x80\x80", "\xF4\x8F\xBF\xBF", "\x7F"
+    };
+    static const char *const invalid[] = {
+        "\x80", "\xBF", "\xC0\x80", "\xC1\xBF", "\xC2", "\xC2\x41", "\xE0\x80\x80", "\xE0\x9F\xBF", "\xE2\x82",
+        "\xED\xA0\x80", "\xED\xBF\xBF", "\xF0\x80\x80\x80", "\xF0\x8F\xBF\xBF", "\xF4\x90\x80\x80", "\xF5\x80\x80\x80",
+        "\xFF", "\xE2\x82\xAC\xAC"
+    };
+    json_field_set *fields = json_field_set_create();
+    json_parse_options options;
+    json_path *path;
+    json_value v;
+    int level;
+
+    path = json_path_compile_pointer("/kept", 5);
+    json_field_set_add(fields, path);
+    json_path_free(path);
+    options.flags = JSON_PARSE_VALIDATE_UTF8;
+    options.keys = NULL;
+
+    for (level = JSON_SIMD_NONE; level <= JSON_SIMD_AVX2; level++) {
+        size_t i, j;
+
+        json_set_simd(level);
+
+        /* each sequence at offsets across the vector strides, plain, after an escape, and as a key */
+        for (i = 0; i < 70; i += 3) {
+            for (j = 0; j < sizeof(valid) / sizeof(valid[0]) + sizeof(invalid) / sizeof(invalid[0]); j++) {
+                int ok = j < sizeof(valid) / sizeof(valid[0]);
+                const char *s = ok ? valid[j] : invalid[j - sizeof(valid) / sizeof(valid[0])];
+                int expect = ok ? JSON_PARSE_OK : JSON_PARSE_INVALID_UTF8;
+                char json[160];
+                size_t n;
+
+                memset(json, 'a', sizeof(json));
+                json[0] = '"';
+                n = strlen(s);
+                memcpy(json + 1 + i, s, n);
+                json[n + i + 41] = '"';
+                EXPECT_EQ_INT(expect, test_parse_utf8_n(json, n + i + 42));
+                TEST_PARSE_N(JSON_PARSE_OK, json, n + i + 42);
+
+                json[n + i + 20] = '\\'; json[n + i + 21] = 't';
+                EXPECT_EQ_INT(expect, test_parse_utf8_n(json, n + i + 42));
+
+                memset(json, 'a', sizeof(json));
+                json[0] = '{'; json[1] = '"';
+                memcpy(json + 2 + i, s, n);
+                json[n + i + 41] = '"'; json[n + i + 42] = ':'; json[n + i + 43] = '1'; json[n + i + 44] = '}';
+                EXPECT_EQ_INT(expect, test_parse_utf8_n(json, n + i + 45));
+
+                /* skipped values are held to it as well */
+                json_value_init(&v);
+                EXPECT_EQ_INT(expect, json_parse_projected(&v, json, n + i + 45, fields, &options));
+                json_value_free(&v);
+            }
+        }
+    }
+
+    json_set_simd(JSON_SIMD_AVX2);
+
+    /* escapes decode to the same rules: pairs as one code point, no lone low surrogate */
+    EXPECT_EQ_INT(JSON_PARSE_OK, test_parse_utf8_n("\"\\uD83D\\uDE00\"", 14));
+    EXPECT_EQ_INT(JSON_PARSE_OK, test_parse_utf8_n("\"\\uDBFF\\uDFFF\"", 14));
+    EXPECT_EQ_INT(JSON_PARSE_INVALID_UNICODE_SURROGATE, test_parse_utf8_n("\"\\uDC00\"", 8));
+    EXPECT_EQ_INT(JSON_PARSE_INVALID_UNICODE_SURROGATE, test_parse_utf8_n("\"a\\uDFFF\"", 9));
+    EXPECT_EQ_INT(JSON_PARSE_INVALID_UNICODE_SURROGATE, test_parse_utf8_n("\"\\uDC00\\uD800\"", 14));
+    TEST_PARSE_N(JSON_PARSE_OK, "\"\\uDC00\"", 8);
+    json_value_init(&v);
+    EXPECT_EQ_INT(JSON_PARSE_INVALID_UNICODE_SURROGATE,
+                  json_parse_projected(&v, "{\"a\":\"\\uDC00\",\"kept\":1}", 23, fields, &options));
+    json_value_free(&v);
+    json_field_set_free(fields);
+}
+
+static void test_parse_string_views() {
+    static const char json[] = "{ \"plain\" : \"abc\", \"esc\\naped\" : [ \"x\\ty\", \"\" ] }";
+    json_parse_options options;
+    json_document *doc;
+    json_value value, *a, *root;
+
+    options.flags = JSON_PARSE_STRING_VIEWS;
+
+    json_value_init(&value);
+    EXPECT_EQ_INT(JSON_PARSE_OK, json_parse_ex(&value, json, sizeof(json) - 1, &options));
+    EXPECT_EQ_STRING("plain", json_get_object_key(&value, 0), json_get_object_key_length(&value, 0));
+    EXPECT_TRUE(json_get_object_key(&value, 0) == json + 3);
+    EXPECT_EQ_STRING("abc", json_get_string(json_get_object_value(&value, 0)),
+                     json_get_string_length(json_get_object_value(&value, 0)));
+    EXPECT_TRUE(json_get_string(json_get_object_value(&value, 0)) == json + 13);
+    EXPECT_TRUE(0 != (json_get_object_value(&value, 0)->flags & JSON_FLAG_STRING_VIEW));
+
+    /* escaped strings and keys are materialized */
+    EXPECT_EQ_STRING("esc\naped", json_get_object_key(&value, 1), json_get_object_key_length(&value, 1));
+    EXPECT_EQ_INT(0, (int)value.u.members[1].key.flags);
+    a = json_get_object_value(&value, 1);
+    EXPECT_EQ_STRING("x\ty", json_get_string(json_get_array_element(a, 0)), json_get_string_length(json_get_array_element(a, 0)));
+    EXPECT_EQ_INT(0, (int)json_get_array_element(a, 0)->flags);
+    EXPECT_EQ_SIZE_T((size_t)0, json_get_string_length(json_get_array_element(a, 1)));
+    EXPECT_TRUE(0 != (json_get_array_element(a, 1)->flags & JSON_FLAG_STRING_VIEW));
+
+    /* replacing a view must not free the borrowed bytes */
+    json_set_string(json_get_array_element(a, 1), "copy", 4);
+    EXPECT_EQ_STRING("copy", json_get_string(json_get_array_element(a, 1)), json_get_string_length(json_get_array_element(a, 1)));
+    json_value_free(&value);
+
+    /* the default still copies */
+    json_value_init(&value);
+    EXPECT_EQ_INT(JSON_PARSE_OK, json_parse_ex(&value, json, sizeof(json) - 1, NULL));
+    EXPECT_TRUE(json_get_object_key(&value, 0) != json + 3);
+    EXPECT_EQ_INT(0, (int)json_get_object_value(&value, 0)->flags);
+    json_value_free(&value);
+
+    EXPECT_EQ_INT(JSON_PARSE_MISS_COLON, json_parse_ex(&value, "{\"a\" 1}", 7, &options));
+    EXPECT_EQ_INT(JSON_PARSE_MISS_COMMA_OR_CURLY_BRACKET, json_parse_ex(&value, "{\"a\":\"b\" 1}", 11, &options));
+
+    doc = json_document_create();
+    EXPECT_EQ_INT(JSON_PARSE_OK, json_parse_into_ex(doc, json, sizeof(json) - 1, &options));
+    root = json_document_root(doc);
+    EXPECT_TRUE(json_get_object_key(root, 0) == json + 3);
+    EXPECT_EQ_STRING("esc\naped", json_get_object_key(root, 1), json_get_object_key_length(root, 1));
+    json_document_free(doc);
+}
+
+static void test_parse_inline_strings() {
+    static const char json[] =
+        "{\"elevenbytes\":\"short\",\"twelve bytes\":[\"eleven\\nbyte\",\"twelve\\nbytes\",\"\"],"
+        "\"n\\u0000l\":\"a\\u0000b\"}";
+    json_document *doc = json_document_create();
+    json_value value, *a, *root;
+    char *out;
+    size_t length;
+    int i;
+
+    EXPECT_EQ_SIZE_T((size_t)16, sizeof(json_value));
+    EXPECT_EQ_SIZE_T((size_t)32, sizeof(json_member));
+
+    json_value_init(&value);
+    EXPECT_EQ_INT(JSON_PARSE_OK, json_parse_n(&value, json, sizeof(json) - 1));
+    EXPECT_TRUE(JSON_PARSE_OK == json_parse_into_n(doc, json, sizeof(json) - 1));
+    for (i = 0; i < 2; i++) {
+        root = i ? json_document_root(doc) : &value;
+        EXPECT_EQ_STRING("elevenbytes", json_get_object_key(root, 0), json_get_object_key_length(root, 0));
+        EXPECT_EQ_STRING("short", json_get_string(json_get_object_value(root, 0)),
+                         json_get_string_length(json_get_object_value(root, 0)));
+        EXPECT_EQ_STRING("twelve bytes", json_get_object_key(root, 1), json_get_object_key_length(root, 1));
+        a = json_get_object_value(root, 1);
+        EXPECT_EQ_STRING("eleven\nbyte", json_get_string(json_get_array_element(a, 0)), json_get_string_length(json_get_array_element(a, 0)));
+        EXPECT_TRUE(json_get_string(json_get_array_element(a, 0)) == (const char *)json_get_array_element(a, 0));
+        EXPECT_EQ_STRING("twelve\nbytes", json_get_string(json_get_array_element(a, 1)), json_get_string_length(json_get_array_element(a, 1)));
+        EXPECT_EQ_STRING("", json_get_string(json_get_array_element(a, 2)), json_get_string_length(json_get_array_element(a, 2)));
+        EXPECT_EQ_STRING("n\0l", json_get_object_key(root, 2), json_get_object_key_length(root, 2));
+        EXPECT_EQ_STRING("a\0b", json_get_string(json_find_object_value(root, "n\0l", 3)),
+                         json_get_string_length(json_find_object_value(root, "n\0l", 3)));
+    }
+
+    out = json_stringify(&value, &length);
+    EXPECT_EQ_STRING(json, out, length);
+    free(out);
+
+    json_value_free(&value);
+    json_document_free(doc);
+}
+
+static void test_parse_document() {
+    json_document *doc = json_document_create();
+    json_value *root, *o;
+
+    EXPECT_EQ_INT(JSON_PARSE_OK, json_parse_into(doc, " { \"a\" : [ 1, \"abc\", null ], \"o\" : { \"k\" : \"v\" } } "));
+    root = json_document_root(doc);
+    EXPECT_EQ_INT(JSON_OBJECT, json_get_type(root));
+    EXPECT_EQ_SIZE_T((size_t)2, json_get_object_size(root));
+    EXPECT_EQ_STRING("a", json_get_object_key(root, 0), json_get_object_key_length(root, 0));
+    EXPECT_EQ_SIZE_T((size_t)3, json_get_array_size(json_get_object_value(root, 0)));
+    EXPECT_EQ_DOUBLE(1.0, json_get_number(json_get_array_element(json_get_object_value(root, 0), 0)));
+    EXPECT_EQ_STRING("abc",
+                     json_get_string(json_get_array_element(json_get_object_value(root, 0), 1)),
+                     json_get_string_length(json_get_array_element(json_get_object_value(root, 0), 1)));
+    o = json_get_object_value(root, 1);
+    EXPECT_EQ_STRING("k", json_get_object_key(o, 0), json_get_object_key_length(o, 0));
+    EXPECT_EQ_STRING("v", json_get_string(json_get_object_value(o, 0)), json_get_string_length(json_get_object_value(o, 0)));
+
+    /* reparsing releases the previous tree */
+    EXPECT_EQ_INT(JSON_PARSE_OK, json_parse_into(doc, "\"Hello\\nWorld\""));
+    root = json_document_root(doc);
+    EXPECT_EQ_STRING("Hello\nWorld", json_get_string(root), json_get_string_length(root));
+
+    EXPECT_EQ_INT(JSON_PARSE_MISS_COMMA_OR_CURLY_BRACKET, json_parse_into(doc, "{\"a\":[1,2],\"b\":\"c\""));
+    EXPECT_EQ_INT(JSON_NULL, json_get_type(json_document_root(doc)));
+
+    json_document_free(doc);
+}
+
+/* checks every key of an object built as {"k0":0,"k1":1,...,"dup":-1,"dup":-2,"a\u0000b":-3} */
+static void test_find_in_object(const json_value *o, size_t count) {
+    char key[32];
+    size_t i;
+
+    for (i = 0; i < count; i++) {
+        sprintf(key, "k%lu", (unsigned long)i);
+        EXPECT_TRUE(NULL != json_find_object_value(o, key, strlen(key)));
+        EXPECT_EQ_DOUBLE((double)i, json_get_number(json_find_object_value(o, key, strlen(key))));
+    }
+    EXPECT_EQ_DOUBLE(-1.0, json_get_number(json_find_object_value(o, "dup", 3)));
+    EXPECT_EQ_DOUBLE(-3.0, json_get_number(json_find_object_value(o, "a\0b", 3)));
+    EXPECT_TRUE(NULL == json_find_object_value(o, "a", 1));
+    EXPECT_TRUE(NULL == json_find_object_value(o, "k", 1));
+    EXPECT_TRUE(NULL == json_find_object_value(o, "", 0));
+    sprintf(key, "k%lu", (unsigned long)count);
+    EXPECT_TRUE(NULL == json_find_object_value(o, key, strlen(key)));
+}
+
+static void test_find_object_value() {
+    static const size_t sizes[] = { 0, 1, 5, 30, 31, 32, 100, 1000 };
+    json_parse_options options;
+    json_document *doc = json_document_create();
+    json_value v;
+    char *json;
+    size_t i, j;
+
+    options.flags = JSON_PARSE_STRING_VIEWS;
+    for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        json = (char *)malloc(16 * sizes[i] + 64);
+        strcpy(json, "{");
+        for (j = 0; j < sizes[i]; j++) {
+            sprintf(json + strlen(json), "\"k%lu\":%lu,", (unsigned long)j, (unsigned long)j);
+        }
+        strcat(json, "\"dup\":-1,\"dup\":-2,\"a\\u0000b\":-3}");
+
+        json_value_init(&v);
+        EXPECT_EQ_INT(JSON_PARSE_OK, json_parse(&v, json));
+        test_find_in_object(&v, sizes[i]);
+        json_value_free(&v);
+
+        json_value_init(&v);
+        EXPECT_EQ_INT(JSON_PARSE_OK, json_parse_ex(&v, json, strlen(json), &options));
+        test_find_in_object(&v, sizes[i]);
+        json_value_free(&v);
+
+        EXPECT_EQ_INT(JSON_PARSE_OK, json_parse_into(doc, json));
+        test_find_in_object(json_document_root(doc), sizes[i]);
+
+        free(json);
+    }
+
+    json_document_free(doc);
+}
+
+static void test_parse_intern_keys() {
+    static const char json[] =
+        "[{\"identifier\":1,\"a long member name\":{\"identifier\":2}},{\"a long member name\":3,\"x\\u0000y\":4}]";
+    json_parse_options options;
+    json_key_table *table = json_key_table_create();
+    json_document *doc = json_document_create();
+    json_value v, *root;
+    const char *id, *name, *nul;
+    char key[32], *big;
+    size_t i;
+    int round;
+
+    options.flags = JSON_PARSE_INTERN_KEYS;
+    options.keys = table;
+    id = json_key_table_intern(table, "identifier", 10);
+    EXPECT_TRUE(id == json_key_table_intern(table, "identifier", 10));
+    EXPECT_EQ_STRING("identifier", id, 10);
+    EXPECT_EQ_SIZE_T((size_t)1, json_key_table_size(table));
+
+    for (round = 0; round < 3; round++) {
+        options.flags = JSON_PARSE_INTERN_KEYS | (2 == round ? JSON_PARSE_LAZY : 0);
+        json_value_init(&v);
+        if (1 == round) {
+            EXPECT_EQ_INT(JSON_PARSE_OK, json_parse_into_ex(doc, json, sizeof(json) - 1, &options));
+            root = json_document_root(doc);
+        } else {
+            EXPECT_EQ_INT(JSON_PARSE_OK, json_parse_ex(&v, json, sizeof(json) - 1, &options));
+            root = &v;
+        }
+        name = json_key_table_intern(table, "a long member name", 18);
+        nul = json_key_table_intern(table, "x\0y", 3);
+        EXPECT_EQ_SIZE_T((size_t)3, json_key_table_size(table));
+
+        EXPECT_TRUE(id == json_get_object_key(json_get_array_element(root, 0), 0));
+        EXPECT_TRUE(name == json_get_object_key(json_get_array_element(root, 1), 0));
+        EXPECT_TRUE(0 != (json_get_array_element(root, 0)->u.members[0].key.flags & JSON_FLAG_INTERNED));
+        EXPECT_EQ_DOUBLE(2.0, json_get_number(json_find_interned_value(
+            json_find_interned_value(json_get_array_element(root, 0), name), id)));
+        EXPECT_EQ_DOUBLE(3.0, json_get_number(json_find_interned_value(json_get_array_element(root, 1), name)));
+        EXPECT_EQ_DOUBLE(4.0, json_get_number(json_find_interned_value(json_get_array_element(root, 1), nul)));
+        EXPECT_TRUE(NULL == json_find_interned_value(json_get_array_element(root, 1), id));
+        EXPECT_EQ_DOUBLE(4.0, json_get_number(json_find_object_value(json_get_array_element(root, 1), "x\0y", 3)));
+        json_value_free(&v);
+    }
+
+    /* indexed objects are probed with the hash stored by the table */
+    big = (char *)malloc(40 * 20 + 16);
+    strcpy(big, "{");
+    for (i = 0; i < 40; i++) {
+        sprintf(big + strlen(big), "%s\"key number %lu\":%lu", i ? "," : "", (unsigned long)i, (unsigned long)i);
+    }
+    strcat(big, "}");
+    json_value_init(&v);
+    EXPECT_EQ_INT(JSON_PARSE_OK, json_parse_ex(&v, big, strlen(big), &options));
+    for (i = 0; i < 40; i++) {
+        sprintf(key, "key number %lu", (unsigned long)i);
+        EXPECT_EQ_DOUBLE((double)i, json_get_number(json_find_interned_value(&v, json_key_table_intern(table, key, strlen(key)))));
+    }
+    EXPECT_TRUE(NULL == json_find_interned_value(&v, name));
+    EXPECT_EQ_SIZE_T((size_t)43, json_key_table_size(table));
+    json_value_free(&v);
+    free(big);
+
+    /* without the flag the table is left alone */
+    options.flags = 0;
+    EXPECT_EQ_INT(JSON_PARSE_OK, json_parse_ex(&v, json, sizeof(json) - 1, &options));
+    EXPECT_TRUE(0 == (json_get_array_element(&v, 0)->u.members[0].key.flags & JSON_FLAG_INTERNED));
+    json_value_free(&v);
+
+    json_document_free(doc);
+    json_key_table_free(table);
+}
+
+static size_t test_alloc_count = 0;
+
+static void* test_counting_malloc(size_t size) {
+    test_alloc_count++;
+    return malloc(size);
+}
+
+static void* test_counting_realloc(void *ptr, size_t size) {
+    test_alloc_count++;
+    return realloc(ptr, size);
+}
+
+static void test_parser() {
+    static const char message[] = "{\"id\":7,\"tags\":[\"a\",\"b\",[1,[2,[3]]]],\"name\":\"a message of some length\"}";
+    static const json_allocator counting = { test_counting_malloc, test_counting_realloc, free };
+    json_parser_config config;
+    json_parser *parser;
+    json_value v, *root;
+    char *deep, *out;
+    size_t i, length;
+
+    config.stack_size = 64;
+    config.arena_size = 0;
+    config.retain_size = 4096;
+    parser = json_parser_create(&config);
+
+    /* after the first message of a kind, the same kind parses without allocating */
+    json_set_allocator(&counting);
+    for (i = 0; i < 3; i++) {
+        test_alloc_count = 0;
+        EXPECT_EQ_INT(JSON_PARSE_OK, json_parser_parse_into(parser, message, sizeof(message) - 1, NULL));
+        if (i > 0) {
+            EXPECT_EQ_SIZE_T((size_t)0, test_alloc_count);
+        }
+    }
+    json_set_allocator(NULL);
+    root = json_parser_root(parser);
+    out = json_stringify(root, &length);
+    EXPECT_EQ_STRING(message, out, length);
+    free(out);
+
+    json_value_init(&v);
+    EXPECT_EQ_INT(JSON_PARSE_OK, json_parser_parse(parser, &v, message, sizeof(message) - 1, NULL));
+    out = json_stringify(&v, &length);
+    EXPECT_EQ_STRING(message, out, length);
+    free(out);
+    json_value_free(&v);
+
+    /* an outlier grows stack and arena past the cap, which is given back */
+    deep = (char *)malloc(20001);
+    for (i = 0; i < 10000; i++) {
+        deep[i] = '[';
+        deep[20000 - 1 - i] = ']';
+    }
+    EXPECT_EQ_INT(JSON_PARSE_OK, json_parser_parse_into(parser, deep, 20000, NULL));
+    EXPECT_EQ_INT(JSON_ARRAY, json_get_type(json_parser_root(parser)));
+    EXPECT_EQ_INT(JSON_PARSE_OK, json_parser_parse(parser, &v, deep, 20000, NULL));
+    json_value_free(&v);
+    free(deep);
+    for (i = 0; i < 3; i++) {
+        EXPECT_EQ_INT(JSON_PARSE_OK, json_parser_parse_into(parser, message, sizeof(message) - 1, NULL));
+    }
+    EXPECT_EQ_STRING("a message of some length",
+                     json_get_string(json_find_object_value(json_parser_root(parser), "name", 4)),
+                     json_get_string_length(json_find_object_value(json_parser_root(parser), "name", 4)));
+
+    EXPECT_EQ_INT(JSON_PARSE_MISS_COMMA_OR_CURLY_BRACKET, json_parser_parse_into(parser, "{\"a\":1", 6, NULL));
+    EXPECT_EQ_INT(JSON_NULL, json_get_type(json_parser_root(parser)));
+    json_parser_reset(parser);
+    EXPECT_EQ_INT(JSON_NULL, json_get_type(json_parser_root(parser)));
+    json_parser_free(parser);
+
+    parser = json_parser_create(NULL);
+    EXPECT_EQ_INT(JSON_PARSE_OK, json_parser_parse_into(parser, "[1,2]", 5, NULL));
+    EXPECT_EQ_SIZE_T((size_t)2, json_get_array_size(json_parser_root(parser)));
+    json_parser_free(parser);
+}
+
+/* collects up to 8 numbers or string lengths reached by a path, freeing parsed values when owned */
+typedef struct {
+    double seen[8];
+    size_t count, stop_at;
+    int owned;
+} test_path_result;
+
+static int test_path_collect(void *user, json_value *value) {
+    test_path_result *r = (test_path_result *)user;
+
+    if (r->count < 8) {
+        r->seen[r->count] = JSON_NUMBER == json_get_type(value) ? json_get_number(value) :
+                            JSON_STRING == json_get_type(value) ? (double)json_get_string_length(value) : -1.0;
+    }
+    r->count++;
+    if (r->owned) {
+        json_value_free(value);
+    }
+    return r->count == r->stop_at;
+}
+
+#define TEST_POINTER(expect, pointer)\
+    do {\
+        json_path *path = json_path_compile_pointer(pointer, sizeof(pointer) - 1);\
+        EXPECT_TRUE(NULL != path);\
+        if (NULL != path) {\
+            EXPECT_EQ_DOUBLE(expect, json_get_number(json_path_find(path, &v)));\
+            r.count = 0;\
+            r.owned = 1;\
+            EXPECT_EQ_INT(JSON_PARSE_OK, json_parse_path(json, sizeof(json) - 1, path, NULL, test_path_collect, &r));\
+            EXPECT_EQ_SIZE_T((size_t)1, r.count);\
+            EXPECT_EQ_DOUBLE(expect, r.seen[0]);\
+            json_path_free(path);\
+        }\
+    } while(0)
+
+static void test_path() {
+    /* the example document of RFC 6901 */
+    static const char json[] =
+        "{\"foo\":[\"bar\",\"baz\"],\"\":0,\"a/b\":1,\"c%d\":2,\"e^f\":3,\"g|h\":4,\"i\\\\j\":5,"
+        "\"k\\\"l\":6,\" \":7,\"m~n\":8,\"0\":{\"1\":[10,[11,12]]}}";
+    static const char *invalid[] = { "a", "$.", "$[", "$[01]", "$[-1]", "$['x'", "$['x']y", "$x", "$..a" };
+    test_path_result r;
+    json_parse_options options;
+    json_path *path;
+    json_value v;
+    size_t i;
+
+    r.stop_at = 0;
+    json_value_init(&v);
+    EXPECT_EQ_INT(JSON_PARSE_OK, json_parse_n(&v, json, sizeof(json) - 1));
+
+    TEST_POINTER(0.0, "/");
+    TEST_POINTER(1.0, "/a~1b");
+    TEST_POINTER(2.0, "/c%d");
+    TEST_POINTER(3.0, "/e^f");
+    TEST_POINTER(4.0, "/g|h");
+    TEST_POINTER(5.0, "/i\\j");
+    TEST_POINTER(6.0, "/k\"l");
+    TEST_POINTER(7.0, "/ ");
+    TEST_POINTER(8.0, "/m~0n");
+    TEST_POINTER(10.0, "/0/1/0");
+    TEST_POINTER(12.0, "/0/1/1/1");
+
+    path = json_path_compile_pointer("", 0);
+    EXPECT_TRUE(&v == json_path_find(path, &v));
+    json_path_free(path);
+    path = json_path_compile_pointer("/foo/2", 6);
+    EXPECT_TRUE(NULL == json_path_find(path, &v));
+    json_path_free(path);
+    path = json_path_compile_pointer("/foo/-", 6);
+    EXPECT_TRUE(NULL == json_path_find(path, &v));
+    json_path_free(path);
+    EXPECT_TRUE(NULL == json_path_compile_pointer("foo", 3));
+    EXPECT_TRUE(NULL == json_path_compile_pointer("/m~2n", 5));
+    EXPECT_TRUE(NULL == json_path_compile_pointer("/m~", 3));
+
+    /* JSONPath: the same steps, spelled differently, and wildcards */
+    path = json_path_compile("$['a/b']", 8);
+    EXPECT_EQ_DOUBLE(1.0, json_get_number(json_path_find(path, &v)));
+    json_path_free(path);
+    path = json_path_compile("$[\"k\\\"l\"]", 9);
+    EXPECT_EQ_DOUBLE(6.0, json_get_number(json_path_find(path, &v)));
+    json_path_free(path);
+    path = json_path_compile("$.0.1[1][0]", 11);
+    EXPECT_EQ_DOUBLE(11.0, json_get_number(json_path_find(path, &v)));
+    json_path_free(path);
+    path = json_path_compile("$.0[0]", 6);
+    EXPECT_TRUE(NULL == json_path_find(path, &v));
+    json_path_free(path);
+
+    path = json_path_compile("$.foo[*]", 8);
+    r.count = 0;
+    r.owned = 0;
+    EXPECT_EQ_INT(JSON_PARSE_OK, json_path_each(path, &v, test_path_collect, &r));
+    EXPECT_EQ_SIZE_T((size_t)2, r.count);
+    EXPECT_EQ_DOUBLE(3.0, r.seen[0]);
+    r.count = 0;
+    r.owned = 1;
+    EXPECT_EQ_INT(JSON_PARSE_OK, json_parse_path(json, sizeof(json) - 1, path, NULL, test_path_collect, &r));
+    EXPECT_EQ_SIZE_T((size_t)2, r.count);
+    json_path_free(path);
+
+    path = json_path_compile("$.*", 3);
+    r.count = 0;
+    r.owned = 0;
+    EXPECT_EQ_INT(JSON_PARSE_OK, json_path_each(path, &v, test_path_collect, &r));
+    EXPECT_EQ_SIZE_T((size_t)11, r.count);
+    EXPECT_EQ_DOUBLE(-1.0, r.seen[0]);
+    EXPECT_EQ_DOUBLE(0.0, r.seen[1]);
+    EXPECT_EQ_INT(JSON_ARRAY, json_get_type(json_path_find(path, &v)));
+    r.count = 0;
+    r.stop_at = 3;
+    EXPECT_EQ_INT(JSON_PARSE_ABORTED, json_path_each(path, &v, test_path_collect, &r));
+    EXPECT_EQ_SIZE_T((size_t)3, r.count);
+    r.count = 0;
+    r.owned = 1;
+    EXPECT_EQ_INT(JSON_PARSE_ABORTED, json_parse_path(json, sizeof(json) - 1, path, NULL, test_path_collect, &r));
+    EXPECT_EQ_SIZE_T((size_t)3, r.count);
+    r.stop_at = 0;
+
+    /* skipped values are still checked */
+    r.count = 0;
+    EXPECT_EQ_INT(JSON_PARSE_INVALID_VALUE, json_parse_path("{\"foo\":1,\"x\":[tru]}", 19, path, NULL, test_path_collect, &r));
+    EXPECT_EQ_INT(JSON_PARSE_MISS_COMMA_OR_CURLY_BRACKET, json_parse_path("{\"foo\":1 2}", 11, path, NULL, test_path_collect, &r));
+    EXPECT_EQ_SIZE_T((size_t)2, r.count);
+    r.count = 0;
+    EXPECT_EQ_INT(JSON_PARSE_OK, json_parse_path("7", 1, path, NULL, test_path_collect, &r));
+    EXPECT_EQ_SIZE_T((size_t)0, r.count);
+    json_path_free(path);
+    path = json_path_compile("$.b", 3);
+    r.count = 0;
+    EXPECT_EQ_INT(JSON_PARSE_OK, json_parse_path("{\"a\":\"\\uD83D\\uDE00\",\"b\":1}", 26, path, NULL, test_path_collect, &r));
+    EXPECT_EQ_SIZE_T((size_t)1, r.count);
+    json_path_free(path);
+
+    for (i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++) {
+        EXPECT_TRUE(NULL == json_path_compile(invalid[i], strlen(invalid[i])));
+    }
+    path = json_path_compile("$", 1);
+    EXPECT_TRUE(&v == json_path_find(path, &v));
+    json_path_free(path);
+    json_value_free(&v);
+
+    /* lazy trees are expanded along the path */
+    options.flags = JSON_PARSE_LAZY;
+    EXPECT_EQ_INT(JSON_PARSE_OK, json_parse_ex(&v, json, sizeof(json) - 1, &options));
+    path = json_path_compile_pointer("/0/1/1/0", 8);
+    EXPECT_EQ_DOUBLE(11.0, json_get_number(json_path_find(path, &v)));
+    json_path_free(path);
+    json_value_free(&v);
+}
+
+/* parses json projected on the given pointers and compares the result, stringified, with expect */
+static void test_projected(const char *expect, const char *json, const char *const *pointers, size_t count) {
+    json_field_set *fields = json_field_set_create();
+    json_value v, full;
+    size_t i, length, full_length;
+    char *out, *full_out;
+
+    for (i = 0; i < count; i++) {
+        json_path *path = json_path_compile_pointer(pointers[i], strlen(pointers[i]));
+        json_field_set_add(fields, path);
+        json_path_free(path);
+    }
+    EXPECT_EQ_INT(JSON_PARSE_OK, json_parse_projected(&v, json, strlen(json), fields, NULL));
+    out = json_stringify(&v, &length);
+    EXPECT_EQ_BASE(strlen(expect) == length && 0 == memcmp(expect, out, length), expect, out, "%s");
+    free(out);
+
+    /* the paths of the set find in the projected tree what they find in the full one */
+    json_value_init(&full);
+    EXPECT_EQ_INT(JSON_PARSE_OK, json_parse_n(&full, json, strlen(json)));
+    for (i = 0; i < count; i++) {
+        json_path *path = json_path_compile_pointer(pointers[i], strlen(pointers[i]));
+        const json_value *expect_value = json_path_find(path, &full), *actual = json_path_find(path, &v);
+        EXPECT_TRUE((NULL == expect_value) == (NULL == actual));
+        if (NULL != expect_value && NULL != actual) {
+            full_out = json_stringify(expect_value, &full_length);
+            out = json_stringify(actual, &length);
+            EXPECT_EQ_BASE(full_length == length && 0 == memcmp(full_out, out, length), full_out, out, "%s");
+            free(full_out);
+            free(out);
+        }
+        json_path_free(path);
+    }
+    json_value_free(&full);
+    json_value_free(&v);
+    json_field_set_free(fields);
+}
+
+static void test_parse_projected() {
+    static const char json[] =
+        "{\"id\":7,\"name\":\"a\\\"b\",\"tags\":[\"x\",\"y\"],\"meta\":{\"deep\":[1,{\"k\":true}],\"z\":null},"
+        "\"items\":[{\"id\":1,\"v\":2},{\"id\":3,\"w\":[4]},5]}";
+    static const char *const invalid[] = {
+        "{\"id\":1,\"x\":[tru]}", "{\"id\":1 2}", "{\"id\":1,\"x\":\"\\u12\"}", "{\"id\":1,\"x\":\"\\ud800\"}",
+        "{\"id\":1,\"x\":\"a", "{\"id\":1,\"x\":-}", "{\"id\":1,\"x\":1.}", "{\"id\":1,\"x\":1e}",
+        "{\"id\":1,\"x\":{\"a\" 1}}", "{\"id\":1,\"x\":{1:2}}", "{\"id\":1,\"x\":[1 2]}", "{\"id\":1,\"x\":\"\\q\"}",
+        "{\"id\":1,\"x\":\"\x01\"}", "{\"id\":1,\"x\":", "{\"id\":1,\"x\":?}"
+    };
+    static const char *const pointers[] = {
+        "/id", "/name", "/meta/deep/1/k", "/tags", "/meta/z", "/missing", "", "/items/3/id", "/n/1/1"
+    };
+    json_field_set *fields;
+    json_path *path;
+    json_value v, full;
+    size_t i;
+
+    test_projected("{\"id\":7}", json, pointers, 1);
+    test_projected("{\"id\":7,\"name\":\"a\\\"b\"}", json, pointers, 2);
+    test_projected("{\"meta\":{\"deep\":[null,{\"k\":true}]}}", json, pointers + 2, 1);
+    test_projected("{\"tags\":[\"x\",\"y\"],\"meta\":{\"z\":null}}", json, pointers + 3, 3);
+    test_projected(json, json, pointers + 6, 1);
+    test_projected("{}", json, pointers + 5, 1);
+
+    /* a wildcard applies to named children too; dropped elements are left null in place */
+    fields = json_field_set_create();
+    path = json_path_compile("$.items[*].id", 13);
+    json_field_set_add(fields, path);
+    json_path_free(path);
+    path = json_path_compile("$.items[1].w", 12);
+    json_field_set_add(fields, path);
+    json_path_free(path);
+    path = json_path_compile("$.*.k", 5);
+    json_field_set_add(fields, path);
+    json_path_free(path);
+    EXPECT_EQ_INT(JSON_PARSE_OK, json_parse_projected(&v, json, sizeof(json) - 1, fields, NULL));
+    EXPECT_EQ_SIZE_T((size_t)3, json_get_object_size(&v));
+    EXPECT_EQ_SIZE_T((size_t)2, json_get_array_size(json_find_object_value(&v, "tags", 4)));
+    EXPECT_EQ_INT(JSON_NULL, json_get_type(json_get_array_element(json_find_object_value(&v, "tags", 4), 1)));
+    EXPECT_EQ_SIZE_T((size_t)0, json_get_object_size(json_find_object_value(&v, "meta", 4)));
+    full = *json_find_object_value(&v, "items", 5);
+    EXPECT_EQ_SIZE_T((size_t)3, json_get_array_size(&full));
+    EXPECT_EQ_DOUBLE(1.0, json_get_number(json_find_object_value(json_get_array_element(&full, 0), "id", 2)));
+    EXPECT_EQ_SIZE_T((size_t)1, json_get_object_size(json_get_array_element(&full, 0)));
+    EXPECT_EQ_SIZE_T((size_t)2, json_get_object_size(json_get_array_element(&full, 1)));
+    EXPECT_EQ_INT(JSON_NULL, json_get_type(json_get_array_element(&full, 2)));
+    path = json_path_compile("$.items[1].w[0]", 15);
+    EXPECT_EQ_DOUBLE(4.0, json_get_number(json_path_find(path, &v)));
+    json_path_free(path);
+    json_value_free(&v);
+
+    /* a kept element past dropped ones is found at its original index */
+    test_projected("{\"items\":[null,null,null,{\"id\":9},null],\"n\":[null,[null,2,null]]}",
+                   "{\"items\":[1,{\"id\":2},[3],{\"id\":9,\"x\":0},5],\"n\":[0,[1,2,3]]}", pointers + 7, 2);
+
+    /* a scalar root is dropped, an empty one still reports the error */
+    EXPECT_EQ_INT(JSON_PARSE_OK, json_parse_projected(&v, "\"s\"", 3, fields, NULL));
+    EXPECT_EQ_INT(JSON_NULL, json_get_type(&v));
+    EXPECT_EQ_INT(JSON_PARSE_EXPECT_VALUE, json_parse_projected(&v, " ", 1, fields, NULL));
+
+    /* skipped values fail as the full parse does */
+    for (i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++) {
+        json_value_init(&full);
+        EXPECT_EQ_INT(json_parse_n(&full, invalid[i], strlen(invalid[i])),
+                      json_parse_projected(&v, invalid[i], strlen(invalid[i]), fields, NULL));
+        EXPECT_EQ_INT(JSON_NULL, json_get_type(&v));
+    }
+    json_field_set_free(fields);
+}
+
+/* feeds json in pieces of at most step bytes, the first piece cut at split */
+static int test_stream_parse(json_stream *stream, json_value *v, const char *json, size_t split, size_t step) {
+    size_t len = strlen(json), i = 0, n;
+
+    n = split < len ? split : len;
+    for (;;) {
+        int ret = json_stream_feed(stream, json + i, n);
+        i += n;
+        if (JSON_PARSE_OK != ret || i == len) {
+            break;
+        }
+        n = len - i < step ? len - i : step;
+    }
+    return json_stream_finish(stream, v);
+}
+
+static void test_stream() {
+    static const char *docs[] = {
+        "null", "true", "false", " 123 ", "-0.5e-3", "1.7976931348623157e308", "18446744073709551615",
+        "\"\"", "\"Hello\\nWorld\"", "\"\\u0024\\u00A2\\u20AC\\uD834\\uDD1E\"", "\"\\\\\\\"\\/\"",
+        "[]", "{}", "[ ]", "{ }", "[[[]]]", "[1,[2,[3,{\"a\":[true,false,null]}]]]",
+        "{\"n\":null,\"f\":false,\"t\":true,\"i\":123,\"s\":\"abc\",\"a\":[1,2,3],\"o\":{\"1\":1,\"2\":2,\"3\":3}}",
+        " { \"k\\u0000\" : [ -1.25e+2 , \"v\\t\" ] , \"\" : { } } ",
+        "123 trailing", "truex", "[1.2.3]", "[0123]",
+        "", " ", "nul", "tru", "[", "[1", "[1,", "[1,]", "[1 2]", "{", "{\"a\"", "{\"a\":", "{\"a\":1", "{\"a\" 1}",
+        "{1:1}", "{\"a\":1,}", "\"abc", "\"\\v\"", "\"\\u12\"", "\"\\uD800\"", "\"a\x01\"", "-", "+1", "1e", "[?]"
+    };
+    static const size_t steps[] = { 1, 2, 3, 7 };
+    json_stream *stream = json_stream_create();
+    char *expect_json, *json2;
+    size_t i, split, s, length, length2;
+    json_value expect, v;
+    int expect_ret;
+
+    for (i = 0; i < sizeof(docs) / sizeof(docs[0]); i++) {
+        json_value_init(&expect);
+        expect_ret = json_parse_n(&expect, docs[i], strlen(docs[i]));
+        expect_json = JSON_PARSE_OK == expect_ret ? json_stringify(&expect, &length) : NULL;
+
+        for (s = 0; s < sizeof(steps) / sizeof(steps[0]); s++) {
+            for (split = 0; split <= strlen(docs[i]); split++) {
+                EXPECT_EQ_INT(expect_ret, test_stream_parse(stream, &v, docs[i], split, steps[s]));
+                if (JSON_PARSE_OK == expect_ret) {
+                    json2 = json_stringify(&v, &length2);
+                    EXPECT_EQ_SIZE_T(length, length2);
+                    EXPECT_TRUE(0 == memcmp(expect_json, json2, length));
+                    free(json2);
+                }
+                EXPECT_TRUE(JSON_PARSE_OK == expect_ret || JSON_NULL == json_get_type(&v));
+                json_value_free(&v);
+            }
+        }
+
+        free(expect_json);
+        json_value_free(&expect);
+    }
+
+    /* an error sticks until finish, then the stream takes the next document */
+    EXPECT_EQ_INT(JSON_PARSE_MISS_COLON, json_stream_feed(stream, "{\"a\" 1", 6));
+    EXPECT_EQ_INT(JSON_PARSE_MISS_COLON, json_stream_feed(stream, "}", 1));
+    EXPECT_EQ_INT(JSON_PARSE_MISS_COLON, json_stream_finish(stream, &v));
+    EXPECT_EQ_INT(JSON_PARSE_OK, json_stream_feed(stream, "[\"x\"", 4));
+    EXPECT_EQ_INT(JSON_PARSE_OK, json_stream_feed(stream, "]", 1));
+    EXPECT_EQ_INT(JSON_PARSE_OK, json_stream_finish(stream, &v));
+    EXPECT_EQ_SIZE_T((size_t)1, json_get_array_size(&v));
+    json_value_free(&v);
+
+    /* dropped half way through a deep tree */
+    EXPECT_EQ_INT(JSON_PARSE_OK, json_stream_feed(stream, "{\"a\":[1,{\"b\":[\"c\",{\"d\":\"e", 25));
+    json_stream_free(stream);
+}
+
+/* records events as a compact log, aborting at event number abort_at when set */
+typedef struct {
+    char log[256];
+    int events, abort_at;
+} test_sax_log;
+
+static void test_sax_append(test_sax_log *l, const char *s, size_t len) {
+    size_t n = strlen(l->log);
+    if (n + len + 1 < sizeof(l->log)) {
+        memcpy(l->log + n, s, len);
+        l->log[n + len] = '\0';
+    }
+}
+
+static int test_sax_event(void *user, const char *s) {
+    test_sax_log *l = (test_sax_log *)user;
+    test_sax_append(l, s, strlen(s));
+    return ++l->events == l->abort_at;
+}
+
+static int test_sax_null(void *user) { return test_sax_event(user, "n "); }
+static int test_sax_boolean(void *user, int b) { return test_sax_event(user, b ? "t " : "f "); }
+static int test_sax_start_object(void *user) { return test_sax_event(user, "{ "); }
+static int test_sax_start_array(void *user) { return test_sax_event(user, "[ "); }
+
+static int test_sax_string(void *user, const char *str, size_t len) {
+    test_sax_append(user, "\"", 1);
+    test_sax_append(user, str, len);
+    return test_sax_event(user, "\" ");
+}
+
+static int test_sax_key(void *user, const char *key, size_t len) {
+    test_sax_append(user, key, len);
+    return test_sax_event(user, ":");
+}
+
+static int test_sax_number(void *user, const json_value *number) {
+    char buffer[32];
+    if (json_is_int64(number)) {
+        sprintf(buffer, "i%ld ", (long)json_get_int64(number));
+    } else {
+        sprintf(buffer, "%g ", json_get_number(number));
+    }
+    return test_sax_event(user, buffer);
+}
+
+static int test_sax_end_object(void *user, size_t size) {
+    char buffer[32];
+    sprintf(buffer, "}%lu ", (unsigned long)size);
+    return test_sax_event(user, buffer);
+}
+
+static int test_sax_end_array(void *user, size_t size) {
+    char buffer[32];
+    sprintf(buffer, "]%lu ", (unsigned long)size);
+    return test_sax_event(user, buffer);
+}
+
+static const json_sax_handler test_sax_handler = {
+    test_sax_null, test_sax_boolean, test_sax_number, test_sax_string, test_sax_key,
+    test_sax_start_object, test_sax_end_object, test_sax_start_array, test_sax_end_array
+};
+
+#define TEST_SAX(expect_ret, expect_log, json, abort) \
+    do {\
+        test_sax_log l;\
+        l.log[0] = '\0';\
+        l.events = 0;\
+        l.abort_at = abort;\
+        EXPECT_EQ_INT(expect_ret, json_parse_sax(json, sizeof(json) - 1, &test_sax_handler, &l));\
+        EXPECT_EQ_STRING(expect_log, l.log, strlen(l.log));\
+    } while(0)
+
+static void test_parse_sax() {
+    static const char *invalid[] = {
+        "", "nul", "[1,]", "[1 2]", "{", "{1:1}", "{\"a\" 1}", "{\"a\":1,}", "\"abc", "\"\\v\"", "\"\\uD800\"", "[?]"
+    };
+    static const char *docs[] = {
+        " null ", "[null,false,true,-1,1.5,\"abc\",[1]]", "{\"a\":[1],\"b\":{\"c\":\"d\"},\"e\":null}",
+        "{\"k\\u00e9y\":[\"x\\ny\",{},[]],\"\":123456789012}", "[ ]", "{ }", "\"Hello\\nWorld\"",
+        "", "nul", "[1,]", "[1 2]", "{", "{1:1}", "{\"a\" 1}", "{\"a\":1,}", "\"abc", "\"\\v\"", "[?]", "[1"
+    };
+    static const json_sax_handler empty = { NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL };
+    size_t i;
+
+    TEST_SAX(JSON_PARSE_OK, "n ", " null ", 0);
+    TEST_SAX(JSON_PARSE_OK, "\"Hello\nWorld\" ", "\"Hello\\nWorld\"", 0);
+    TEST_SAX(JSON_PARSE_OK, "[ ]0 ", "[ ]", 0);
+    TEST_SAX(JSON_PARSE_OK, "{ }0 ", "{ }", 0);
+    TEST_SAX(JSON_PARSE_OK, "[ n f t i-1 1.5 \"abc\" [ i1 ]1 ]7 ", "[null,false,true,-1,1.5,\"abc\",[1]]", 0);
+    TEST_SAX(JSON_PARSE_OK, "{ a:[ i1 ]1 b:{ c:\"d\" }1 e:n }3 ", "{\"a\":[1],\"b\":{\"c\":\"d\"},\"e\":null}", 0);
+
+    /* stopping at the third event leaves the rest unread */
+    TEST_SAX(JSON_PARSE_ABORTED, "[ n f ", "[null,false,true]", 3);
+    TEST_SAX(JSON_PARSE_ABORTED, "{ a:", "{\"a\":[1]}", 2);
+    TEST_SAX(JSON_PARSE_ABORTED, "[ ]0 ", "[]", 2);
+
+    /* errors are those of json_parse_n */
+    for (i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++) {
+        json_value v;
+        json_value_init(&v);
+        EXPECT_EQ_INT(json_parse_n(&v, invalid[i], strlen(invalid[i])),
+                      json_parse_sax(invalid[i], strlen(invalid[i]), &empty, NULL));
+        json_value_free(&v);
+    }
+    EXPECT_EQ_INT(JSON_PARSE_OK, json_parse_sax("{\"a\":[1,\"\\u20AC\",{}]}", 21, &empty, NULL));
+
+    /* a sax stream reports the same events and errors whatever the chunks */
+    for (i = 0; i < sizeof(docs) / sizeof(docs[0]); i++) {
+        size_t len = strlen(docs[i]), split, abort;
+
+        for (abort = 0; abort < 4; abort++) {
+            for (split = 0; split <= len; split++) {
+                test_sax_log expect, l;
+                json_stream *stream;
+                json_value v;
+                int ret;
+
+                expect.log[0] = l.log[0] = '\0';
+                expect.events = l.events = 0;
+                expect.abort_at = l.abort_at = (int)abort;
+                ret = json_parse_sax(docs[i], len, &test_sax_handler, &expect);
+                stream = json_stream_create_sax(&test_sax_handler, &l);
+                EXPECT_EQ_INT(ret, test_stream_parse(stream, &v, docs[i], split, 1 + split % 3));
+                EXPECT_EQ_INT(JSON_NULL, json_get_type(&v));
+                EXPECT_EQ_BASE(0 == strcmp(expect.log, l.log), expect.log, l.log, "%s");
+                json_stream_free(stream);
+            }
+        }
+    }
+}
+
+typedef struct {
+    size_t calls, last_line, stop_at;
+    int ok;
+} test_ndjson_state;
+
+/* line i holds {"id":i,...}, except every 50th run has a blank line and a broken one */
+static int test_ndjson_line(void *user, size_t line, int error, json_value *value) {
+    test_ndjson_state *state = (test_ndjson_state *)user;
+
+    state->ok = state->ok && line > state->last_line;
+    if (line % 50 == 13) {
+        state->ok = state->ok && JSON_PARSE_EXPECT_VALUE == error && JSON_NULL == json_get_type(value);
+    } else {
+        state->ok = state->ok && line % 50 != 7 && JSON_PARSE_OK == error &&
+                    (double)line == json_get_number(json_find_object_value(value, "id", 2));
+    }
+    state->last_line = line;
+    json_value_free(value);
+    return ++state->calls == state->stop_at;
+}
+
+static void test_parse_ndjson() {
+    static const int threads[] = { 1, 2, 4, 0 };
+    json_parse_options options;
+    test_ndjson_state state;
+    char *json;
+    size_t i, len = 0;
+    int t;
+
+    json = (char *)malloc(5000 * 64);
+    for (i = 1; i <= 5000; i++) {
+        if (i % 50 == 7) {
+            len += sprintf(json + len, " \r\n");
+        } else if (i % 50 == 13) {
+            len += sprintf(json + len, "{\"id\":\n");
+        } else {
+            len += sprintf(json + len, "{\"id\":%lu,\"name\":\"record\",\"tags\":[1,2,3]}%s",
+                           (unsigned long)i, i < 5000 ? "\n" : "");
+        }
+    }
+
+    options.flags = JSON_PARSE_STRING_VIEWS;
+    for (t = 0; t < (int)(sizeof(threads) / sizeof(threads[0])); t++) {
+        state.calls = state.last_line = state.stop_at = 0;
+        state.ok = 1;
+        EXPECT_EQ_INT(JSON_PARSE_OK, json_parse_ndjson(json, len, threads[t], NULL, test_ndjson_line, &state));
+        EXPECT_TRUE(state.ok);
+        EXPECT_EQ_SIZE_T((size_t)4900, state.calls);
+        EXPECT_EQ_SIZE_T((size_t)5000, state.last_line);
+
+        state.calls = state.last_line = state.stop_at = 0;
+        state.ok = 1;
+        EXPECT_EQ_INT(JSON_PARSE_OK, json_parse_ndjson(json, len, threads[t], &options, test_ndjson_line, &state));
+        EXPECT_TRUE(state.ok);
+        EXPECT_EQ_SIZE_T((size_t)4900, state.calls);
+
+        /* stopping early: no more calls, the rest is freed */
+        state.calls = state.last_line = 0;
+        state.stop_at = 1234;
+        state.ok = 1;
+        EXPECT_EQ_INT(JSON_PARSE_ABORTED, json_parse_ndjson(json, len, threads[t], NULL, test_ndjson_line, &state));
+        EXPECT_TRUE(state.ok);
+        EXPECT_EQ_SIZE_T((size_t)1234, state.calls);
+    }
+
+    state.calls = state.last_line = state.stop_at = 0;
+    EXPECT_EQ_INT(JSON_PARSE_OK, json_parse_ndjson("", 0, 2, NULL, test_ndjson_line, &state));
+    EXPECT_EQ_SIZE_T((size_t)0, state.calls);
+
+    free(json);
+}
+
+static void test_write_file(const char *path, const char *json) {
+    FILE *file = fopen(path, "wb");
+    fputs(json, file);
+    fclose(file);
+}
+
+static int test_count_values(void *user) {
+    ++*(int *)user;
+    return 0;
+}
+
+static void test_parse_file() {
+    static const char *path = "json_parse_test.tmp";
+    json_sax_handler handler = { NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL };
+    json_value v;
+    size_t length;
+    char *json;
+    int count = 0;
+
+    test_write_file(path, " {\"a\":[1,\"\\u20AC\",null],\"b\":{\"c\":true}} \n");
+    EXPECT_EQ_INT(JSON_PARSE_OK, json_parse_file(&v, path));
+    json = json_stringify(&v, &length);
+    EXPECT_EQ_STRING("{\"a\":[1,\"\xE2\x82\xAC\",null],\"b\":{\"c\":true}}", json, length);
+    free(json);
+    json_value_free(&v);
+
+    handler.null_fn = test_count_values;
+    EXPECT_EQ_INT(JSON_PARSE_OK, json_parse_file_sax(path, &handler, &count));
+    EXPECT_EQ_INT(1, count);
+
+    test_write_file(path, "[1,2");
+    EXPECT_EQ_INT(JSON_PARSE_MISS_COMMA_OR_SQUARE_BRACKET, json_parse_file(&v, path));
+    EXPECT_EQ_INT(JSON_NULL, json_get_type(&v));
+    EXPECT_EQ_INT(JSON_PARSE_MISS_COMMA_OR_SQUARE_BRACKET, json_parse_file_sax(path, &handler, &count));
+
+    /* empty files cannot be mapped and take the reading path */
+    test_write_file(path, "");
+    EXPECT_EQ_INT(JSON_PARSE_EXPECT_VALUE, json_parse_file(&v, path));
+    EXPECT_EQ_INT(JSON_PARSE_EXPECT_VALUE, json_parse_file_sax(path, &handler, &count));
+
+    remove(path);
+    EXPECT_EQ_INT(JSON_PARSE_IO_ERROR, json_parse_file(&v, path));
+    EXPECT_EQ_INT(JSON_PARSE_IO_ERROR, json_parse_file_sax(path, &handler, &count));
+
+    /* a directory opens but fails to read: an I/O error, not a syntax error on no text */
+    EXPECT_EQ_INT(JSON_PARSE_IO_ERROR, json_parse_file(&v, "."));
+    EXPECT_EQ_INT(JSON_NULL, json_get_type(&v));
+    EXPECT_EQ_INT(JSON_PARSE_IO_ERROR, json_parse_file_sax(".", &handler, &count));
+}
+
+/* a top-level array past JSON_PARALLEL_MIN_SIZE whose strings hide brackets, commas and quotes */
+static char* test_parallel_json(size_t *len) {
+    char *json = (char *)malloc(4 * 1024 * 1024), *p = json;
+    size_t i, j;
+
+    p += sprintf(p, " [ ");
+    for (i = 0; i < 15000; i++) {
+        p += sprintf(p, "%s{\"id\":%lu,\"s\":\"a],[b}{\\\"c\\\\\",\"n\":[[],{},[1,-2.5e3,true,null]]",
+                     i ? " ,\n" : "", (unsigned long)i);
+        if (i % 100 == 0) {
+            for (j = 0; j < 40; j++) {
+                p += sprintf(p, ",\"k%lu\":%lu", (unsigned long)j, (unsigned long)j);
+            }
+        }
+        p += sprintf(p, "}");
+        if (i % 7 == 0) {
+            p += sprintf(p, ",\"plain string, with [brackets]\",123,[\"\\u005D\"]");
+        }
+    }
+    p += sprintf(p, " ] ");
+    *len = p - json;
+    return json;
+}
+
+static void test_parse_parallel() {
+    static const char *breakers[] = { "1 2", "1,]", "[1,2", "}", "\"abc", "tru" };
+    json_document *doc = json_document_create(), *expect_doc = json_document_create();
+    char *json = NULL, *expect = NULL, *actual;
+    size_t len, i, length, expect_length = 0;
+    int threads, ret;
+
+    json = test_parallel_json(&len);
+    EXPECT_TRUE(len > 1024 * 1024);
+    EXPECT_EQ_INT(JSON_PARSE_OK, json_parse_into_n(expect_doc, json, len));
+    expect = json_stringify(json_document_root(expect_doc), &expect_length);
+
+    for (threads = 1; threads <= 4; threads++) {
+        EXPECT_EQ_INT(JSON_PARSE_OK, json_parse_into_parallel(doc, json, len, threads, NULL));
+        actual = json_stringify(json_document_root(doc), &length);
+        EXPECT_EQ_SIZE_T(expect_length, length);
+        EXPECT_TRUE(0 == memcmp(expect, actual, length));
+        free(actual);
+        /* indexed objects build their index in their worker's arena */
+        EXPECT_EQ_DOUBLE(39.0, json_get_number(json_find_object_value(
+            json_get_array_element(json_document_root(doc), 3000 + 3 * (3000 / 7 + 1)), "k39", 3)));
+    }
+
+    /* broken elements fall back to the sequential parser and its error */
+    for (i = 0; i < sizeof(breakers) / sizeof(breakers[0]); i++) {
+        char *broken = (char *)malloc(len + 16);
+        size_t half = len / 2;
+        while (json[half] != '\n') {
+            half++;
+        }
+        memcpy(broken, json, half + 1);
+        strcpy(broken + half + 1, breakers[i]);
+        memcpy(broken + half + 1 + strlen(breakers[i]), json + half + 1, len - half - 1);
+
+        ret = json_parse_into_n(expect_doc, broken, len + strlen(breakers[i]));
+        EXPECT_TRUE(JSON_PARSE_OK != ret);
+        EXPECT_EQ_INT(ret, json_parse_into_parallel(doc, broken, len + strlen(breakers[i]), 3, NULL));
+        EXPECT_EQ_INT(JSON_NULL, json_get_type(json_document_root(doc)));
+        free(broken);
+    }
+
+    /* input cut off right after a backslash inside a string */
+    {
+        char *cut = (char *)malloc(len);
+        memcpy(cut, json, len);
+        cut[len - 2] = '\"';
+        cut[len - 1] = '\\';
+        ret = json_parse_into_n(expect_doc, cut, len);
+        EXPECT_TRUE(JSON_PARSE_OK != ret);
+        EXPECT_EQ_INT(ret, json_parse_into_parallel(doc, cut, len, 3, NULL));
+        free(cut);
+    }
+
+    EXPECT_EQ_INT(JSON_PARSE_OK, json_parse_into_parallel(doc, "{\"a\":[1]}", 9, 4, NULL));
+    EXPECT_EQ_INT(JSON_OBJECT, json_get_type(json_document_root(doc)));
+
+    /* past the size threshold, what is not an array goes to the sequential parser too */
+    {
+        char *other = (char *)malloc(len + 8);
+        EXPECT_EQ_INT(JSON_PARSE_OK, json_parse_into_n(expect_doc, json, len));
+        memset(other, ' ', len + 8);
+        EXPECT_EQ_INT(JSON_PARSE_EXPECT_VALUE, json_parse_into_parallel(doc, other, len + 8, 3, NULL));
+        EXPECT_EQ_INT(JSON_NULL, json_get_type(json_document_root(doc)));
+        memcpy(other, "{\"a\":", 5);
+        memcpy(other + 5, json, len);
+        other[len + 5] = '}';
+        EXPECT_EQ_INT(JSON_PARSE_OK, json_parse_into_parallel(doc, other, len + 8, 3, NULL));
+        EXPECT_EQ_INT(JSON_OBJECT, json_get_type(json_document_root(doc)));
+        EXPECT_EQ_SIZE_T(json_get_array_size(json_document_root(expect_doc)),
+                         json_get_array_size(json_find_object_value(json_document_root(doc), "a", 1)));
+        free(other);
+    }
+
+    free(expect);
+    free(json);
+    json_document_free(expect_doc);
+    json_document_free(doc);
+}
+
+static void test_parse_lazy() {
+    static const char *docs[] = {
+        "[]", "{}", "[[]]", "[1,[2,[3,{\"a\":[true,false,null]}]]]",
+        "{\"n\":null,\"s\":\"a]}\\\"[{\",\"a\":[1,2,3],\"o\":{\"1\":{},\"2\":[\"]\"],\"3\":3}}",
+        " { \"k\\u0000\" : [ -1.25e+2 , \"v\\t\" ] , \"\" : { } } ", "[\"\\\\\",[\"\\\\\\\"]\"],{\"\\\\\":[]}]",
+        "[1,[2", "{\"a\":{\"b\":[}", "[[1]", "[[\"]\"]", "{\"a\":[1]", "[{]",
+        "{\"a\":[1,,2],\"b\":3}", "[{\"x\":tru}]", "[[1}]", "[{\"a\":1]]", "[[\"\\x\"]]"
+    };
+    json_parse_options options;
+    json_document *doc = json_document_create();
+    json_value v, expect, *child;
+    char *json, *expect_json, *actual_json, *p;
+    size_t i, length, expect_length;
+    int ret;
+
+    options.flags = JSON_PARSE_LAZY;
+
+    /* fully expanded by json_stringify, lazy trees print like eager ones */
+    for (i = 0; i < sizeof(docs) / sizeof(docs[0]); i++) {
+        json_value_init(&expect);
+        ret = json_parse_n(&expect, docs[i], strlen(docs[i]));
+        EXPECT_EQ_INT(ret, json_parse_ex(&v, docs[i], strlen(docs[i]), &options));
+        EXPECT_EQ_INT(ret, json_parse_into_ex(doc, docs[i], strlen(docs[i]), &options));
+        if (JSON_PARSE_OK == ret) {
+            expect_json = json_stringify(&expect, &expect_length);
+            actual_json = json_stringify(&v, &length);
+            EXPECT_EQ_SIZE_T(expect_length, length);
+            EXPECT_TRUE(0 == memcmp(expect_json, actual_json, length));
+            free(actual_json);
+            actual_json = json_stringify(json_document_root(doc), &length);
+            EXPECT_EQ_SIZE_T(expect_length, length);
+            EXPECT_TRUE(0 == memcmp(expect_json, actual_json, length));
+            free(actual_json);
+            free(expect_json);
+        }
+        json_value_free(&expect);
+        json_value_free(&v);
+    }
+
+    /* only the containers looked into get parsed, once */
+    EXPECT_EQ_INT(JSON_PARSE_OK, json_parse_ex(&v, "{\"a\":[1,{\"b\":2}],\"c\":{\"d\":[]},\"e\":3}", 36, &options));
+    EXPECT_TRUE(0 == (v.flags & JSON_FLAG_LAZY));
+    EXPECT_EQ_SIZE_T((size_t)3, json_get_object_size(&v));
+    child = json_find_object_value(&v, "a", 1);
+    EXPECT_EQ_INT(JSON_ARRAY, json_get_type(child));
+    EXPECT_TRUE(0 != (child->flags & JSON_FLAG_LAZY));
+    EXPECT_TRUE(0 != (json_get_object_value(&v, 1)->flags & JSON_FLAG_LAZY));
+    EXPECT_EQ_SIZE_T((size_t)2, json_get_array_size(child));
+    EXPECT_TRUE(0 == (child->flags & JSON_FLAG_LAZY));
+    EXPECT_TRUE(0 != (json_get_array_element(child, 1)->flags & JSON_FLAG_LAZY));
+    EXPECT_EQ_DOUBLE(2.0, json_get_number(json_find_object_value(json_get_array_element(child, 1), "b", 1)));
+    EXPECT_TRUE(json_get_array_element(child, 1) == json_get_array_element(child, 1));
+    EXPECT_TRUE(0 != (json_get_object_value(&v, 1)->flags & JSON_FLAG_LAZY));
+    json_value_free(&v);
+
+    /* a malformed skipped value fails the parse, it never reads as empty */
+    EXPECT_EQ_INT(JSON_PARSE_INVALID_VALUE, json_parse_ex(&v, "[[1,],{\"a\":1}]", 15, &options));
+    EXPECT_EQ_INT(JSON_NULL, json_get_type(&v));
+    EXPECT_EQ_INT(JSON_PARSE_MISS_COLON, json_parse_ex(&v, "[[1],{\"a\" 1}]", 14, &options));
+    EXPECT_EQ_INT(JSON_PARSE_MISS_COMMA_OR_SQUARE_BRACKET, json_parse_into_ex(doc, "[[1}]", 5, &options));
+
+    /* string views reach the values parsed on first use */
+    options.flags = JSON_PARSE_LAZY | JSON_PARSE_STRING_VIEWS;
+    EXPECT_EQ_INT(JSON_PARSE_OK, json_parse_into_ex(doc, "[[\"abc\"]]", 9, &options));
+    child = json_get_array_element(json_get_array_element(json_document_root(doc), 0), 0);
+    EXPECT_TRUE(0 != (child->flags & JSON_FLAG_STRING_VIEW));
+    EXPECT_EQ_STRING("abc", json_get_string(child), json_get_string_length(child));
+
+    /* brackets in long strings and escapes across 64-byte blocks are skipped over */
+    json = (char *)malloc(64 * 1024);
+    p = json + sprintf(json, "[");
+    for (i = 0; i < 200; i++) {
+        p += sprintf(p, "%s{\"s\":\"%.*s\\\\\\\"]}\",\"t\":[\"%.*s\\\\\"]}", i ? "," : "",
+                     (int)(i % 67), "[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[",
+                     (int)(i % 61), "}}}}}}}}}}}}}}}}}}}}}}}}}}}}}}}}}}}}}}}}}}}}}}}}}}}}}}}}}}}}}}}}}");
+    }
+    sprintf(p, "]");
+    json_value_init(&expect);
+    EXPECT_EQ_INT(JSON_PARSE_OK, json_parse(&expect, json));
+    EXPECT_EQ_INT(JSON_PARSE_OK, json_parse_into_ex(doc, json, strlen(json), &options));
+    expect_json = json_stringify(&expect, &expect_length);
+    actual_json = json_stringify(json_document_root(doc), &length);
+    EXPECT_EQ_SIZE_T(expect_length, length);
+    EXPECT_TRUE(0 == memcmp(expect_json, actual_json, length));
+    free(actual_json);
+    free(expect_json);
+    json_value_free(&expect);
+    free(json);
+
+    /* elements parsed on worker threads leave their children for later too */
+    options.flags = JSON_PARSE_LAZY;
+    json = test_parallel_json(&length);
+    EXPECT_EQ_INT(JSON_PARSE_OK, json_parse_into_parallel(doc, json, length, 3, &options));
+    child = json_get_array_element(json_document_root(doc), 7);
+    EXPECT_TRUE(0 != (json_find_object_value(child, "n", 1)->flags & JSON_FLAG_LAZY));
+    EXPECT_EQ_SIZE_T((size_t)4, json_get_array_size(json_get_array_element(json_find_object_value(child, "n", 1), 2)));
+    free(json);
+
+    json_document_free(doc);
+}
+
+static int test_tape_equal(const json_tape *tape, json_tape_ref ref, const json_value *v) {
+    json_value number;
+    json_tape_ref r;
+    const char *s;
+    size_t len, i = 0;
+
+    if (json_tape_get_type(tape, ref) != json_get_type(v)) {
+        return 0;
+    }
+    switch (json_get_type(v)) {
+        case JSON_NUMBER:
+            json_tape_get_number(tape, ref, &number);
+            return number.flags == v->flags && number.u.u64 == v->u.u64;
+        case JSON_STRING:
+            s = json_tape_get_string(tape, ref, &len);
+            return len == json_get_string_length(v) && 0 == memcmp(s, json_get_string(v), len);
+        case JSON_ARRAY:
+            for (r = json_tape_first(tape, ref); 0 != r; r = json_tape_next(tape, r), i++) {
+                if (i == json_get_array_size(v) || !test_tape_equal(tape, r, json_get_array_element(v, i))) {
+                    return 0;
+                }
+            }
+            return i == json_get_array_size(v) && i == json_tape_get_size(tape, ref);
+        case JSON_OBJECT:
+            for (r = json_tape_first(tape, ref); 0 != r; r = json_tape_next(tape, json_tape_next(tape, r)), i++) {
+                if (i == json_get_object_size(v)) {
+                    return 0;
+                }
+                s = json_tape_get_string(tape, r, &len);
+                if (len != json_get_object_key_length(v, i) || 0 != memcmp(s, json_get_object_key(v, i), len) ||
+                    !test_tape_equal(tape, json_tape_next(tape, r), json_get_object_value(v, i))) {
+                    return 0;
+                }
+            }
+            return i == json_get_object_size(v) && i == json_tape_get_size(tape, ref);
+        default:
+            return 1;
+    }
+}
+
+/* results and errors of json_parse_n, read off the tape */
+static void test_tape_against_parse(json_tape *tape, const char *json, size_t len) {
+    json_value expect;
+    int ret;
+
+    json_value_init(&expect);
+    ret = json_parse_n(&expect, json, len);
+    EXPECT_EQ_INT(ret, json_parse_tape(tape, json, len));
+    EXPECT_TRUE(JSON_PARSE_OK == ret ? test_tape_equal(tape, json_tape_root(tape), &expect)
+                                     : JSON_NULL == json_tape_get_type(tape, json_tape_root(tape)));
+    json_value_free(&expect);
+}
+
+static void test_parse_tape() {
+    static const char *docs[] = {
+        "null", "true", "false", " 123 ", "-0.5e-3", "1.7976931348623157e308", "18446744073709551615",
+        "-9223372036854775808", "\"\"", "\"Hello\\nWorld\"", "\"\\u0024\\u00A2\\u20AC\\uD834\\uDD1E\"",
+        "\"\\\\\\\"\\/\"", "[]", "{}", "[ ]", "{ }", "[[[]]]", "[1,[2,[3,{\"a\":[true,false,null]}]]]",
+        "{\"n\":null,\"f\":false,\"t\":true,\"i\":123,\"s\":\"abc\",\"a\":[1,2,3],\"o\":{\"1\":1,\"2\":2,\"3\":3}}",
+        " { \"k\\u0000\" : [ -1.25e+2 , \"v\\t\" ] , \"\" : { } } ", "[\"a\\\\\",\"\\\\\\\"]\"]",
+        "123 trailing", "truex", "\"a\"b", "[1.2.3]", "[0123]", "[1x]", "[truex]", "[1\"a\"]", "{\"a\"x:1}",
+        "", " ", "nul", "tru", "[", "[1", "[1,", "[1,]", "[1 2]", "{", "{\"a\"", "{\"a\":", "{\"a\":1",
+        "{\"a\" 1}", "{1:1}", "{\"a\":1,}", "\"abc", "\"\\v\"", "\"\\u12\"", "\"\\uD800\"", "\"a\x01\"", "-",
+        "+1", "1e", "[?]", "[\\\"]", "{\"a\":1]", "[1}"
+    };
+    json_tape *tape = json_tape_create();
+    json_tape_ref root, a;
+    json_value number;
+    const char *s;
+    char *json;
+    size_t i, len;
+    int level;
+
+    /* a fresh tape reads as null */
+    EXPECT_EQ_INT(JSON_NULL, json_tape_get_type(tape, json_tape_root(tape)));
+
+    for (level = JSON_SIMD_NONE; level <= JSON_SIMD_AVX2; level++) {
+        json_set_simd(level);
+        for (i = 0; i < sizeof(docs) / sizeof(docs[0]); i++) {
+            test_tape_against_parse(tape, docs[i], strlen(docs[i]));
+        }
+    }
+    json_set_simd(JSON_SIMD_AVX2);
+
+    EXPECT_EQ_INT(JSON_PARSE_OK, json_parse_tape(tape, "{\"a\":[1,-2,18446744073709551615,0.5],\"b\\n\":\"x\\u20ACy\",\"c\":{}}", 62));
+    root = json_tape_root(tape);
+    EXPECT_EQ_INT(JSON_OBJECT, json_tape_get_type(tape, root));
+    EXPECT_EQ_SIZE_T((size_t)3, json_tape_get_size(tape, root));
+    a = json_tape_find_object_value(tape, root, "a", 1);
+    EXPECT_EQ_SIZE_T((size_t)4, json_tape_get_size(tape, a));
+    json_tape_get_number(tape, json_tape_get_array_element(tape, a, 1), &number);
+    EXPECT_EQ_INT64(-2, json_get_int64(&number));
+    json_tape_get_number(tape, json_tape_get_array_element(tape, a, 2), &number);
+    EXPECT_TRUE(json_is_uint64(&number) && UINT64_MAX == json_get_uint64(&number));
+    json_tape_get_number(tape, json_tape_get_array_element(tape, a, 3), &number);
+    EXPECT_EQ_DOUBLE(0.5, json_get_number(&number));
+    EXPECT_EQ_SIZE_T((size_t)0, json_tape_next(tape, json_tape_get_array_element(tape, a, 3)));
+    s = json_tape_get_string(tape, json_tape_find_object_value(tape, root, "b\n", 2), &len);
+    EXPECT_EQ_STRING("x\xE2\x82\xAC" "y", s, len);
+    EXPECT_EQ_SIZE_T((size_t)0, json_tape_first(tape, json_tape_find_object_value(tape, root, "c", 1)));
+    EXPECT_EQ_SIZE_T((size_t)0, json_tape_find_object_value(tape, root, "d", 1));
+
+    /* a large document runs through many stage one windows */
+    json = test_parallel_json(&len);
+    test_tape_against_parse(tape, json, len);
+    EXPECT_EQ_SIZE_T((size_t)21429, json_tape_get_size(tape, json_tape_root(tape)));
+    free(json);
+
+    /* backslash runs and quotes on either side of window boundaries */
+    json = (char *)malloc(3 * 64 * 1024);
+    for (i = 64 * 1024 - 8; i < 64 * 1024 + 8; i++) {
+        memset(json, ' ', i);
+        json[0] = '[';
+        json[1] = '\"';
+        strcpy(json + i - 3, "\\\\\\\"\",\"\\\\\",1]");
+        test_tape_against_parse(tape, json, strlen(json));
+        json[1] = ' ';
+        json[2] = '\"';
+        test_tape_against_parse(tape, json, strlen(json));
+    }
+    free(json);
+
+    json_tape_free(tape);
+}
+
 #define TEST_JSON_STRINGIFY(json) \
     do {\
         json_value v;\
@@ -327,21 +1936,310 @@ static void testJsonStringify()
     TEST_JSON_STRINGIFY("-1");
     TEST_JSON_STRINGIFY("1.5");
     TEST_JSON_STRINGIFY("-1.5");
+    TEST_JSON_STRINGIFY("9007199254740993");
+    TEST_JSON_STRINGIFY("-9223372036854775808");
+    TEST_JSON_STRINGIFY("18446744073709551615");
 
     TEST_JSON_STRINGIFY("\"\"");
     TEST_JSON_STRINGIFY("\"Hello\"");
     TEST_JSON_STRINGIFY("\"Hello\\nWorld\"");
     TEST_JSON_STRINGIFY("\"\\\" \\\\ / \\b \\f \\n \\r \\t\"");
     TEST_JSON_STRINGIFY("\"Hello\\u0000World\"");
+
+    TEST_JSON_STRINGIFY("[]");
+    TEST_JSON_STRINGIFY("[null,false,true,123,\"abc\",[1,2,3]]");
+    TEST_JSON_STRINGIFY("{}");
+    TEST_JSON_STRINGIFY("{\"n\":null,\"f\":false,\"t\":true,\"i\":123,\"s\":\"abc\",\"a\":[1,2,3],\"o\":{\"1\":1,\"2\":2,\"3\":3}}");
+    TEST_JSON_STRINGIFY("{\"k\\\"\\n\\u001F\":[[[]],{\"\":{}}],\"x\":-1.5}");
+}
+
+#define TEST_STRINGIFY_NUMBER(expect, number) \
+    do {\
+        json_value v;\
+        size_t length = 0;\
+        char *json;\
+        json_value_init(&v);\
+        json_set_number(&v, number);\
+        json = json_stringify(&v, &length);\
+        EXPECT_EQ_STRING(expect, json, length);\
+        free(json);\
+    } while(0)
+
+/* significant digits of a formatted number, ignoring sign, zeros padding either end and exponent */
+static int test_significant_digits(const char *s) {
+    const char *first = NULL, *last = NULL;
+    for (; *s && *s != 'e' && *s != 'E'; s++) {
+        if (*s >= '1' && *s <= '9') {
+            if (!first) {
+                first = s;
+            }
+            last = s;
+        }
+    }
+    if (!first) {
+        return 1;
+    }
+    return (int)(last - first) + 1 - (first < last && memchr(first, '.', last - first) ? 1 : 0);
+}
+
+static void test_stringify_number() {
+    double zero = 0.0;
+    size_t i;
+
+    TEST_STRINGIFY_NUMBER("0.1", 0.1);
+    TEST_STRINGIFY_NUMBER("0.3", 0.3);
+    TEST_STRINGIFY_NUMBER("0.30000000000000004", 0.1 + 0.2);
+    TEST_STRINGIFY_NUMBER("-0", -zero);
+    TEST_STRINGIFY_NUMBER("2.5", 2.5);
+    TEST_STRINGIFY_NUMBER("100", 100.0);
+    TEST_STRINGIFY_NUMBER("-42", -42.0);
+    TEST_STRINGIFY_NUMBER("123456.789", 123456.789);
+    TEST_STRINGIFY_NUMBER("0.01", 0.01);
+    TEST_STRINGIFY_NUMBER("1e-3", 0.001);
+    TEST_STRINGIFY_NUMBER("1.5e-7", 1.5e-7);
+    TEST_STRINGIFY_NUMBER("1000000000000000", 1e15);
+    TEST_STRINGIFY_NUMBER("9007199254740991", 9007199254740991.0);
+    TEST_STRINGIFY_NUMBER("9007199254740992", 9007199254740992.0);
+    TEST_STRINGIFY_NUMBER("1e21", 1e21);
+    TEST_STRINGIFY_NUMBER("1e23", 1e23);
+    TEST_STRINGIFY_NUMBER("5e-324", 4.9406564584124654e-324);
+    TEST_STRINGIFY_NUMBER("2.2250738585072014e-308", 2.2250738585072014e-308);
+    TEST_STRINGIFY_NUMBER("1.7976931348623157e308", 1.7976931348623157e308);
+    TEST_STRINGIFY_NUMBER("null", 1.0 / zero);
+    TEST_STRINGIFY_NUMBER("null", zero / zero);
+
+    /* random bit patterns come back bit for bit, in no more digits than %.*e needs */
+    for (i = 0; i < 20000; i++) {
+        unsigned char bytes[sizeof(double)];
+        char shortest[32], *json;
+        double d, back;
+        size_t j, length;
+        int precision;
+        json_value v;
+
+        for (j = 0; j < sizeof(bytes); j++) {
+            bytes[j] = (unsigned char)test_random();
+        }
+        memcpy(&d, bytes, sizeof(d));
+        if (d != d || d - d != 0.0) {
+            continue;
+        }
+
+        json_value_init(&v);
+        json_set_number(&v, d);
+        json = json_stringify(&v, &length);
+        EXPECT_EQ_INT(JSON_PARSE_OK, json_parse(&v, json));
+        back = json_get_number(&v);
+        EXPECT_TRUE(0 == memcmp(&d, &back, sizeof(d)));
+
+        for (precision = 1; precision < 17; precision++) {
+            sprintf(shortest, "%.*e", precision - 1, d);
+            if (strtod(shortest, NULL) == d) {
+                break;
+            }
+        }
+        EXPECT_EQ_INT(precision, test_significant_digits(json));
+        free(json);
+    }
+}
+
+static void test_stringify_large() {
+    char *json, *json2;
+    size_t i, length, length2;
+    json_value v;
+
+    /* wide and nested enough that any undersized buffer would show */
+    json = (char *)malloc(64 * 2000 + 16);
+    strcpy(json, "[");
+    for (i = 0; i < 2000; i++) {
+        sprintf(json + strlen(json), "%s{\"id\":%lu,\"v\":[0.5,\"\\t\\u0001\",{\"deep\":[true]}]}",
+                i ? "," : "", (unsigned long)i);
+    }
+    strcat(json, "]");
+
+    json_value_init(&v);
+    EXPECT_EQ_INT(JSON_PARSE_OK, json_parse(&v, json));
+    json2 = json_stringify(&v, &length2);
+    length = strlen(json);
+    EXPECT_EQ_SIZE_T(length, length2);
+    EXPECT_TRUE(0 == memcmp(json, json2, length));
+    json_value_free(&v);
+
+    free(json);
+    free(json2);
+}
+
+static void test_stringify_string_runs() {
+    int level;
+
+    for (level = JSON_SIMD_NONE; level <= JSON_SIMD_AVX2; level++) {
+        size_t i;
+
+        json_set_simd(level);
+
+        /* escapes among clean runs at every offset of the vector strides, printed back as they were read */
+        for (i = 0; i < 70; i++) {
+            char json[95], *out;
+            size_t length;
+            json_value value;
+
+            memset(json, 'a', sizeof(json));
+            json[0] = '"';
+            json[i + 1] = '\\'; json[i + 2] = 'n';
+            json[i + 3] = '\xE2'; json[i + 4] = '\x82'; json[i + 5] = '\xAC';
+            memcpy(json + 86 - i / 8, "\\u001F", 6);
+            json[92] = '\\'; json[93] = '"';
+            json[94] = '"';
+
+            json_value_init(&value);
+            EXPECT_EQ_INT(JSON_PARSE_OK, json_parse_n(&value, json, sizeof(json)));
+            out = json_stringify(&value, &length);
+            EXPECT_EQ_SIZE_T(sizeof(json), length);
+            EXPECT_TRUE(0 == memcmp(json, out, sizeof(json)));
+            free(out);
+            json_value_free(&value);
+        }
+    }
+
+    json_set_simd(JSON_SIMD_AVX2);
+}
+
+typedef struct {
+    char *out;
+    size_t len, flushes, max_chunks, fail_after;
+} test_sink;
+
+static int test_sink_write(void *user, const json_chunk *chunks, size_t count) {
+    test_sink *sink = (test_sink *)user;
+    size_t i;
+
+    if (0 != sink->fail_after && sink->flushes + 1 == sink->fail_after) {
+        return 1;
+    }
+    sink->flushes++;
+    if (count > sink->max_chunks) {
+        sink->max_chunks = count;
+    }
+    for (i = 0; i < count; i++) {
+        sink->out = (char *)realloc(sink->out, sink->len + chunks[i].len);
+        memcpy(sink->out + sink->len, chunks[i].data, chunks[i].len);
+        sink->len += chunks[i].len;
+    }
+    return 0;
+}
+
+static void test_writer() {
+    static const char built[] =
+        "{\"id\":-7,\"big\":18446744073709551615,\"pi\":3.25,\"s\":\"a\\\"b\\n\\u0001\",\"ok\":true,"
+        "\"list\":[null,false,[],{}],\"\":[1,2]}";
+    test_sink sink = { NULL, 0, 0, 0, 0 };
+    json_writer *writer;
+    json_value v;
+    char *json, *expect;
+    size_t i, length;
+
+    /* a tree through a buffer much smaller than the output, long strings by reference */
+    json = (char *)malloc(3000 * 40 + 16);
+    strcpy(json, "[");
+    for (i = 0; i < 3000; i++) {
+        sprintf(json + strlen(json), "%s{\"id\":%lu,\"v\":[0.5,\"\\t\\\"x\"]}", i ? "," : "", (unsigned long)i);
+    }
+    strcat(json, ",\"");
+    length = strlen(json);
+    memset(json + length, 'w', 5000);
+    strcpy(json + length + 5000, "\\n\"]");
+    json_value_init(&v);
+    EXPECT_EQ_INT(JSON_PARSE_OK, json_parse(&v, json));
+    expect = json_stringify(&v, &length);
+
+    writer = json_writer_create(test_sink_write, &sink, 100);
+    EXPECT_EQ_INT(JSON_PARSE_OK, json_writer_value(writer, &v));
+    EXPECT_EQ_INT(JSON_PARSE_OK, json_writer_flush(writer));
+    EXPECT_EQ_SIZE_T(length, sink.len);
+    EXPECT_TRUE(0 == memcmp(expect, sink.out, length));
+    EXPECT_TRUE(sink.flushes > 1);
+    EXPECT_TRUE(sink.max_chunks >= 2);
+    json_writer_free(writer);
+    json_value_free(&v);
+    free(expect);
+    free(json);
+
+    /* the builder, commas placed for it */
+    sink.len = 0;
+    writer = json_writer_create(test_sink_write, &sink, 0);
+    json_writer_begin_object(writer);
+    json_writer_key(writer, "id", 2);
+    json_writer_int64(writer, -7);
+    json_writer_key(writer, "big", 3);
+    json_writer_uint64(writer, UINT64_MAX);
+    json_writer_key(writer, "pi", 2);
+    json_writer_number(writer, 3.25);
+    json_writer_key(writer, "s", 1);
+    json_writer_string(writer, "a\"b\n\001", 5);
+    json_writer_key(writer, "ok", 2);
+    json_writer_boolean(writer, 1);
+    json_writer_key(writer, "list", 4);
+    json_writer_begin_array(writer);
+    json_writer_null(writer);
+    json_writer_boolean(writer, 0);
+    json_writer_begin_array(writer);
+    json_writer_end_array(writer);
+    json_writer_begin_object(writer);
+    json_writer_end_object(writer);
+    json_writer_end_array(writer);
+    json_writer_key(writer, "", 0);
+    EXPECT_EQ_INT(JSON_PARSE_OK, json_parse(&v, "[1,2]"));
+    json_writer_value(writer, &v);
+    json_value_free(&v);
+    EXPECT_EQ_INT(JSON_PARSE_OK, json_writer_end_object(writer));
+    EXPECT_EQ_SIZE_T((size_t)0, sink.len);
+    EXPECT_EQ_INT(JSON_PARSE_OK, json_writer_flush(writer));
+    EXPECT_EQ_STRING(built, sink.out, sink.len);
+    json_writer_free(writer);
+
+    /* a failing sink stops the writer for good */
+    sink.len = sink.flushes = 0;
+    sink.fail_after = 2;
+    writer = json_writer_create(test_sink_write, &sink, 64);
+    json_writer_begin_array(writer);
+    for (i = 0; i < 100; i++) {
+        json_writer_string(writer, "0123456789", 10);
+    }
+    EXPECT_EQ_INT(JSON_PARSE_ABORTED, json_writer_end_array(writer));
+    EXPECT_EQ_INT(JSON_PARSE_ABORTED, json_writer_flush(writer));
+    EXPECT_EQ_SIZE_T((size_t)1, sink.flushes);
+    json_writer_free(writer);
+    free(sink.out);
 }
 
 int main(int argc, char const *argv[]) {
 	test_parse();
 	test_parse_number();
 	test_parse_invalid_number();
+    test_parse_number_roundtrip();
+    test_parse_integer();
     test_parse_string();
     test_parse_array();
     test_parse_object();
+    test_parse_n();
+    test_parse_whitespace();
+    test_parse_string_runs();
+    test_parse_utf8();
+    test_parse_string_views();
+    test_parse_inline_strings();
+    test_parse_document();
+    test_parse_parallel();
+    test_parse_lazy();
+    test_parse_tape();
+    test_find_object_value();
+    test_parse_intern_keys();
+    test_parser();
+    test_path();
+    test_parse_projected();
+    test_stream();
+    test_parse_sax();
+    test_parse_ndjson();
+    test_parse_file();
 
     test_access_number();
     test_access_string();
@@ -354,6 +2252,10 @@ int main(int argc, char const *argv[]) {
     test_parse_miss_comma_or_curly_bracket();
 
     testJsonStringify();
+    test_stringify_number();
+    test_stringify_large();
+    test_stringify_string_runs();
+    test_writer();
 
     printf("%d/%d (%3.2f%%) passed\n", test_pass, test_count, test_pass * 100.0 / test_count);
 	return main_ret;